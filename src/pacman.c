@@ -18,63 +18,197 @@ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
 SOFTWARE.
 *******************************************************************************/
 
+#define _GNU_SOURCE
+
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
 #include <math.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/epoll.h>
+#include <errno.h>
+#include <signal.h>
+#include <dirent.h>
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_image.h>
 
 #define WINDOW_TITLE "Pacman"
 #define SIZE_TILE 20
-#define FPS 15
+#define MAX_CATCHUP_TICKS 8
+#define INPUT_QUEUE 64
+#define TURN_BUFFER 4
+#define TURN_SAMPLES 4096
+#define SPECULATION_BUDGET 2
+#define SPECULATION_HORIZON 3
+#define SPECULATION_SAMPLES 4096
+#define SNAPSHOT_FRESH 4
+#define LAYER_PAD SIZE_TILE
+#define LAYER_MAX 4096
+#define ATLAS_WIDTH 1024
+#define TICK_RATE 60
+#define BENCH_TICKS 1200
+#define BENCH_GAME_TICKS (180 * TICK_RATE)
+#define BENCH_TRIALS 5
+#define BENCH_STATES 600
+#define BENCH_TOLERANCE 15.0
+#define SOAK_DECAY 0.2
+#define SOAK_GROWTH_KB 8192
+#define SOAK_CLEAR_TICKS (40 * TICK_RATE)
+#define ROLLOUT_TICKS (4 * TICK_RATE)
+#define MCTS_MAX_NODES 65536
+#define MCTS_MAX_DEPTH 32
+#define MCTS_EXPLORATION 0.7f
+#define SERVER_BATCH 64
+#define SERVER_EVENTS 256
+#define SERVER_STATS_TICKS (5 * TICK_RATE)
+#define REMOTE_RESTART 5
+#define STREAM_KEYFRAME 'K'
+#define STREAM_DELTA 'D'
+#define STREAM_KEYFRAME_TICKS (5 * TICK_RATE)
+#define STREAM_BUFFER 65536
+#define STREAM_MAX_GHOSTS 4096
+#define SCORE_FILE "score"
+#define SCORE_MAGIC 0x53434d50u
+#define SCORE_QUEUE 64
+#define SCORE_SESSIONS 1024
+#define SCORE_BATCH_MS 500
 
 #define SCREEN_WIDTH 560
 #define SCREEN_HEIGHT 660
+#define VIEW_HEIGHT (SCREEN_HEIGHT - SIZE_TILE * 2)
+
+#define CHUNK_SHIFT 6
+#define CHUNK_SIZE (1 << CHUNK_SHIFT)
+#define MAX_PORTALS 16
+#define RELEASE_AFTER_FOOD 30
+
+#define PACK_MAGIC "PACPACK"
+#define PACK_VERSION 1
+#define PACK_ALIGN 64
+#define MAX_DISTANCE_MAPS 9
+#define NO_DISTANCE UINT32_MAX
+#define NO_JUNCTION UINT32_MAX
+#define TILE_WALL 1
+#define TILE_PORTAL 2
+
+#define WHEEL_SLOTS 1024
 
 typedef enum { noFood = 0, smallBall = 1, largeBall = 2 } foodName;
 typedef enum { north = 0, south = 1, west = 2, east = 3 } neighbourName;
 typedef enum { up = 1, down = 2, left = 3, right = 4, idle = 5 } headingName; 
 typedef enum { scatter = 1, frightened = 2, eaten = 3, chase = 4, home = 5 } stateName;
 typedef enum { blinky = 0, pinky = 1, inky = 2, clyde = 3 } ghostName;
+typedef enum { packTiles, packFoodSmall, packFoodLarge, packDirections, packWalkable, packJunctions, packJunctionEdges, packDistance, packSections = packDistance + MAX_DISTANCE_MAPS } packSectionName;
+typedef enum { sheetMaze, sheetFood, sheetGhost, sheetPacman, sheetKill, sheetReady, sheetGameOver, sheetNumbers, sheets } sheetName;
+typedef enum { scatterEnd = 1, chaseEnd = 2, frightenedEnd = 3, frightenedAlmostEnd = 4, houseRelease = 5, pauseEnd = 6 } eventName;
 
 typedef struct {
     float gridX, gridY;
-    foodName food;
-    SDL_bool isWall;
+    int tileX, tileY;
+    SDL_bool isWall, isPortal;
 } gridClass;
 
-gridClass grid[33][30] = {{{ 0 }}};
+// compiled maze packs are mapped read-only; every reference inside is an offset from the start of the file
+typedef struct {
+    uint64_t offset, size, checksum;
+} packSectionClass;
+
+typedef struct {
+    char magic[8];
+    uint32_t version, headerSize;
+    int32_t width, height, playerX, playerY, houseX, houseY, houseW, houseH;
+    int32_t ghostSpawn[4][6];
+    int32_t portalCount, portal[MAX_PORTALS][4];
+    uint32_t foodTotal, walkableCount, junctionCount, distanceCount;
+    int32_t distanceTarget[MAX_DISTANCE_MAPS][2];
+    packSectionClass sections[packSections];
+    uint64_t checksum;
+} packHeaderClass;
+
+// junction edges lead to the next junction along each neighbourName direction
+typedef struct {
+    uint32_t junction, length;
+} junctionEdgeClass;
+
+// tiles live in square chunks that are read from the maze file on first use
+typedef struct {
+    int width, height, chunksX, chunksY, foodWords, portalCount;
+    unsigned int foodTotal;
+    int playerX, playerY, houseX, houseY, houseW, houseH;
+    int ghostSpawn[4][6]; // per behaviour: spawn x y, first scatter corner x y, second scatter corner x y
+    int portal[MAX_PORTALS][4];
+    gridClass **chunks;
+    const uint64_t *foodSmallInit, *foodLargeInit;
+    FILE *source;
+    long tilesOffset;
+    SDL_bool isBuiltIn;
+    const char *path;
+    const unsigned char *pack;
+    size_t packSize;
+    uint32_t packVerified;
+    SDL_mutex *lock;
+} mazeClass;
+
+mazeClass maze;
 
 typedef struct nodeClass {
     gridClass *gridPtr;
-    float nodeX, nodeY, g, f;
-    SDL_bool isWall, isVisited;
-    struct nodeClass *nodeParent, *allNeighbours[4];
+    float g, f;
+    unsigned int searchId;
+    SDL_bool isVisited;
+    struct nodeClass *nodeParent;
 } nodeClass;
 
-nodeClass *nodeStart = NULL;
-nodeClass *nodeEnd = NULL;
-nodeClass nodes[33][30] = {{{ 0 }}};
+// search nodes are reset lazily: a node whose searchId is stale counts as untouched;
+// every thread that simulates a game has its own search state
+_Thread_local nodeClass *nodeStart = NULL;
+_Thread_local nodeClass *nodeEnd = NULL;
+_Thread_local nodeClass **nodeChunks = NULL;
+_Thread_local unsigned int searchId = 0;
+_Thread_local int blockedNeighbour = -1;
+
+int cameraX = 0;
+int cameraY = 0;
+
+// how far the renderer is between the last two simulation ticks
+float renderAlpha = 1.0f;
+unsigned int drawCalls = 0;
 
 typedef struct {
-    float speed, posX, posY;
+    float speed, posX, posY, prevX, prevY;
     short vector[2];
     headingName curHeading, newHeading;
     SDL_bool isAlive, isMoving;
     gridClass *curGridPos, *newGridPos;
-    SDL_Rect pacmanTextureCrop, killTextureCrop;
-    unsigned int timeFrame;
 } playerClass;
 
+// ghosts are stored as a structure of arrays, one entry per ghost, so per-tick passes walk contiguous memory
 typedef struct {
-    float speed, posX, posY; 
-    short vector[2];
-    headingName heading;
-    stateName state;
-    gridClass *target, *curGridPos, *newGridPos, *scatterPointOne, *scatterPointTwo;
-    SDL_bool isMoving, isRandLocationSet, isTimeAlmostEnd;
-    SDL_Rect ghostTextureCrop;
-    unsigned int timeEnd;
+    int count;
+    float *speed, *posX, *posY, *prevX, *prevY;
+    short *vectorX, *vectorY;
+    headingName *heading;
+    stateName *state;
+    ghostName *behaviour;
+    gridClass **target, **curGridPos, **newGridPos, **scatterPointOne, **scatterPointTwo;
+    SDL_bool *isMoving, *isRandLocationSet, *isTimeAlmostEnd;
+    unsigned int *timerGeneration;
+    uint32_t *hitMask;
+    gridClass **specFrom, **specTarget, **specStep; // the step a ghost in transit expects to take on arrival, and what it assumed
+    headingName *specHeading; // idle when the ghost may turn back
 } enemyClass;
 
 typedef struct listClass {
@@ -82,1433 +216,8213 @@ typedef struct listClass {
     struct listClass *next;
 } listClass;
 
-listClass *listHead = NULL;
+_Thread_local listClass *listHead = NULL;
+
+// search counters per ghost and per state; only a thread that sets isRecordingPaths counts,
+// so autopilot rollouts and server sessions stay out of them
+#define GHOST_STATES 5
+#define PATH_BUCKETS 16
+#define PATH_TRACE_CELLS 4096
+
+typedef struct {
+    uint64_t searches, mapSteps, expanded, allocations, unreachable, latencyNs;
+    unsigned int openPeak;
+    uint64_t histogram[PATH_BUCKETS]; // bucket b counts searches under 2^b microseconds, the last one the rest
+} pathStatsClass;
+
+// tile indices of each ghost's last search, for the overlay
+typedef struct {
+    long *expanded, *path, target;
+    int expandedCount, pathCount;
+} pathTraceClass;
+
+typedef struct {
+    pathStatsClass *stats; // ghosts * GHOST_STATES
+    pathTraceClass *traces;
+    int ghosts;
+    SDL_bool isEnabled, isTracing;
+    SDL_mutex *lock; // guards traces, the render thread reads them
+} pathStatsTableClass;
+
+pathStatsTableClass pathStatsTable = { 0 };
+
+_Thread_local SDL_bool isRecordingPaths = SDL_FALSE;
+_Thread_local unsigned int listSize = 0, listPeak = 0, listAllocations = 0, searchExpanded = 0;
+_Thread_local uint64_t pathSearches = 0; // every search this thread ran, counted or not, speculative ones aside
+_Thread_local long searchCells[PATH_TRACE_CELLS];
+
+// ghost decisions taken from a step worked out in transit, against the ones searched on arrival
+typedef struct {
+    uint64_t decisions, predicted, mispredicted, unready, searches, ticks;
+    uint64_t bursts[4]; // ticks by searches run in them: none, one, two, more
+    uint64_t worstBurst;
+    float worstUs;
+    float stepUs[SPECULATION_SAMPLES]; // the latest ticks' doEnemyMove time, speculation included
+} speculationClass;
+
+SDL_bool isSpeculating = SDL_TRUE;
+_Thread_local SDL_bool isRollingOut = SDL_FALSE;
+_Thread_local speculationClass speculation;
+
+// scheduled events live in a pool and are chained by index into the wheel slot of their tick
+typedef struct {
+    unsigned int tick, generation;
+    eventName type;
+    int ghost, next;
+} eventClass;
+
+typedef struct {
+    eventClass *events;
+    int slots[WHEEL_SLOTS];
+    int freeList, capacity;
+} wheelClass;
+
+// one finished (or abandoned) game, as stored in the score file
+typedef struct {
+    uint32_t score, level, deaths, seconds;
+    int64_t endedAt;
+    uint32_t isFinished, reserved;
+} scoreRecordClass;
+
+// a turn pressed ahead of the junction it is meant for; ticks keep the game deterministic, the press time is only for latency
+typedef struct {
+    headingName heading;
+    unsigned int tick;
+    uint64_t pressedNs;
+} turnClass;
 
 typedef struct {
-    SDL_bool gameOver;
+    SDL_bool gameOver, isRoundStarted, isPauseOver, isHeadless;
     unsigned short playerLives;
-    unsigned int ballsLeft, timeDelay, currentScore, highestScore;
+    unsigned int timeDelay, currentScore, highestScore, tick, foodLeft;
+    unsigned int level, deaths, sessionStart; // the game in progress, for its score record
+    scoreRecordClass lastSession; // filled when the game over screen comes up
+    uint64_t *foodSmall, *foodLarge;
+    wheelClass wheel;
+    struct autopilotClass *autopilot;
+    SDL_bool isRemote;
+    turnClass turns[TURN_BUFFER]; // queued turns, oldest first; the oldest legal one is taken and drops those before it
+    int turnCount;
+    const headingName *plan; // headings the bot takes at its next decisions, used by rollouts
+    int planLength, planStep;
+    unsigned char planOptions;
 } gameClass;
 
-// PATHFINDING ROUTINES
+// MEMORY
 
-float doDistance(const gridClass *a, const gridClass *b)
+void* doAllocate(const size_t count, const size_t size)
 {
-    return fabsf(a -> gridX - b -> gridX) + fabsf(a -> gridY - b -> gridY);
+    void *tmp = calloc(count, size);
+
+    if (!tmp)
+    {
+        fprintf(stderr, "Failed to allocate %zu bytes\n", count * size);
+        exit(4);
+    }
+
+    return tmp;
 }
 
-void doListPush(nodeClass* node)
+int doCompareFloat(const void* a, const void* b)
 {
-    listClass *tmp = (listClass*)malloc(sizeof(listClass));
+    float x = *(const float*)a, y = *(const float*)b;
 
-    tmp -> nodePtr = node; 
-    tmp -> next = listHead;
-    listHead = tmp;
+    return (x > y) - (x < y);
 }
 
-void doListSort(void)
+int doCompareDouble(const void* a, const void* b)
 {
-    listClass *tmp1 = NULL, *tmp2 = NULL;
-    nodeClass *node = NULL;
+    double x = *(const double*)a, y = *(const double*)b;
 
-    if (!listHead || listHead -> next == NULL)
+    return (x > y) - (x < y);
+}
+
+// RANDOM
+
+// per-thread xorshift, so rollout threads neither share nor lock a generator
+_Thread_local uint64_t randomState = 88172645463325252ULL;
+
+void doSeedRandom(const uint64_t seed)
+{
+    randomState = seed * 2654435761ULL + 88172645463325252ULL;
+}
+
+int doRandom(void)
+{
+    randomState ^= randomState << 13;
+    randomState ^= randomState >> 7;
+    randomState ^= randomState << 17;
+    return (int)(randomState >> 33);
+}
+
+// PROFILER
+
+// built with -DPROFILE, every phase below is timed into a ring of its thread and reported on exit;
+// without it the markers compile to nothing
+typedef enum { phaseTick, phaseInput, phaseEatFood, phaseEnemyState, phasePathfinding, phaseMovement, phaseEncounter,
+    phaseDraw, phaseClear, phaseMazeLayer, phaseHud, phaseBackground, phaseTextReady, phaseFood, phasePacman, phaseGhosts,
+    phaseKill, phaseTextGameOver, phaseFlush, phasePresent, phases } phaseName;
+
+const char *phaseNames[phases] = { "tick", "input", "eat food", "enemy state", "pathfinding", "movement", "encounter",
+    "draw", "clear", "maze layer", "hud", "background", "ready text", "food", "pacman", "ghosts",
+    "kill", "game over text", "flush", "present" };
+
+uint64_t doMonotonicNs(void);
+
+#ifdef PROFILE
+#define PROFILE_RING 65536
+#define PROFILE_BEGIN(phase) const uint64_t phase##Start = doMonotonicNs()
+#define PROFILE_END(phase) doProfileRecord(phase, phase##Start)
+#define PROFILE_THREAD(name) doProfileThread(name)
+
+typedef struct {
+    uint64_t start;
+    uint32_t duration, phase;
+} profileEventClass;
+
+typedef struct profileRingClass {
+    profileEventClass events[PROFILE_RING];
+    uint64_t written;
+    char name[32];
+    int id;
+    struct profileRingClass *next;
+} profileRingClass;
+
+_Thread_local profileRingClass *profileRing = NULL;
+profileRingClass *profileRings = NULL; // every thread's ring, newest first
+SDL_atomic_t profileThreads;
+const char *profileTracePath = NULL;
+uint64_t profileOrigin = 0;
+
+profileRingClass* doProfileRing(void)
+{
+    // a thread's ring is made on its first event and never freed, the report reads it after the thread is gone
+    if (!profileRing)
     {
-        return;
+        profileRing = doAllocate(1, sizeof(profileRingClass));
+        profileRing -> id = SDL_AtomicAdd(&profileThreads, 1) + 1;
+        snprintf(profileRing -> name, sizeof(profileRing -> name), "thread %d", profileRing -> id);
+
+        do
+        {
+            profileRing -> next = SDL_AtomicGetPtr((void**)&profileRings);
+        } while (!SDL_AtomicCASPtr((void**)&profileRings, profileRing -> next, profileRing));
+    }
+
+    return profileRing;
+}
+
+void doProfileThread(const char* name)
+{
+    snprintf(doProfileRing() -> name, sizeof(profileRing -> name), "%s", name);
+}
+
+void doProfileRecord(const phaseName phase, const uint64_t start)
+{
+    profileRingClass *ring = profileRing ? profileRing : doProfileRing();
+    profileEventClass *event = &ring -> events[ring -> written++ % PROFILE_RING];
+
+    event -> start = start;
+    event -> duration = (uint32_t)(doMonotonicNs() - start);
+    event -> phase = phase;
+}
+
+int doCompareDuration(const void* a, const void* b)
+{
+    uint32_t x = *(const uint32_t*)a, y = *(const uint32_t*)b;
+
+    return (x > y) - (x < y);
+}
+
+void doProfileReport(void)
+{
+    // what the rings still hold: a min/p50/p99 table, and a Chrome trace when --trace was given
+    uint32_t *durations[phases];
+    size_t counts[phases] = { 0 }, capacity = 0, events = 0;
+    FILE *trace = profileTracePath ? fopen(profileTracePath, "w") : NULL;
+    SDL_bool isFirst = SDL_TRUE;
+
+    for (profileRingClass *ring = profileRings; ring; ring = ring -> next)
+    {
+        capacity += SDL_min(ring -> written, PROFILE_RING);
+    }
+
+    for (int p = 0; p < phases; p++)
+    {
+        durations[p] = doAllocate(capacity + 1, sizeof(uint32_t));
+    }
+
+    if (profileTracePath && !trace)
+    {
+        fprintf(stderr, "Failed to write %s\n", profileTracePath);
+    }
+
+    if (trace)
+    {
+        fprintf(trace, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
     }
 
-    for (tmp1 = listHead; tmp1 != NULL; tmp1 = tmp1 -> next)
+    for (profileRingClass *ring = profileRings; ring; ring = ring -> next)
     {
-        for (tmp2 = tmp1 -> next; tmp2 != NULL; tmp2 = tmp2 -> next)
+        uint64_t first = ring -> written > PROFILE_RING ? ring -> written - PROFILE_RING : 0;
+
+        if (trace)
+        {
+            fprintf(trace, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}", isFirst ? "" : ",", ring -> id, ring -> name);
+            isFirst = SDL_FALSE;
+        }
+
+        for (uint64_t i = first; i < ring -> written; i++)
+        {
+            const profileEventClass *event = &ring -> events[i % PROFILE_RING];
+
+            durations[event -> phase][counts[event -> phase]++] = event -> duration;
+
+            if (trace)
+            {
+                fprintf(trace, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}", phaseNames[event -> phase], ring -> id,
+                    (double)(event -> start - profileOrigin) / 1e3, event -> duration / 1e3);
+            }
+        }
+
+        events += ring -> written - first;
+    }
+
+    if (trace)
+    {
+        fprintf(trace, "\n]}\n");
+        fclose(trace);
+    }
+
+    printf("%-16s %10s %10s %10s %10s %10s %12s\n", "phase", "count", "min us", "p50 us", "p99 us", "max us", "total ms");
+
+    for (int p = 0; p < phases; p++)
+    {
+        size_t n = counts[p];
+        double total = 0.0;
+
+        if (n)
         {
-            if (tmp2 -> nodePtr -> f < tmp1 -> nodePtr -> f)
+            qsort(durations[p], n, sizeof(uint32_t), doCompareDuration);
+
+            for (size_t i = 0; i < n; i++)
             {
-                node = tmp1 -> nodePtr;
-                tmp1 -> nodePtr = tmp2 ->nodePtr;
-                tmp2 -> nodePtr = node;
+                total += durations[p][i];
             }
+
+            printf("%-16s %10zu %10.2f %10.2f %10.2f %10.2f %12.2f\n", phaseNames[p], n, durations[p][0] / 1e3, durations[p][n / 2] / 1e3,
+                durations[p][SDL_min(n - 1, n * 99 / 100)] / 1e3, durations[p][n - 1] / 1e3, total / 1e6);
         }
+
+        free(durations[p]);
     }
+
+    printf("profiler: %zu events kept on %d threads%s%s\n", events, SDL_AtomicGet(&profileThreads), trace ? ", trace in " : "", trace ? profileTracePath : "");
 }
+#else
+#define PROFILE_BEGIN(phase)
+#define PROFILE_END(phase)
+#define PROFILE_THREAD(name)
+#endif
 
-void doListPopVisited(void)
+// MAZE ACCESS
+
+void doMazeError(const char* path, const char* message)
 {
-    listClass **tmp1 = &listHead;
-    
-    while (*tmp1)
+    fprintf(stderr, "Failed to load maze %s: %s\n", path ? path : "(built-in)", message);
+    exit(5);
+}
+
+uint64_t doChecksum(const void* data, const size_t size)
+{
+    // FNV-1a over whole words, the tail byte by byte
+    const unsigned char *bytes = data;
+    uint64_t hash = 14695981039346656037ULL, word;
+    size_t i = 0;
+
+    for (; i + 8 <= size; i += 8)
     {
-        if ((*tmp1) -> nodePtr -> isVisited)
-        {
-            listClass *tmp2 = *tmp1;
-            *tmp1 = (*tmp1) -> next;
-            free(tmp2);
-        } 
-        else
+        memcpy(&word, bytes + i, 8);
+        hash = (hash ^ word) * 1099511628211ULL;
+    }
+
+    for (; i < size; i++)
+    {
+        hash = (hash ^ bytes[i]) * 1099511628211ULL;
+    }
+
+    return hash;
+}
+
+const void* doGetPackSection(const packSectionName section)
+{
+    // sections are checked the first time they are used, so mapping a large pack stays cheap
+    const packHeaderClass *header = (const packHeaderClass*)maze.pack;
+    const packSectionClass *tmp = &header -> sections[section];
+
+    if (!(__atomic_load_n(&maze.packVerified, __ATOMIC_ACQUIRE) & (1u << section)))
+    {
+        SDL_LockMutex(maze.lock);
+
+        if (!(maze.packVerified & (1u << section)) && doChecksum(maze.pack + tmp -> offset, tmp -> size) != tmp -> checksum)
         {
-            tmp1 = &(*tmp1) -> next;
+            doMazeError(maze.path, "pack section checksum mismatch");
         }
+
+        __atomic_fetch_or(&maze.packVerified, 1u << section, __ATOMIC_RELEASE);
+        SDL_UnlockMutex(maze.lock);
     }
+
+    return maze.pack + tmp -> offset;
 }
 
-void doListDelete(void)
+const uint32_t* doGetDistanceMap(const gridClass* target)
 {
-    listClass *tmp = listHead;
+    const packHeaderClass *header = (const packHeaderClass*)maze.pack;
 
-    while (tmp)
+    if (!maze.pack || !target)
     {
-        listHead = listHead -> next;
-        free(tmp);
-        tmp = listHead;
+        return NULL;
+    }
+
+    for (uint32_t i = 0; i < header -> distanceCount; i++)
+    {
+        if (header -> distanceTarget[i][0] == target -> tileX && header -> distanceTarget[i][1] == target -> tileY)
+        {
+            return doGetPackSection(packDistance + i);
+        }
     }
+
+    return NULL;
 }
 
-void doInitNodes(const enemyClass* enemy)
+gridClass* doLoadChunk(const int chunkX, const int chunkY)
 {
-    // initiate nodes
-    for (int y = 0; y < 31; y++)
+    // rollout threads may race for the same chunk, the loser takes the winner's copy
+    SDL_LockMutex(maze.lock);
+
+    gridClass *chunk = maze.chunks[chunkY * maze.chunksX + chunkX];
+
+    if (chunk)
+    {
+        SDL_UnlockMutex(maze.lock);
+        return chunk;
+    }
+
+    chunk = doAllocate(CHUNK_SIZE * CHUNK_SIZE, sizeof(gridClass));
+    const unsigned char *flags = maze.pack ? doGetPackSection(packTiles) : NULL;
+    char row[CHUNK_SIZE];
+
+    for (int ly = 0; ly < CHUNK_SIZE; ly++)
     {
-        for (int x = 0; x < 30; x++)
+        int y = chunkY * CHUNK_SIZE + ly;
+        int n = 0;
+
+        // rows are fixed width in the file, so every chunk row is a single seek away
+        if (y < maze.height)
         {
-            nodes[y][x].gridPtr = &grid[y][x];
-            nodes[y][x].nodeX = grid[y][x].gridX;
-            nodes[y][x].nodeY = grid[y][x].gridY;
-            nodes[y][x].g = nodes[y][x].f = INFINITY;
-            nodes[y][x].isWall = grid[y][x].isWall;
-            nodes[y][x].isVisited = SDL_FALSE;
-            nodes[y][x].nodeParent = NULL;
-            
-            if (nodes[y][x].gridPtr == enemy -> curGridPos)
+            n = SDL_min(CHUNK_SIZE, maze.width - chunkX * CHUNK_SIZE);
+
+            if (flags)
             {
-                nodeStart = &nodes[y][x];
-                nodeStart -> f = nodeStart -> g = 0.0f;
-                doListPush(nodeStart);
+                for (int lx = 0; lx < n; lx++)
+                {
+                    row[lx] = flags[(long)y * maze.width + chunkX * CHUNK_SIZE + lx] & TILE_WALL ? '#' : ' ';
+                }
             }
-
-            if (nodes[y][x].gridPtr == enemy -> target)
+            else
             {
-                nodeEnd = &nodes[y][x];
+                fseek(maze.source, maze.tilesOffset + (long)y * (maze.width + 1) + chunkX * CHUNK_SIZE, SEEK_SET);
+                n = (int)fread(row, 1, n, maze.source);
             }
         }
+
+        for (int lx = 0; lx < CHUNK_SIZE; lx++)
+        {
+            gridClass *tile = &chunk[ly * CHUNK_SIZE + lx];
+
+            tile -> tileX = chunkX * CHUNK_SIZE + lx;
+            tile -> tileY = y;
+            tile -> gridX = (float) tile -> tileX * SIZE_TILE;
+            tile -> gridY = (float) y * SIZE_TILE;
+            tile -> isWall = lx >= n || row[lx] == '#';
+        }
     }
 
-    // establish connections
-    for (int y = 0; y < 31; y++) 
+    for (int i = 0; i < maze.portalCount; i++)
     {
-        for (int x = 0; x < 30; x++)
+        for (int end = 0; end < 4; end += 2)
         {
-            if (y > 0)
-            {
-                nodes[y][x].allNeighbours[north] = &nodes[y - 1][x];
-            }
-            if (y < 33)
-            {
-                nodes[y][x].allNeighbours[south] = &nodes[y + 1][x];
-            }
-            if (x > 0)
-            {
-                nodes[y][x].allNeighbours[west] = &nodes[y][x - 1];
-            }
-            if (x < 30)
+            int x = maze.portal[i][end] - chunkX * CHUNK_SIZE;
+            int y = maze.portal[i][end + 1] - chunkY * CHUNK_SIZE;
+
+            if (x >= 0 && y >= 0 && x < CHUNK_SIZE && y < CHUNK_SIZE)
             {
-                nodes[y][x].allNeighbours[east] = &nodes[y][x + 1];
+                chunk[y * CHUNK_SIZE + x].isPortal = SDL_TRUE;
             }
         }
     }
 
-    // specifically establish connections between portals
-    nodes[14][0].allNeighbours[west] = &nodes[14][29];
-    nodes[14][29].allNeighbours[east] = &nodes[14][0];
+    __atomic_store_n(&maze.chunks[chunkY * maze.chunksX + chunkX], chunk, __ATOMIC_RELEASE);
+    SDL_UnlockMutex(maze.lock);
+    return chunk;
 }
 
-void doRestrictMovingBack(nodeClass* nodeStart, const enemyClass* enemy)
+gridClass* doGetTile(const int x, const int y)
 {
-    if (enemy -> state == scatter || enemy -> state == chase)
+    if (x < 0 || y < 0 || x >= maze.width || y >= maze.height)
     {
-        switch (enemy -> heading)
-        {
-            case up: 
-                nodeStart -> allNeighbours[south] = NULL; 
-            break;
-
-            case down: 
-                nodeStart -> allNeighbours[north] = NULL; 
-            break;
-            
-            case left: 
-                nodeStart -> allNeighbours[east] = NULL; 
-            break;
-            
-            case right: 
-                nodeStart -> allNeighbours[west] = NULL; 
-            break;
-            
-            case idle: 
-            break;
-        }
+        return NULL;
     }
-}
 
-void doPathFinding(const enemyClass* enemy)
-{
-    nodeClass *nodeCurrent = NULL;
-    nodeClass *nodeNeighbour = NULL;
+    gridClass *chunk = __atomic_load_n(&maze.chunks[(y >> CHUNK_SHIFT) * maze.chunksX + (x >> CHUNK_SHIFT)], __ATOMIC_ACQUIRE);
 
-    // clear list
-    if (listHead)
+    if (!chunk)
     {
-        doListDelete();
+        chunk = doLoadChunk(x >> CHUNK_SHIFT, y >> CHUNK_SHIFT);
     }
 
-    doInitNodes(enemy);
-    doRestrictMovingBack(nodeStart, enemy);
-    
-    while (listHead)
-    {
-        doListSort();
-        doListPopVisited();
+    return &chunk[(y & (CHUNK_SIZE - 1)) * CHUNK_SIZE + (x & (CHUNK_SIZE - 1))];
+}
 
-        nodeCurrent = listHead -> nodePtr;
-        nodeCurrent -> isVisited = SDL_TRUE;
+gridClass* doGetTileOffset(const gridClass* cell, const int dx, const int dy)
+{
+    return doGetTile(cell -> tileX + dx, cell -> tileY + dy);
+}
 
-        if (nodeCurrent == nodeEnd)
+gridClass* doGetPortalExit(const gridClass* cell)
+{
+    for (int i = 0; i < maze.portalCount; i++)
+    {
+        if (cell -> tileX == maze.portal[i][0] && cell -> tileY == maze.portal[i][1])
         {
-            return;
+            return doGetTile(maze.portal[i][2], maze.portal[i][3]);
         }
 
-        for (int i = 0; i < 4; i++)
+        if (cell -> tileX == maze.portal[i][2] && cell -> tileY == maze.portal[i][3])
         {
-            nodeNeighbour = nodeCurrent -> allNeighbours[i];
-        
-            if (nodeNeighbour && !nodeNeighbour -> isWall && !nodeNeighbour -> isVisited)
-            {
-                // variable to check if this path to neighbour is shorter
-                float tmp = nodeCurrent -> g + doDistance(nodeNeighbour -> gridPtr, nodeCurrent -> gridPtr);
-
-                if (tmp < nodeNeighbour -> g)
-                {
-                    if (nodeNeighbour -> g == INFINITY)
-                    {
-                        doListPush(nodeNeighbour);
-                    }
-
-                    nodeNeighbour -> nodeParent = nodeCurrent;
-                    nodeNeighbour -> g = tmp;
-                    nodeNeighbour -> f = nodeNeighbour -> g + doDistance(nodeNeighbour -> gridPtr, nodeEnd -> gridPtr);
-                }
-            }
+            return doGetTile(maze.portal[i][0], maze.portal[i][1]);
         }
     }
-}
 
-// TELEPORT
+    return NULL;
+}
 
-void doTeleport(float* posX, float* posY, gridClass** curGridPos, gridClass** newGridPos, const headingName heading)
+gridClass* doGetNeighbour(const gridClass* cell, const neighbourName side)
 {
-    // we can't take both enemy and player type, but we can take individual fields from each type
+    // stepping off the edge of the maze from a portal leads to its other end
+    static const int stepX[4] = { 0, 0, -1, 1 };
+    static const int stepY[4] = { -1, 1, 0, 0 };
+    gridClass *tmp = doGetTileOffset(cell, stepX[side], stepY[side]);
 
-    if (*curGridPos == &grid[14][0] && heading == left)
+    if (!tmp && cell -> isPortal)
     {
-        *curGridPos = &grid[14][29];
-        *newGridPos = &grid[14][29];
-        *posX = grid[14][29].gridX;
-        *posY = grid[14][29].gridY;
+        tmp = doGetPortalExit(cell);
     }
-    else if (*curGridPos == &grid[14][29] && heading == right)
-    {
-        *curGridPos = &grid[14][0];
-        *newGridPos = &grid[14][0];
-        *posX = grid[14][0].gridX;
-        *posY = grid[14][0].gridY;
-    }
-}
 
-// PLAYER ROUTINES
+    return tmp;
+}
 
-SDL_bool doGetPlayerComand(SDL_Window* window, SDL_Event* event, gameClass* game, playerClass* player)
+gridClass* doGetStep(const gridClass* cell, const headingName heading)
 {
-    while(SDL_PollEvent(event)) 
+    switch (heading)
     {
-        switch(event -> type) 
-        {
-            case SDL_WINDOWEVENT_CLOSE: case SDL_QUIT: 
-                return SDL_TRUE; 
-            break;
+        case up: 
+            return doGetNeighbour(cell, north);
+        
+        case down: 
+            return doGetNeighbour(cell, south);
+        
+        case left: 
+            return doGetNeighbour(cell, west);
+        
+        case right: 
+            return doGetNeighbour(cell, east);
+        
+        case idle: 
+        break;
+    }
+
+    return NULL;
+}
+
+SDL_bool doIsWalkable(const gridClass* cell)
+{
+    return cell && !cell -> isWall;
+}
+
+long doGridIndex(const gridClass* cell)
+{
+    return (long)cell -> tileY * maze.width + cell -> tileX;
+}
+
+// PATHFINDING ROUTINES
+
+float doDistance(const gridClass *a, const gridClass *b)
+{
+    return fabsf(a -> gridX - b -> gridX) + fabsf(a -> gridY - b -> gridY);
+}
+
+void doListPush(nodeClass* node)
+{
+    listClass *tmp = (listClass*)malloc(sizeof(listClass));
+
+    tmp -> nodePtr = node; 
+    tmp -> next = listHead;
+    listHead = tmp;
+
+    listAllocations++;
+    listPeak = SDL_max(listPeak, ++listSize);
+}
+
+void doListSort(void)
+{
+    // the search only ever takes the head, so one pass bringing the lowest f forward is enough;
+    // ties go to the deeper node, otherwise open boards flood the whole rectangle to the target
+    listClass *tmp1 = NULL, *best = listHead;
+    nodeClass *node = NULL;
+
+    if (!listHead || listHead -> next == NULL)
+    {
+        return;
+    }
+
+    for (tmp1 = listHead -> next; tmp1 != NULL; tmp1 = tmp1 -> next)
+    {
+        if (tmp1 -> nodePtr -> f < best -> nodePtr -> f || (tmp1 -> nodePtr -> f == best -> nodePtr -> f && tmp1 -> nodePtr -> g > best -> nodePtr -> g))
+        {
+            best = tmp1;
+        }
+    }
+
+    node = listHead -> nodePtr;
+    listHead -> nodePtr = best -> nodePtr;
+    best -> nodePtr = node;
+}
+
+void doListPopVisited(void)
+{
+    listClass **tmp1 = &listHead;
+    
+    while (*tmp1)
+    {
+        if ((*tmp1) -> nodePtr -> isVisited)
+        {
+            listClass *tmp2 = *tmp1;
+            *tmp1 = (*tmp1) -> next;
+            free(tmp2);
+            listSize--;
+        } 
+        else
+        {
+            tmp1 = &(*tmp1) -> next;
+        }
+    }
+}
+
+void doListDelete(void)
+{
+    listClass *tmp = listHead;
+
+    while (tmp)
+    {
+        listHead = listHead -> next;
+        free(tmp);
+        tmp = listHead;
+    }
+
+    listSize = 0;
+}
+
+nodeClass* doGetNode(gridClass* cell)
+{
+    int chunk = (cell -> tileY >> CHUNK_SHIFT) * maze.chunksX + (cell -> tileX >> CHUNK_SHIFT);
+
+    if (!nodeChunks[chunk])
+    {
+        nodeChunks[chunk] = doAllocate(CHUNK_SIZE * CHUNK_SIZE, sizeof(nodeClass));
+    }
+
+    nodeClass *node = &nodeChunks[chunk][(cell -> tileY & (CHUNK_SIZE - 1)) * CHUNK_SIZE + (cell -> tileX & (CHUNK_SIZE - 1))];
+
+    if (node -> searchId != searchId)
+    {
+        node -> gridPtr = cell;
+        node -> g = node -> f = INFINITY;
+        node -> isVisited = SDL_FALSE;
+        node -> nodeParent = NULL;
+        node -> searchId = searchId;
+    }
+
+    return node;
+}
+
+void doInitNodes(const enemyClass* enemy, const int i)
+{
+    // only the nodes a search touches get initialised, so its cost does not grow with the maze
+    if (!nodeChunks)
+    {
+        nodeChunks = doAllocate(maze.chunksX * maze.chunksY, sizeof(nodeClass*));
+    }
+
+    searchId++;
+    nodeStart = doGetNode(enemy -> curGridPos[i]);
+    nodeStart -> f = nodeStart -> g = 0.0f;
+    doListPush(nodeStart);
+    nodeEnd = doGetNode(enemy -> target[i]);
+}
+
+void doRestrictMovingBack(const enemyClass* enemy, const int i)
+{
+    blockedNeighbour = -1;
+
+    if (enemy -> state[i] == scatter || enemy -> state[i] == chase)
+    {
+        switch (enemy -> heading[i])
+        {
+            case up: 
+                blockedNeighbour = south; 
+            break;
+
+            case down: 
+                blockedNeighbour = north; 
+            break;
             
-            case SDL_KEYDOWN:
-                switch(event -> key.keysym.sym) 
+            case left: 
+                blockedNeighbour = east; 
+            break;
+            
+            case right: 
+                blockedNeighbour = west; 
+            break;
+            
+            case idle: 
+            break;
+        }
+    }
+}
+
+void doPathFinding(const enemyClass* enemy, const int i)
+{
+    nodeClass *nodeCurrent = NULL;
+    nodeClass *nodeNeighbour = NULL;
+
+    // clear list
+    if (listHead)
+    {
+        doListDelete();
+    }
+
+    listPeak = listAllocations = searchExpanded = 0;
+    pathSearches++;
+    doInitNodes(enemy, i);
+    doRestrictMovingBack(enemy, i);
+    
+    while (listHead)
+    {
+        doListPopVisited();
+        doListSort();
+
+        if (!listHead)
+        {
+            return;
+        }
+
+        nodeCurrent = listHead -> nodePtr;
+        nodeCurrent -> isVisited = SDL_TRUE;
+
+        if (searchExpanded < PATH_TRACE_CELLS)
+        {
+            searchCells[searchExpanded] = doGridIndex(nodeCurrent -> gridPtr);
+        }
+
+        searchExpanded++;
+
+        if (nodeCurrent == nodeEnd)
+        {
+            return;
+        }
+
+        for (int n = 0; n < 4; n++)
+        {
+            gridClass *cell = doGetNeighbour(nodeCurrent -> gridPtr, n);
+
+            if (!doIsWalkable(cell) || (nodeCurrent == nodeStart && n == blockedNeighbour))
+            {
+                continue;
+            }
+
+            nodeNeighbour = doGetNode(cell);
+        
+            if (!nodeNeighbour -> isVisited)
+            {
+                // variable to check if this path to neighbour is shorter
+                float tmp = nodeCurrent -> g + doDistance(nodeNeighbour -> gridPtr, nodeCurrent -> gridPtr);
+
+                if (tmp < nodeNeighbour -> g)
                 {
-                    case SDLK_ESCAPE: 
-                        return SDL_TRUE; 
-                    break;
-                    
-                    case SDLK_SPACE: 
-                        game -> gameOver = SDL_FALSE; 
-                    break;
-                    
-                    case SDLK_UP: 
-                        player -> newHeading = up; 
-                    break;
-                    
-                    case SDLK_DOWN: 
-                        player -> newHeading = down; 
-                    break;                    
-                    
-                    case SDLK_LEFT: 
-                        player -> newHeading = left; 
-                    break;                
-                    
-                    case SDLK_RIGHT: 
-                        player -> newHeading = right; 
-                    break;                    
-                    
-                    default: 
-                        player -> newHeading = idle; 
-                    break;
+                    if (nodeNeighbour -> g == INFINITY)
+                    {
+                        doListPush(nodeNeighbour);
+                    }
+
+                    nodeNeighbour -> nodeParent = nodeCurrent;
+                    nodeNeighbour -> g = tmp;
+                    nodeNeighbour -> f = nodeNeighbour -> g + doDistance(nodeNeighbour -> gridPtr, nodeEnd -> gridPtr);
                 }
-            break;
+            }
+        }
+    }
+}
+
+gridClass* doFollowDistanceMap(const enemyClass* enemy, const int i)
+{
+    // descend a precomputed distance map; give up to A* whenever no allowed step gets closer
+    const uint32_t *distance = doGetDistanceMap(enemy -> target[i]);
+    gridClass *best = NULL;
+    uint32_t bestDistance;
+
+    if (!distance)
+    {
+        return NULL;
+    }
+
+    doRestrictMovingBack(enemy, i);
+    bestDistance = distance[doGridIndex(enemy -> curGridPos[i])];
+
+    for (int n = 0; n < 4; n++)
+    {
+        gridClass *cell = doGetNeighbour(enemy -> curGridPos[i], n);
+
+        if (doIsWalkable(cell) && n != blockedNeighbour && distance[doGridIndex(cell)] < bestDistance)
+        {
+            best = cell;
+            bestDistance = distance[doGridIndex(cell)];
+        }
+    }
+
+    return best;
+}
+
+void doOpenPathStats(const int ghosts)
+{
+    // made before the simulation starts so the render thread never sees it half built
+    pathStatsTable.ghosts = ghosts;
+    pathStatsTable.stats = doAllocate((size_t)ghosts * GHOST_STATES, sizeof(pathStatsClass));
+    pathStatsTable.traces = doAllocate((size_t)ghosts, sizeof(pathTraceClass));
+    pathStatsTable.lock = SDL_CreateMutex();
+}
+
+void doClosePathStats(void)
+{
+    for (int g = 0; g < pathStatsTable.ghosts; g++)
+    {
+        free(pathStatsTable.traces[g].expanded);
+        free(pathStatsTable.traces[g].path);
+    }
+
+    free(pathStatsTable.stats);
+    free(pathStatsTable.traces);
+    SDL_DestroyMutex(pathStatsTable.lock);
+    pathStatsTable.stats = NULL;
+    pathStatsTable.traces = NULL;
+    pathStatsTable.ghosts = 0;
+}
+
+pathStatsClass* doGetPathStats(const enemyClass* enemy, const int i)
+{
+    return i < pathStatsTable.ghosts ? &pathStatsTable.stats[i * GHOST_STATES + enemy -> state[i] - 1] : NULL;
+}
+
+void doRecordSearch(const enemyClass* enemy, const int i, const uint64_t latency)
+{
+    pathStatsClass *stats = doGetPathStats(enemy, i);
+    pathTraceClass *trace;
+    int bucket = 0;
+
+    if (!stats)
+    {
+        return;
+    }
+
+    while (bucket < PATH_BUCKETS - 1 && latency >= 1000ULL << bucket)
+    {
+        bucket++;
+    }
+
+    stats -> searches++;
+    stats -> expanded += searchExpanded;
+    stats -> allocations += listAllocations;
+    stats -> unreachable += !nodeEnd -> isVisited;
+    stats -> latencyNs += latency;
+    stats -> openPeak = SDL_max(stats -> openPeak, listPeak);
+    stats -> histogram[bucket]++;
+
+    if (!pathStatsTable.isTracing)
+    {
+        return;
+    }
+
+    trace = &pathStatsTable.traces[i];
+    SDL_LockMutex(pathStatsTable.lock);
+
+    if (!trace -> expanded)
+    {
+        trace -> expanded = doAllocate(PATH_TRACE_CELLS, sizeof(long));
+        trace -> path = doAllocate(PATH_TRACE_CELLS, sizeof(long));
+    }
+
+    trace -> expandedCount = (int)SDL_min(searchExpanded, PATH_TRACE_CELLS);
+    memcpy(trace -> expanded, searchCells, trace -> expandedCount * sizeof(long));
+    trace -> target = doGridIndex(enemy -> target[i]);
+    trace -> pathCount = 0;
+
+    for (nodeClass *node = nodeEnd -> isVisited ? nodeEnd : NULL; node && trace -> pathCount < PATH_TRACE_CELLS; node = node -> nodeParent)
+    {
+        trace -> path[trace -> pathCount++] = doGridIndex(node -> gridPtr);
+    }
+
+    SDL_UnlockMutex(pathStatsTable.lock);
+}
+
+gridClass* doGetEnemyStep(const enemyClass* enemy, const int i)
+{
+    gridClass *tmp = doFollowDistanceMap(enemy, i);
+    nodeClass *node = NULL;
+    uint64_t start = 0;
+
+    if (tmp || enemy -> curGridPos[i] == enemy -> target[i])
+    {
+        pathStatsClass *stats = tmp && isRecordingPaths ? doGetPathStats(enemy, i) : NULL;
+
+        if (stats)
+        {
+            stats -> mapSteps++;
+        }
+
+        return tmp ? tmp : enemy -> curGridPos[i];
+    }
+
+    if (isRecordingPaths)
+    {
+        start = doMonotonicNs();
+    }
+
+    doPathFinding(enemy, i);
+
+    if (isRecordingPaths)
+    {
+        doRecordSearch(enemy, i, doMonotonicNs() - start);
+    }
+
+    // stay put when the target is where we stand or cannot be reached
+    node = nodeEnd;
+    tmp = enemy -> curGridPos[i];
+
+    while (node && node -> nodeParent)
+    {
+        tmp = node -> gridPtr; 
+        node = node -> nodeParent;
+    }
+
+    return tmp;
+}
+
+pathStatsClass doQueryPathStats(const int ghost, const int state)
+{
+    // ghost or state -1 sums over all of them; the simulation keeps counting while this reads
+    pathStatsClass sum;
+
+    memset(&sum, 0, sizeof(pathStatsClass));
+
+    for (int g = 0; g < pathStatsTable.ghosts; g++)
+    {
+        for (int s = 1; s <= GHOST_STATES; s++)
+        {
+            const pathStatsClass *stats = &pathStatsTable.stats[g * GHOST_STATES + s - 1];
+
+            if ((ghost >= 0 && ghost != g) || (state >= 0 && state != s))
+            {
+                continue;
+            }
+
+            sum.searches += stats -> searches;
+            sum.mapSteps += stats -> mapSteps;
+            sum.expanded += stats -> expanded;
+            sum.allocations += stats -> allocations;
+            sum.unreachable += stats -> unreachable;
+            sum.latencyNs += stats -> latencyNs;
+            sum.openPeak = SDL_max(sum.openPeak, stats -> openPeak);
+
+            for (int b = 0; b < PATH_BUCKETS; b++)
+            {
+                sum.histogram[b] += stats -> histogram[b];
+            }
+        }
+    }
+
+    return sum;
+}
+
+unsigned int doPathPercentileUs(const pathStatsClass* stats, const double fraction)
+{
+    // the upper bound of the bucket holding that share of searches
+    uint64_t seen = 0;
+
+    if (!stats -> searches)
+    {
+        return 0;
+    }
+
+    for (int b = 0; b < PATH_BUCKETS; b++)
+    {
+        seen += stats -> histogram[b];
+
+        if (seen && seen >= fraction * stats -> searches)
+        {
+            return 1u << b;
+        }
+    }
+
+    return 1u << (PATH_BUCKETS - 1);
+}
+
+void doReportPathStats(void)
+{
+    const char *stateNames[GHOST_STATES] = { "scatter", "frightened", "eaten", "chase", "home" };
+    pathStatsClass total = doQueryPathStats(-1, -1);
+
+    printf("%6s %-11s %9s %9s %12s %9s %12s %11s %9s %9s\n", "ghost", "state", "searches", "map steps", "expanded/sr", "open peak", "mallocs/sr", "unreachable", "mean us", "p99 us<");
+
+    for (int g = -1; g < pathStatsTable.ghosts; g++)
+    {
+        for (int s = 1; s <= GHOST_STATES; s++)
+        {
+            pathStatsClass stats = g < 0 ? total : doQueryPathStats(g, s);
+            char ghost[16];
+
+            if (!stats.searches && !stats.mapSteps)
+            {
+                if (g < 0)
+                {
+                    break;
+                }
+
+                continue;
+            }
+
+            snprintf(ghost, sizeof(ghost), g < 0 ? "all" : "%d", g);
+            printf("%6s %-11s %9llu %9llu %12.1f %9u %12.1f %11llu %9.2f %9u\n", ghost, g < 0 ? "all" : stateNames[s - 1],
+                (unsigned long long)stats.searches, (unsigned long long)stats.mapSteps, stats.searches ? (double)stats.expanded / stats.searches : 0.0,
+                stats.openPeak, stats.searches ? (double)stats.allocations / stats.searches : 0.0, (unsigned long long)stats.unreachable,
+                stats.searches ? stats.latencyNs / 1e3 / stats.searches : 0.0, doPathPercentileUs(&stats, 0.99));
+
+            if (g < 0)
+            {
+                break;
+            }
+        }
+    }
+
+    for (int b = 0; b < PATH_BUCKETS; b++)
+    {
+        if (total.histogram[b])
+        {
+            printf("searches %s %5u us: %llu\n", b < PATH_BUCKETS - 1 ? "under" : "from ", b < PATH_BUCKETS - 1 ? 1u << b : 1u << (b - 1), (unsigned long long)total.histogram[b]);
+        }
+    }
+}
+
+// TELEPORT
+
+void doTeleport(float* posX, float* posY, gridClass** curGridPos, gridClass** newGridPos, const headingName heading)
+{
+    // we can't take both enemy and player type, but we can take individual fields from each type
+    gridClass *tmp = NULL;
+
+    if (!(*curGridPos) -> isPortal || heading == idle || doGetStep(*curGridPos, heading) != doGetPortalExit(*curGridPos))
+    {
+        return;
+    }
+
+    tmp = doGetPortalExit(*curGridPos);
+    *curGridPos = tmp;
+    *newGridPos = tmp;
+    *posX = tmp -> gridX;
+    *posY = tmp -> gridY;
+}
+
+// FOOD BITSET
+
+unsigned int doCountFood(const uint64_t* mask)
+{
+    unsigned int count = 0;
+
+    for (int i = 0; i < maze.foodWords; i++)
+    {
+        count += (unsigned int)__builtin_popcountll(mask[i]);
+    }
+
+    return count;
+}
+
+unsigned int doBallsLeft(const gameClass* game)
+{
+    return game -> foodLeft;
+}
+
+unsigned int doReleaseThreshold(void)
+{
+    // pellets left when the ghost house opens, 0 on a maze too small to wait for RELEASE_AFTER_FOOD of them
+    return maze.foodTotal > RELEASE_AFTER_FOOD ? maze.foodTotal - RELEASE_AFTER_FOOD : 0;
+}
+
+foodName doGetFood(const gameClass* game, const gridClass* cell)
+{
+    long i = doGridIndex(cell);
+    uint64_t bit = 1ULL << (i % 64);
+
+    if (game -> foodSmall[i / 64] & bit)
+    {
+        return smallBall;
+    }
+
+    if (game -> foodLarge[i / 64] & bit)
+    {
+        return largeBall;
+    }
+
+    return noFood;
+}
+
+void doClearFood(gameClass* game, const gridClass* cell)
+{
+    long i = doGridIndex(cell);
+    uint64_t bit = 1ULL << (i % 64);
+
+    if ((game -> foodSmall[i / 64] | game -> foodLarge[i / 64]) & bit)
+    {
+        game -> foodLeft--;
+    }
+
+    game -> foodSmall[i / 64] &= ~bit;
+    game -> foodLarge[i / 64] &= ~bit;
+}
+
+void doInitFood(gameClass* game)
+{
+    memcpy(game -> foodSmall, maze.foodSmallInit, sizeof(uint64_t) * maze.foodWords);
+    memcpy(game -> foodLarge, maze.foodLargeInit, sizeof(uint64_t) * maze.foodWords);
+    game -> foodLeft = doCountFood(game -> foodSmall) + doCountFood(game -> foodLarge);
+}
+
+// EVENT SCHEDULER
+
+void doClearEvents(wheelClass* wheel)
+{
+    for (int i = 0; i < WHEEL_SLOTS; i++)
+    {
+        wheel -> slots[i] = -1;
+    }
+
+    for (int i = 0; i < wheel -> capacity; i++)
+    {
+        wheel -> events[i].next = i + 1 < wheel -> capacity ? i + 1 : -1;
+    }
+
+    wheel -> freeList = wheel -> capacity ? 0 : -1;
+}
+
+void doScheduleEvent(wheelClass* wheel, const unsigned int tick, const eventName type, const int ghost, const unsigned int generation)
+{
+    int i;
+
+    if (wheel -> freeList < 0)
+    {
+        int capacity = wheel -> capacity ? wheel -> capacity * 2 : 64;
+        eventClass *tmp = (eventClass*)realloc(wheel -> events, sizeof(eventClass) * capacity);
+
+        if (!tmp)
+        {
+            fprintf(stderr, "Failed to grow event pool\n");
+            exit(4);
+        }
+
+        for (i = wheel -> capacity; i < capacity; i++)
+        {
+            tmp[i].next = i + 1 < capacity ? i + 1 : -1;
+        }
+
+        wheel -> freeList = wheel -> capacity;
+        wheel -> events = tmp;
+        wheel -> capacity = capacity;
+    }
+
+    i = wheel -> freeList;
+    wheel -> freeList = wheel -> events[i].next;
+
+    wheel -> events[i].tick = tick;
+    wheel -> events[i].type = type;
+    wheel -> events[i].ghost = ghost;
+    wheel -> events[i].generation = generation;
+    wheel -> events[i].next = wheel -> slots[tick % WHEEL_SLOTS];
+    wheel -> slots[tick % WHEEL_SLOTS] = i;
+}
+
+int doTakeDueEvents(wheelClass* wheel, const unsigned int tick)
+{
+    // unlink events due this tick and return them as a chain, events of later rounds stay in the slot
+    int *link = &wheel -> slots[tick % WHEEL_SLOTS];
+    int due = -1;
+
+    while (*link >= 0)
+    {
+        eventClass *event = &wheel -> events[*link];
+
+        if (event -> tick == tick)
+        {
+            int tmp = *link;
+            *link = event -> next;
+            event -> next = due;
+            due = tmp;
+        }
+        else
+        {
+            link = &event -> next;
+        }
+    }
+
+    return due;
+}
+
+void doFreeEvent(wheelClass* wheel, const int i)
+{
+    wheel -> events[i].next = wheel -> freeList;
+    wheel -> freeList = i;
+}
+
+void doInitWheel(wheelClass* wheel)
+{
+    wheel -> events = NULL;
+    wheel -> capacity = 0;
+    doClearEvents(wheel);
+}
+
+// PLAYER ROUTINES
+
+unsigned char doGetOpenHeadings(const gridClass* cell)
+{
+    unsigned char mask = 0;
+
+    for (headingName heading = up; heading <= right; heading++)
+    {
+        mask |= doIsWalkable(doGetStep(cell, heading)) ? 1 << heading : 0;
+    }
+
+    return mask;
+}
+
+SDL_bool doIsDecision(const unsigned char open, const headingName heading)
+{
+    // corridors and dead ends leave no choice, everything else does
+    headingName reverse = heading == idle ? idle : ((heading - 1) ^ 1) + 1;
+
+    if (__builtin_popcount(open) < 2)
+    {
+        return SDL_FALSE;
+    }
+
+    return heading == idle || !(open & (1 << heading)) || (open & ~((1 << heading) | (1 << reverse)));
+}
+
+void doGetBotCommand(gameClass* game, playerClass* player)
+{
+    // keep going most of the time, otherwise pick a random open direction
+    headingName open[4];
+    int count = 0;
+
+    // a rollout plays out its plan first, one heading per decision
+    if (game -> plan && player -> isMoving && game -> planStep <= game -> planLength)
+    {
+        unsigned char mask = doGetOpenHeadings(player -> newGridPos);
+
+        if (doIsDecision(mask, player -> curHeading))
+        {
+            if (game -> planStep < game -> planLength)
+            {
+                player -> newHeading = game -> plan[game -> planStep++];
+                return;
+            }
+
+            game -> planOptions = mask;
+            game -> planStep++;
+        }
+    }
+
+    for (headingName heading = up; heading <= right; heading++)
+    {
+        if (doIsWalkable(doGetStep(player -> newGridPos, heading)))
+        {
+            open[count++] = heading;
+        }
+    }
+
+    game -> gameOver = SDL_FALSE;
+    player -> newHeading = player -> curHeading;
+
+    for (int i = 0; i < count; i++)
+    {
+        if (open[i] == player -> curHeading && doRandom() % 4)
+        {
+            return;
+        }
+    }
+
+    if (count)
+    {
+        player -> newHeading = open[doRandom() % count];
+    }
+}
+
+void doGetAutopilotCommand(gameClass* game, playerClass* player);
+
+// turns taken from the buffer, only those with a press time, so only the local player's
+typedef struct {
+    uint64_t taken, expired, dropped;
+    float latencyMs[TURN_SAMPLES]; // the latest TURN_SAMPLES press-to-turn delays
+} turnStatsClass;
+
+turnStatsClass turnStats = { 0 };
+unsigned int turnWindowTicks = 15;
+
+void doQueueTurn(gameClass* game, const headingName heading, const uint64_t pressedNs)
+{
+    // a repeated key keeps its first press, a full buffer loses its oldest turn
+    if (game -> turnCount && game -> turns[game -> turnCount - 1].heading == heading)
+    {
+        return;
+    }
+
+    if (game -> turnCount == TURN_BUFFER)
+    {
+        memmove(game -> turns, game -> turns + 1, (TURN_BUFFER - 1) * sizeof(turnClass));
+        game -> turnCount--;
+        turnStats.dropped += pressedNs != 0;
+    }
+
+    game -> turns[game -> turnCount++] = (turnClass){ heading, game -> tick, pressedNs };
+}
+
+void doTakeTurn(gameClass* game, playerClass* player)
+{
+    // called on a tile centre: stale turns expire, then the oldest turn that leads somewhere is taken
+    // and the blocked presses before it are dropped, so they cannot hold back a newer legal one
+    turnClass *turn = game -> turns;
+    int expired = 0, taken;
+
+    while (expired < game -> turnCount && game -> tick - turn[expired].tick > turnWindowTicks)
+    {
+        turnStats.expired += turn[expired++].pressedNs != 0;
+    }
+
+    for (taken = expired; taken < game -> turnCount && !doIsWalkable(doGetStep(player -> newGridPos, turn[taken].heading)); taken++);
+
+    if (taken < game -> turnCount)
+    {
+        player -> newHeading = turn[taken].heading;
+
+        if (turn[taken].pressedNs)
+        {
+            turnStats.latencyMs[turnStats.taken++ % TURN_SAMPLES] = (float)(doMonotonicNs() - turn[taken].pressedNs) / 1e6f;
+        }
+
+        for (; expired < taken; expired++)
+        {
+            turnStats.dropped += turn[expired].pressedNs != 0;
+        }
+
+        expired++;
+    }
+    else
+    {
+        player -> newHeading = idle;
+    }
+
+    game -> turnCount -= expired;
+    memmove(turn, turn + expired, game -> turnCount * sizeof(turnClass));
+}
+
+void doReportTurns(void)
+{
+    int count = (int)SDL_min(turnStats.taken, TURN_SAMPLES);
+    float sorted[TURN_SAMPLES];
+
+    memcpy(sorted, turnStats.latencyMs, count * sizeof(float));
+    qsort(sorted, count, sizeof(float), doCompareFloat);
+    printf("input: %llu turns taken, %llu expired after %u ms, %llu dropped; key to turn p50 %.1f ms, p99 %.1f ms, worst %.1f ms\n", (unsigned long long)turnStats.taken, (unsigned long long)turnStats.expired,
+           turnWindowTicks * 1000 / TICK_RATE, (unsigned long long)turnStats.dropped, count ? sorted[count / 2] : 0.0f, count ? sorted[count * 99 / 100] : 0.0f, count ? sorted[count - 1] : 0.0f);
+}
+
+void doApplyCommand(gameClass* game, const unsigned char command, const uint64_t pressedNs)
+{
+    // one byte per command: a heading, or REMOTE_RESTART to leave the game over screen
+    if (command >= up && command <= right)
+    {
+        doQueueTurn(game, command, pressedNs);
+    }
+    else if (command == REMOTE_RESTART)
+    {
+        game -> gameOver = SDL_FALSE;
+    }
+}
+
+uint64_t doEventNs(const SDL_Event* event)
+{
+    // SDL stamps events in milliseconds, so a key that waited for the next poll still counts from the press
+    Uint32 age = SDL_GetTicks() - event -> common.timestamp;
+
+    return doMonotonicNs() - (event -> common.timestamp && age < 1000 ? age * 1000000ULL : 0);
+}
+
+SDL_bool doGetPlayerComand(SDL_Window* window, SDL_Event* event, gameClass* game, playerClass* player)
+{
+    if (game -> isHeadless && !game -> isRemote)
+    {
+        game -> autopilot ? doGetAutopilotCommand(game, player) : doGetBotCommand(game, player);
+        return SDL_FALSE;
+    }
+
+    while (!game -> isRemote && SDL_PollEvent(event)) 
+    {
+        switch(event -> type) 
+        {
+            case SDL_WINDOWEVENT_CLOSE: case SDL_QUIT: 
+                return SDL_TRUE; 
+            break;
+            
+            case SDL_KEYDOWN:
+                switch(event -> key.keysym.sym) 
+                {
+                    case SDLK_ESCAPE: 
+                        return SDL_TRUE; 
+                    break;
+                    
+                    case SDLK_SPACE: 
+                        game -> gameOver = SDL_FALSE; 
+                    break;
+                    
+                    case SDLK_UP: 
+                        doQueueTurn(game, up, doEventNs(event)); 
+                    break;
+                    
+                    case SDLK_DOWN: 
+                        doQueueTurn(game, down, doEventNs(event)); 
+                    break;                    
+                    
+                    case SDLK_LEFT: 
+                        doQueueTurn(game, left, doEventNs(event)); 
+                    break;                
+                    
+                    case SDLK_RIGHT: 
+                        doQueueTurn(game, right, doEventNs(event)); 
+                    break;
+                }
+            break;
+        }
+    }
+
+    if (player -> isMoving)
+    {
+        doTakeTurn(game, player);
+    }
+
+    if (game -> autopilot)
+    {
+        doGetAutopilotCommand(game, player);
+    }
+
+    return SDL_FALSE;
+}
+
+void doUpdatePlayerHeading(playerClass* player)
+{
+    gridClass *tmp = NULL;
+
+    if (player -> newHeading != idle && doIsWalkable(doGetStep(player -> newGridPos, player -> newHeading)))
+    {
+        player -> curHeading = player -> newHeading;
+    }
+
+    tmp = doGetStep(player -> newGridPos, player -> curHeading);
+
+    if (doIsWalkable(tmp))
+    {
+        player -> newGridPos = tmp;
+    }
+}
+
+SDL_bool doPlayerMove(SDL_Window* window, SDL_Event* event, gameClass* game, playerClass* player)
+{  
+    SDL_bool tmp = SDL_FALSE;
+    
+    if (player -> isMoving == SDL_TRUE)
+    {
+        if (player -> posX == player -> newGridPos -> gridX && player -> posY == player -> newGridPos -> gridY)
+        {
+            player -> curGridPos = player -> newGridPos;
+            player -> vector[0] = player -> vector[1] = 0;
+            tmp = doGetPlayerComand(window, event, game, player);
+            doUpdatePlayerHeading(player);
+        } 
+        else
+        {
+            player -> vector[0] = (int)(player -> newGridPos -> gridX - player -> curGridPos -> gridX) / SIZE_TILE ; // 1, -1, 0
+            player -> vector[1] = (int)(player -> newGridPos -> gridY - player -> curGridPos -> gridY) / SIZE_TILE ; // 1, -1, 0
+            player -> posX += player -> speed * (float)player -> vector[0];
+            player -> posY += player -> speed * (float)player -> vector[1];
+        }
+        doTeleport(&player -> posX, &player -> posY, &player -> curGridPos, &player -> newGridPos, player -> curHeading);
+    } 
+    else
+    {
+        player -> newHeading = idle;
+        tmp = doGetPlayerComand(window, event, game, player);
+    }
+
+    return tmp;
+}
+
+// ENEMY ROUTINES
+
+void doSetEnemyState(gameClass* game, enemyClass* enemy, const int i, const stateName state)
+{
+    // timers of the previous state become stale, new ones are scheduled once on entry
+    unsigned int time = doBallsLeft(game) < 100 ? 3 : 7;
+    unsigned int now = game -> tick;
+    unsigned int generation = ++enemy -> timerGeneration[i];
+
+    enemy -> state[i] = state;
+    enemy -> isTimeAlmostEnd[i] = SDL_FALSE;
+
+    switch (state)
+    {
+        case scatter:
+            doScheduleEvent(&game -> wheel, now + time * TICK_RATE, scatterEnd, i, generation);
+        break;
+
+        case chase:
+            doScheduleEvent(&game -> wheel, now + 20 * TICK_RATE, chaseEnd, i, generation);
+        break;
+
+        case frightened:
+            doScheduleEvent(&game -> wheel, now + (time - 2) * TICK_RATE, frightenedAlmostEnd, i, generation);
+            doScheduleEvent(&game -> wheel, now + time * TICK_RATE, frightenedEnd, i, generation);
+        break;
+
+        case eaten: case home:
+        break;
+    }
+}
+
+void doReleaseEnemies(gameClass* game, const enemyClass* enemy)
+{
+    for (int i = 0; i < enemy -> count; i++)
+    {
+        if (enemy -> state[i] == home)
+        {
+            doScheduleEvent(&game -> wheel, game -> tick + 1, houseRelease, i, enemy -> timerGeneration[i]);
+        }
+    }
+}
+
+gridClass* doGetRandomLocation(const enemyClass* enemy, const int i)
+{
+    gridClass *tmp = NULL;
+
+    if (enemy -> state[i] != home && maze.pack)
+    {
+        const uint32_t *walkable = doGetPackSection(packWalkable);
+        uint32_t pick = walkable[(uint32_t)doRandom() % ((const packHeaderClass*)maze.pack) -> walkableCount];
+
+        tmp = doGetTile(pick % maze.width, pick / maze.width);
+    }
+    else if (enemy -> state[i] != home)
+    {
+        do {
+            tmp = doGetTile(1 + doRandom() % (maze.width - 2), 1 + doRandom() % (maze.height - 2));
+        } while (tmp -> isWall);
+    } 
+    else
+    {
+        tmp = doGetTile(maze.houseX + doRandom() % maze.houseW, maze.houseY + doRandom() % maze.houseH);
+    }
+
+    return tmp;
+} 
+
+void doEnemyScatter(enemyClass* enemy, const int i)
+{
+    if (enemy -> curGridPos[i] != enemy -> scatterPointOne[i])
+    {
+        enemy -> target[i] = enemy -> scatterPointOne[i];
+    }
+
+    if (enemy -> curGridPos[i] != enemy -> scatterPointTwo[i])
+    {
+        enemy -> target[i] = enemy -> scatterPointTwo[i];
+    }
+}
+
+void doPinkySearch(const playerClass* player, enemyClass* enemy, const int i)
+{
+    gridClass *tmp = player -> curGridPos; 
+
+    switch (player -> curHeading)
+    {
+        case up: 
+            tmp = doGetTileOffset(tmp, 0, -3); 
+        break;
+        
+        case down: 
+            tmp = doGetTileOffset(tmp, 0, 3); 
+        break;
+        
+        case left: 
+            tmp = doGetTileOffset(tmp, -3, 0); 
+        break;
+        
+        case right: 
+            tmp = doGetTileOffset(tmp, 3, 0); 
+        break;
+        
+        case idle: 
+        break;
+    }
+
+    doIsWalkable(tmp) ? (enemy -> target[i] = tmp) : (enemy -> target[i] = player -> curGridPos);
+
+    if (enemy -> curGridPos[i] == enemy -> target[i])
+    {
+        doEnemyScatter(enemy, i);
+    }
+}
+
+void doInkySearch(const playerClass* player, enemyClass* enemy, const int i)
+{
+    float tmp = doDistance(player -> curGridPos, enemy -> curGridPos[i]) / SIZE_TILE;
+
+    tmp <= 8 ? doEnemyScatter(enemy, i) : (enemy -> target[i] = player -> curGridPos);
+}
+
+void doClydeSearch(const playerClass* player, enemyClass* enemy, const int i)
+{
+    // clyde works off the first ghost, which always has blinky's behaviour
+    const gridClass *blinkyPos = enemy -> curGridPos[blinky];
+    float coordX, coordY, dist;
+    gridClass* tmp1 = player -> curGridPos; 
+
+    switch (player -> curHeading)
+    {
+        case up: 
+            tmp1 = doGetTileOffset(tmp1, 0, -2); 
+        break;
+        
+        case down: 
+            tmp1 = doGetTileOffset(tmp1, 0, 2); 
+        break;
+        
+        case left: 
+            tmp1 = doGetTileOffset(tmp1, -2, 0); 
+        break;
+        
+        case right: 
+            tmp1 = doGetTileOffset(tmp1, 2, 0); 
+        break;
+        
+        case idle: 
+        break;
+    }
+
+    if (!tmp1)
+    {
+        tmp1 = player -> curGridPos;
+    }
+
+    dist = doDistance(blinkyPos, tmp1);
+    coordX = tmp1 -> gridX - 2 * dist * (tmp1 -> gridX - blinkyPos -> gridX) / dist;
+    coordY = tmp1 -> gridY - 2 * dist * (tmp1 -> gridY - blinkyPos -> gridY) / dist;
+
+    if ( (coordX < maze.width * SIZE_TILE && coordX >= 0) && (coordY < maze.height * SIZE_TILE && coordY >= 0) )
+    {
+        gridClass* tmp2 = NULL;
+        int x = (int)(coordX / SIZE_TILE), y = (int)(coordY / SIZE_TILE);
+
+        // only a point that lands exactly on a tile counts
+        if ((float)x * SIZE_TILE == coordX && (float)y * SIZE_TILE == coordY)
+        {
+            tmp2 = doGetTile(x, y);
+        }
+
+        if (tmp2 && !tmp2 -> isWall)
+        {
+            enemy -> target[i] = tmp2;
+        }
+
+        if (enemy -> curGridPos[i] == tmp2)
+        {
+            doEnemyScatter(enemy, i);
+        }
+
+    } else
+    {
+        enemy -> target[i] = player -> curGridPos;
+    }
+}
+
+void doUpdateEnemyState(gameClass* game, const playerClass* player, enemyClass* enemy)
+{
+    // mode changes arrive through scheduled events, this only picks targets for the current mode
+    for (int i = 0; i < enemy -> count; i++)
+    {
+        switch (enemy -> state[i]) 
+        {
+            case home: case frightened:
+                if (!enemy -> isRandLocationSet[i])
+                {
+                    enemy -> target[i] = doGetRandomLocation(enemy, i);
+                    enemy -> isRandLocationSet[i] = SDL_TRUE;
+                }
+
+                if (enemy -> isRandLocationSet[i] && enemy -> curGridPos[i] == enemy -> target[i])
+                {
+                    enemy -> isRandLocationSet[i] = SDL_FALSE;
+                }
+            break;
+
+            case scatter:   
+                doEnemyScatter(enemy, i); 
+            break;
+        
+            case chase:
+                switch (enemy -> behaviour[i])
+                {
+                    case blinky: 
+                        enemy -> target[i] = player -> curGridPos; 
+                    break;
+                    
+                    case pinky: 
+                        doPinkySearch(player, enemy, i); 
+                    break;
+                    
+                    case inky: 
+                        doInkySearch(player, enemy, i); 
+                    break;
+                    
+                    case clyde: 
+                        doClydeSearch(player, enemy, i); 
+                    break;
+                }
+
+                enemy -> isRandLocationSet[i] = SDL_FALSE;
+            break;
+
+            case eaten:
+                enemy -> target[i] = doGetTile(maze.houseX + (maze.houseW - 1) / 2, maze.houseY + (maze.houseH - 1) / 2);
+                enemy -> isRandLocationSet[i] = SDL_FALSE; 
+
+                if (enemy -> curGridPos[i] == enemy -> target[i]) 
+                {
+                    doSetEnemyState(game, enemy, i, chase);
+                }
+            break;
+        }
+    }
+}
+
+void doUpdateEnemySpeed(enemyClass* enemy, const int i, const unsigned int ballsLeft)
+{
+    switch (enemy -> state[i]) 
+    {
+        case chase: case scatter: case home: 
+            ballsLeft < 50 ? (enemy -> speed[i] = 2.5f) : (enemy -> speed[i] = 2.0f); 
+        break;
+        
+        case frightened: 
+            enemy -> speed[i] = 0.5f; 
+        break;
+        
+        case eaten:
+            enemy -> speed[i] = 4.0f; 
+        break;
+    }
+}
+
+void doUpdateEnemyHeading(enemyClass* enemy, const int i)
+{
+    if (enemy -> vectorX[i] == 0 && enemy -> vectorY[i] < 0)
+    {
+        enemy -> heading[i] = up;
+    }
+    
+    if (enemy -> vectorX[i] == 0 && enemy -> vectorY[i] > 0)
+    {
+        enemy -> heading[i] = down;
+    }
+    
+    if (enemy -> vectorX[i] < 0 && enemy -> vectorY[i] == 0)
+    {
+        enemy -> heading[i] = left;
+    }
+
+    if (enemy -> vectorX[i] > 0 && enemy -> vectorY[i] == 0)
+    {
+        enemy -> heading[i] = right;
+    }
+}
+
+headingName doSpeculationHeading(const enemyClass* enemy, const int i)
+{
+    // the heading only matters to a step while turning back is forbidden
+    return enemy -> state[i] == scatter || enemy -> state[i] == chase ? enemy -> heading[i] : idle;
+}
+
+gridClass* doTakeEnemyStep(enemyClass* enemy, const int i)
+{
+    // a step depends on nothing but the tile, the target and the heading rule, so a speculated one that
+    // assumed all three is exactly the step a search would give now
+    SDL_bool isCheap = enemy -> curGridPos[i] == enemy -> target[i] || doGetDistanceMap(enemy -> target[i]);
+
+    if (!isRollingOut && !isCheap)
+    {
+        speculation.decisions++;
+
+        if (enemy -> specFrom[i] == enemy -> curGridPos[i] && enemy -> specTarget[i] == enemy -> target[i] && enemy -> specHeading[i] == doSpeculationHeading(enemy, i))
+        {
+            speculation.predicted++;
+            return enemy -> specStep[i];
+        }
+
+        enemy -> specFrom[i] == enemy -> curGridPos[i] ? speculation.mispredicted++ : speculation.unready++;
+    }
+
+    return doGetEnemyStep(enemy, i);
+}
+
+void doSpeculateSteps(enemyClass* enemy)
+{
+    // ghosts a few ticks from their next tile search from it now, the closest first and only a few per
+    // tick, so that ghosts arriving together find their steps ready instead of all searching at once;
+    // starting late keeps the guessed target close to the one the ghost will actually have
+    int budget = SDL_max(SPECULATION_BUDGET, enemy -> count / 4);
+
+    for (int ahead = 1; ahead <= SPECULATION_HORIZON && budget; ahead++)
+    {
+        for (int i = 0; i < enemy -> count && budget; i++)
+        {
+            gridClass *from = enemy -> curGridPos[i], *to = enemy -> newGridPos[i];
+            float left = fabsf(to -> gridX - enemy -> posX[i]) + fabsf(to -> gridY - enemy -> posY[i]);
+
+            if (!enemy -> isMoving[i] || (int)ceilf(left / enemy -> speed[i]) + 1 != ahead || to == enemy -> target[i] ||
+                (enemy -> specFrom[i] == to && enemy -> specTarget[i] == enemy -> target[i] && enemy -> specHeading[i] == doSpeculationHeading(enemy, i)) || doGetDistanceMap(enemy -> target[i]))
+            {
+                continue;
+            }
+
+            // a guess is not a search the ghost made, it only shows up in the speculation counters
+            SDL_bool wasRecording = isRecordingPaths;
+            uint64_t searches = pathSearches;
+
+            isRecordingPaths = SDL_FALSE;
+            enemy -> curGridPos[i] = to;
+            enemy -> specStep[i] = doGetEnemyStep(enemy, i);
+            enemy -> curGridPos[i] = from;
+            isRecordingPaths = wasRecording;
+            pathSearches = searches;
+            enemy -> specFrom[i] = to;
+            enemy -> specTarget[i] = enemy -> target[i];
+            enemy -> specHeading[i] = doSpeculationHeading(enemy, i);
+            speculation.searches++;
+            budget--;
+        }
+    }
+}
+
+void doReportSpeculation(const speculationClass* stats)
+{
+    int count = (int)SDL_min(stats -> ticks, SPECULATION_SAMPLES);
+    float sorted[SPECULATION_SAMPLES];
+    double decisions = stats -> decisions ? (double)stats -> decisions : 1.0;
+
+    memcpy(sorted, stats -> stepUs, count * sizeof(float));
+    qsort(sorted, count, sizeof(float), doCompareFloat);
+    printf("speculation: %llu searched decisions, %.1f%% predicted, %.1f%% mispredicted, %.1f%% not ready; %llu speculative searches; ghost moves per tick p50 %.1f us, p99 %.1f us over the last %d ticks, worst %.1f us\n"
+           "speculation: ticks by searches in them %llu none, %llu one, %llu two, %llu more, %llu at most\n",
+           (unsigned long long)stats -> decisions, stats -> predicted * 100.0 / decisions, stats -> mispredicted * 100.0 / decisions, stats -> unready * 100.0 / decisions,
+           (unsigned long long)stats -> searches, count ? sorted[count / 2] : 0.0f, count ? sorted[count * 99 / 100] : 0.0f, count, stats -> worstUs,
+           (unsigned long long)stats -> bursts[0], (unsigned long long)stats -> bursts[1], (unsigned long long)stats -> bursts[2], (unsigned long long)stats -> bursts[3], (unsigned long long)stats -> worstBurst);
+}
+
+void doEnemyMove(gameClass* game, const playerClass* player, enemyClass* enemy)
+{
+    unsigned int ballsLeft = doBallsLeft(game);
+    uint64_t start = isRollingOut ? 0 : doMonotonicNs(), searches = pathSearches + speculation.searches;
+
+    // ghosts standing on a tile pick their next step
+    PROFILE_BEGIN(phasePathfinding);
+
+    for (int i = 0; i < enemy -> count; i++)
+    {  
+        if (!enemy -> isMoving[i])
+        {   
+            enemy -> newGridPos[i] = isSpeculating ? doTakeEnemyStep(enemy, i) : doGetEnemyStep(enemy, i);
+
+            enemy -> vectorX[i] = (int)(enemy -> newGridPos[i] -> gridX - enemy -> curGridPos[i] -> gridX) / SIZE_TILE; // 1, -1, 0
+            enemy -> vectorY[i] = (int)(enemy -> newGridPos[i] -> gridY - enemy -> curGridPos[i] -> gridY) / SIZE_TILE; // 1, -1, 0
+            enemy -> isMoving[i] = SDL_TRUE;
+
+            // a step through a portal is not a unit move, the ghost hops straight to the other end
+            if (abs(enemy -> vectorX[i]) + abs(enemy -> vectorY[i]) > 1)
+            {
+                enemy -> heading[i] = enemy -> vectorX[i] > 0 ? left : right;
+                enemy -> vectorX[i] = enemy -> vectorY[i] = 0;
+                enemy -> posX[i] = enemy -> newGridPos[i] -> gridX;
+                enemy -> posY[i] = enemy -> newGridPos[i] -> gridY;
+                continue;
+            }
+
+            doUpdateEnemyHeading(enemy, i);
+        }
+    }
+
+    PROFILE_END(phasePathfinding);
+    PROFILE_BEGIN(phaseMovement);
+
+    for (int i = 0; i < enemy -> count; i++)
+    {
+        // after enemy move is finished, we update his position and state
+        if (enemy -> posX[i] == enemy -> newGridPos[i] -> gridX && enemy -> posY[i] == enemy -> newGridPos[i] -> gridY)
+        {
+            enemy -> isMoving[i] = SDL_FALSE;
+            enemy -> curGridPos[i] = enemy -> newGridPos[i];
+            enemy -> vectorX[i] = enemy -> vectorY[i] = 0;
+            doUpdateEnemySpeed(enemy, i, ballsLeft);
+        } else 
+        {
+            enemy -> posX[i] += enemy -> speed[i] * (float)enemy -> vectorX[i]; 
+            enemy -> posY[i] += enemy -> speed[i] * (float)enemy -> vectorY[i];
+        }
+        doTeleport(&enemy -> posX[i], &enemy -> posY[i], &enemy -> curGridPos[i], &enemy -> newGridPos[i], enemy -> heading[i]);
+    }
+
+    PROFILE_END(phaseMovement);
+
+    if (isRollingOut)
+    {
+        return;
+    }
+
+    if (isSpeculating)
+    {
+        PROFILE_BEGIN(phasePathfinding);
+        doSpeculateSteps(enemy);
+        PROFILE_END(phasePathfinding);
+    }
+
+    speculation.stepUs[speculation.ticks++ % SPECULATION_SAMPLES] = (float)(doMonotonicNs() - start) / 1e3f;
+    speculation.worstUs = SDL_max(speculation.worstUs, speculation.stepUs[(speculation.ticks - 1) % SPECULATION_SAMPLES]);
+    // bursts count the speculative searches too, they run in the same tick
+    searches = pathSearches + speculation.searches - searches;
+    speculation.bursts[SDL_min(searches, 3)]++;
+    speculation.worstBurst = SDL_max(speculation.worstBurst, searches);
+}
+
+// GLOBAL EVENTS THAT AFFECT BOTH PLAYER AND ENEMY
+
+void doEatFood(gameClass* game, playerClass* player, enemyClass* enemy)
+{
+    foodName food = doGetFood(game, player -> curGridPos);
+    unsigned int ballsLeft = doBallsLeft(game);
+
+    if (food == smallBall)
+    {
+        doClearFood(game, player -> curGridPos);
+        game -> currentScore += 10;   
+    } 
+    else if (food == largeBall)
+    {
+        doClearFood(game, player -> curGridPos);
+        game -> currentScore += 100;
+        for (int i = 0; i < enemy -> count; i++)
+        {
+            if (enemy -> state[i] != eaten)
+            {
+                doSetEnemyState(game, enemy, i, frightened);
+            }
+        }
+    }
+
+    // the ghost house opens once, when the pellet count drops below the threshold
+    if (food != noFood && ballsLeft == doReleaseThreshold())
+    {
+        doReleaseEnemies(game, enemy);
+    }
+}
+
+// PROCESS ENCOUNTERS
+
+SDL_bool doCollisionLane(const float playerX, const float playerY, const float enemyX, const float enemyY)
+{
+    SDL_bool checkX = fabsf(playerX - enemyX) * 2.0f < (float)(SIZE_TILE * 2); 
+    SDL_bool checkY = fabsf(playerY - enemyY) * 2.0f < (float)(SIZE_TILE * 2); 
+
+    return checkX && checkY;
+}
+
+SDL_bool doCollisionBox(const playerClass* player, const enemyClass* enemy, const int i)
+{
+    return doCollisionLane(player -> posX, player -> posY, enemy -> posX[i], enemy -> posY[i]);
+}
+
+void doCollisionKernel(const float* playerX, const float* playerY, const int playerStride, const float* enemyX, const float* enemyY, const int count, uint32_t* mask)
+{
+    // one bit per ghost, playerStride 0 tests a single player against every ghost, 1 pairs each ghost with its own player
+    int i = 0;
+
+    memset(mask, 0, sizeof(uint32_t) * (count / 32 + 1));
+
+#if defined(__AVX__)
+    const __m256 sign = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+    const __m256 two = _mm256_set1_ps(2.0f);
+    const __m256 box = _mm256_set1_ps((float)(SIZE_TILE * 2));
+
+    for (; i + 8 <= count; i += 8)
+    {
+        __m256 px = playerStride ? _mm256_loadu_ps(playerX + i) : _mm256_broadcast_ss(playerX);
+        __m256 py = playerStride ? _mm256_loadu_ps(playerY + i) : _mm256_broadcast_ss(playerY);
+        __m256 dx = _mm256_mul_ps(_mm256_and_ps(_mm256_sub_ps(px, _mm256_loadu_ps(enemyX + i)), sign), two);
+        __m256 dy = _mm256_mul_ps(_mm256_and_ps(_mm256_sub_ps(py, _mm256_loadu_ps(enemyY + i)), sign), two);
+        __m256 hit = _mm256_and_ps(_mm256_cmp_ps(dx, box, _CMP_LT_OQ), _mm256_cmp_ps(dy, box, _CMP_LT_OQ));
+
+        mask[i / 32] |= (uint32_t)_mm256_movemask_ps(hit) << (i % 32);
+    }
+#elif defined(__SSE2__)
+    const __m128 sign = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+    const __m128 two = _mm_set1_ps(2.0f);
+    const __m128 box = _mm_set1_ps((float)(SIZE_TILE * 2));
+
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128 px = playerStride ? _mm_loadu_ps(playerX + i) : _mm_set1_ps(*playerX);
+        __m128 py = playerStride ? _mm_loadu_ps(playerY + i) : _mm_set1_ps(*playerY);
+        __m128 dx = _mm_mul_ps(_mm_and_ps(_mm_sub_ps(px, _mm_loadu_ps(enemyX + i)), sign), two);
+        __m128 dy = _mm_mul_ps(_mm_and_ps(_mm_sub_ps(py, _mm_loadu_ps(enemyY + i)), sign), two);
+        __m128 hit = _mm_and_ps(_mm_cmplt_ps(dx, box), _mm_cmplt_ps(dy, box));
+
+        mask[i / 32] |= (uint32_t)_mm_movemask_ps(hit) << (i % 32);
+    }
+#endif
+
+    for (; i < count; i++)
+    {
+        if (doCollisionLane(playerX[i * playerStride], playerY[i * playerStride], enemyX[i], enemyY[i]))
+        {
+            mask[i / 32] |= 1u << (i % 32);
+        }
+    }
+}
+
+void doResolveEncounter(gameClass* game, playerClass* player, enemyClass* enemy, const uint32_t* mask)
+{
+    for (int w = 0; w <= enemy -> count / 32; w++)
+    {
+        uint32_t bits = mask[w];
+
+        while (bits)
+        {
+            int i = w * 32 + __builtin_ctz(bits);
+            bits &= bits - 1;
+
+            if (enemy -> state[i] == frightened)
+            {
+                doSetEnemyState(game, enemy, i, eaten);
+                game -> currentScore += 100;
+            }
+            
+            if (enemy -> state[i] == scatter || enemy -> state[i] == chase)
+            {
+                player -> isAlive = SDL_FALSE;
+            }
+        }
+    }
+}
+
+void doCheckEncounter(gameClass* game, playerClass* player, enemyClass* enemy)
+{
+    doCollisionKernel(&player -> posX, &player -> posY, 0, enemy -> posX, enemy -> posY, enemy -> count, enemy -> hitMask);
+    doResolveEncounter(game, player, enemy, enemy -> hitMask);
+}
+
+void doCheckEncounterBatch(gameClass** game, playerClass** player, enemyClass** enemy, const int games)
+{
+    // pack every ghost of every game next to a copy of its player so a single kernel pass tests them all
+    static _Thread_local float *packed = NULL;
+    static _Thread_local uint32_t *mask = NULL;
+    static _Thread_local int capacity = 0;
+    int total = 0, offset = 0;
+
+    for (int g = 0; g < games; g++)
+    {
+        total += enemy[g] -> count;
+    }
+
+    if (total > capacity)
+    {
+        free(packed);
+        free(mask);
+        capacity = total;
+        packed = doAllocate((size_t)capacity * 4, sizeof(float));
+        mask = doAllocate(capacity / 32 + 1, sizeof(uint32_t));
+    }
+
+    float *playerX = packed, *playerY = packed + total, *enemyX = packed + total * 2, *enemyY = packed + total * 3;
+
+    for (int g = 0; g < games; g++)
+    {
+        for (int i = 0; i < enemy[g] -> count; i++)
+        {
+            playerX[offset + i] = player[g] -> posX;
+            playerY[offset + i] = player[g] -> posY;
+        }
+
+        memcpy(enemyX + offset, enemy[g] -> posX, sizeof(float) * enemy[g] -> count);
+        memcpy(enemyY + offset, enemy[g] -> posY, sizeof(float) * enemy[g] -> count);
+        offset += enemy[g] -> count;
+    }
+
+    doCollisionKernel(playerX, playerY, 1, enemyX, enemyY, total, mask);
+
+    // hand each game its slice of the mask
+    offset = 0;
+
+    for (int g = 0; g < games; g++)
+    {
+        memset(enemy[g] -> hitMask, 0, sizeof(uint32_t) * (enemy[g] -> count / 32 + 1));
+
+        for (int i = 0; i < enemy[g] -> count; i++)
+        {
+            int bit = offset + i;
+
+            if (mask[bit / 32] & (1u << (bit % 32)))
+            {
+                enemy[g] -> hitMask[i / 32] |= 1u << (i % 32);
+            }
+        }
+
+        doResolveEncounter(game[g], player[g], enemy[g], enemy[g] -> hitMask);
+        offset += enemy[g] -> count;
+    }
+}
+
+// GAME PAUSE
+
+SDL_bool doGamePause(gameClass* game, const unsigned int time)
+{
+    if (!game -> timeDelay)
+    {
+        game -> timeDelay = game -> tick + time * TICK_RATE;
+        doScheduleEvent(&game -> wheel, game -> timeDelay, pauseEnd, -1, 0);
+    }
+
+    if (game -> isPauseOver)
+    {
+        game -> timeDelay = 0;
+        game -> isPauseOver = SDL_FALSE;
+        return SDL_TRUE;
+    }
+    
+    return SDL_FALSE;
+}
+
+// GAME CLOCK
+
+uint64_t doMonotonicNs(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+}
+
+void doHandleEvent(gameClass* game, enemyClass* enemy, const eventClass* event)
+{
+    if (event -> type == pauseEnd)
+    {
+        game -> isPauseOver = SDL_TRUE;
+        return;
+    }
+
+    // a state change since scheduling invalidates the event
+    if (event -> generation != enemy -> timerGeneration[event -> ghost])
+    {
+        return;
+    }
+
+    switch (event -> type)
+    {
+        case scatterEnd: 
+            doSetEnemyState(game, enemy, event -> ghost, chase);
+        break;
+
+        case chaseEnd:
+            doSetEnemyState(game, enemy, event -> ghost, scatter);
+        break;
+
+        case frightenedEnd:
+            doSetEnemyState(game, enemy, event -> ghost, chase);
+        break;
+
+        case frightenedAlmostEnd:
+            enemy -> isTimeAlmostEnd[event -> ghost] = SDL_TRUE;
+        break;
+
+        case houseRelease:
+            doSetEnemyState(game, enemy, event -> ghost, scatter);
+        break;
+
+        case pauseEnd:
+        break;
+    }
+}
+
+void doAdvanceClock(gameClass* game, enemyClass* enemy)
+{
+    game -> tick++;
+
+    int i = doTakeDueEvents(&game -> wheel, game -> tick);
+
+    while (i >= 0)
+    {
+        eventClass event = game -> wheel.events[i];
+        doFreeEvent(&game -> wheel, i);
+        doHandleEvent(game, enemy, &event);
+        i = event.next;
+    }
+}
+
+void doStartRound(gameClass* game, enemyClass* enemy)
+{
+    // timers start with the first move after the ready screen, not when the round is set up
+    for (int i = 0; i < enemy -> count; i++)
+    {
+        if (enemy -> state[i] == scatter)
+        {
+            doSetEnemyState(game, enemy, i, scatter);
+        }
+    }
+
+    if (!doReleaseThreshold() || doBallsLeft(game) < doReleaseThreshold())
+    {
+        doReleaseEnemies(game, enemy);
+    }
+
+    game -> isRoundStarted = SDL_TRUE;
+}
+
+// INIT CHARACTERS
+
+void doInitPlayer(playerClass* player)
+{
+    player -> isAlive = SDL_TRUE; 
+    player -> speed = 4.0f; 
+    player -> curGridPos = player -> newGridPos = doGetTile(maze.playerX, maze.playerY); 
+    player -> posX = player -> curGridPos -> gridX; 
+    player -> posY = player -> curGridPos -> gridY;
+    player -> vector[0] = player -> vector[1] = 0;
+    player -> curHeading = player -> newHeading = idle;
+}
+
+void doAllocEnemies(enemyClass* enemy, const int count)
+{
+    enemy -> count = count;
+    enemy -> speed = doAllocate(count, sizeof(float));
+    enemy -> posX = doAllocate(count, sizeof(float));
+    enemy -> posY = doAllocate(count, sizeof(float));
+    enemy -> prevX = doAllocate(count, sizeof(float));
+    enemy -> prevY = doAllocate(count, sizeof(float));
+    enemy -> vectorX = doAllocate(count, sizeof(short));
+    enemy -> vectorY = doAllocate(count, sizeof(short));
+    enemy -> heading = doAllocate(count, sizeof(headingName));
+    enemy -> state = doAllocate(count, sizeof(stateName));
+    enemy -> behaviour = doAllocate(count, sizeof(ghostName));
+    enemy -> target = doAllocate(count, sizeof(gridClass*));
+    enemy -> curGridPos = doAllocate(count, sizeof(gridClass*));
+    enemy -> newGridPos = doAllocate(count, sizeof(gridClass*));
+    enemy -> scatterPointOne = doAllocate(count, sizeof(gridClass*));
+    enemy -> scatterPointTwo = doAllocate(count, sizeof(gridClass*));
+    enemy -> isMoving = doAllocate(count, sizeof(SDL_bool));
+    enemy -> isRandLocationSet = doAllocate(count, sizeof(SDL_bool));
+    enemy -> isTimeAlmostEnd = doAllocate(count, sizeof(SDL_bool));
+    enemy -> timerGeneration = doAllocate(count, sizeof(unsigned int));
+    enemy -> hitMask = doAllocate(count / 32 + 1, sizeof(uint32_t));
+    enemy -> specFrom = doAllocate(count, sizeof(gridClass*));
+    enemy -> specTarget = doAllocate(count, sizeof(gridClass*));
+    enemy -> specStep = doAllocate(count, sizeof(gridClass*));
+    enemy -> specHeading = doAllocate(count, sizeof(headingName));
+}
+
+void doFreeEnemies(enemyClass* enemy)
+{
+    free(enemy -> speed);
+    free(enemy -> posX);
+    free(enemy -> posY);
+    free(enemy -> prevX);
+    free(enemy -> prevY);
+    free(enemy -> vectorX);
+    free(enemy -> vectorY);
+    free(enemy -> heading);
+    free(enemy -> state);
+    free(enemy -> behaviour);
+    free(enemy -> target);
+    free(enemy -> curGridPos);
+    free(enemy -> newGridPos);
+    free(enemy -> scatterPointOne);
+    free(enemy -> scatterPointTwo);
+    free(enemy -> isMoving);
+    free(enemy -> isRandLocationSet);
+    free(enemy -> isTimeAlmostEnd);
+    free(enemy -> timerGeneration);
+    free(enemy -> hitMask);
+    free(enemy -> specFrom);
+    free(enemy -> specTarget);
+    free(enemy -> specStep);
+    free(enemy -> specHeading);
+    enemy -> count = 0;
+}
+
+void doCopyEnemies(enemyClass* dst, const enemyClass* src)
+{
+    if (dst -> count != src -> count)
+    {
+        if (dst -> count)
+        {
+            doFreeEnemies(dst);
+        }
+
+        doAllocEnemies(dst, src -> count);
+    }
+
+    memcpy(dst -> speed, src -> speed, src -> count * sizeof(float));
+    memcpy(dst -> posX, src -> posX, src -> count * sizeof(float));
+    memcpy(dst -> posY, src -> posY, src -> count * sizeof(float));
+    memcpy(dst -> prevX, src -> prevX, src -> count * sizeof(float));
+    memcpy(dst -> prevY, src -> prevY, src -> count * sizeof(float));
+    memcpy(dst -> vectorX, src -> vectorX, src -> count * sizeof(short));
+    memcpy(dst -> vectorY, src -> vectorY, src -> count * sizeof(short));
+    memcpy(dst -> heading, src -> heading, src -> count * sizeof(headingName));
+    memcpy(dst -> state, src -> state, src -> count * sizeof(stateName));
+    memcpy(dst -> behaviour, src -> behaviour, src -> count * sizeof(ghostName));
+    memcpy(dst -> target, src -> target, src -> count * sizeof(gridClass*));
+    memcpy(dst -> curGridPos, src -> curGridPos, src -> count * sizeof(gridClass*));
+    memcpy(dst -> newGridPos, src -> newGridPos, src -> count * sizeof(gridClass*));
+    memcpy(dst -> scatterPointOne, src -> scatterPointOne, src -> count * sizeof(gridClass*));
+    memcpy(dst -> scatterPointTwo, src -> scatterPointTwo, src -> count * sizeof(gridClass*));
+    memcpy(dst -> isMoving, src -> isMoving, src -> count * sizeof(SDL_bool));
+    memcpy(dst -> isRandLocationSet, src -> isRandLocationSet, src -> count * sizeof(SDL_bool));
+    memcpy(dst -> isTimeAlmostEnd, src -> isTimeAlmostEnd, src -> count * sizeof(SDL_bool));
+    memcpy(dst -> timerGeneration, src -> timerGeneration, src -> count * sizeof(unsigned int));
+}
+
+void doInitEnemy(enemyClass* enemy)
+{
+    for (int i = 0; i < enemy -> count; i++)
+    {
+        gridClass *spawn = NULL;
+
+        enemy -> target[i] = NULL;
+        enemy -> speed[i] = 2.5f;
+        enemy -> vectorX[i] = enemy -> vectorY[i] = 0;
+        enemy -> isMoving[i] = enemy -> isRandLocationSet[i] = enemy -> isTimeAlmostEnd[i] = SDL_FALSE;  
+        enemy -> timerGeneration[i] = 0;
+        enemy -> behaviour[i] = i % 4;
+
+        switch (enemy -> behaviour[i]) 
+        {
+            case blinky:
+                enemy -> heading[i] = up;
+                enemy -> state[i] = scatter;
+            break;
+        
+            case pinky:
+                enemy -> heading[i] = left;
+                enemy -> state[i] = home;
+            break;
+
+            case inky:
+                enemy -> heading[i] = down;
+                enemy -> state[i] = home;
+            break;
+
+            case clyde:
+                enemy -> heading[i] = right;
+                enemy -> state[i] = home;
+            break;
+        }
+
+        const int *place = maze.ghostSpawn[enemy -> behaviour[i]];
+        spawn = doGetTile(place[0], place[1]);
+        enemy -> scatterPointOne[i] = doGetTile(place[2], place[3]);
+        enemy -> scatterPointTwo[i] = doGetTile(place[4], place[5]);
+
+        // only the original four have their own spawn, everyone else queues up inside the house
+        if (i >= 4)
+        {
+            enemy -> state[i] = home;
+            spawn = doGetTile(maze.houseX + i % maze.houseW, maze.houseY + i / maze.houseW % maze.houseH);
+        }
+
+        enemy -> posX[i] = spawn -> gridX;
+        enemy -> posY[i] = spawn -> gridY;
+        enemy -> curGridPos[i] = enemy -> newGridPos[i] = spawn;
+    }
+}
+
+void doInitRound(gameClass* game, playerClass* player, enemyClass* enemy)
+{
+    doInitPlayer(player);
+    doInitEnemy(enemy);
+    doClearEvents(&game -> wheel);
+    game -> isRoundStarted = SDL_FALSE;
+    game -> turnCount = 0;
+}
+
+void doInitGame(gameClass* game)
+{
+    memset(game, 0, sizeof(gameClass));
+    game -> playerLives = 3;
+    game -> level = 1;
+    game -> foodSmall = doAllocate(maze.foodWords, sizeof(uint64_t));
+    game -> foodLarge = doAllocate(maze.foodWords, sizeof(uint64_t));
+    doInitWheel(&game -> wheel);
+    doInitFood(game);
+}
+
+void doCopyGame(gameClass* dst, const gameClass* src)
+{
+    // a deep copy that reuses whatever buffers dst already owns
+    uint64_t *foodSmall = dst -> foodSmall, *foodLarge = dst -> foodLarge;
+    eventClass *events = dst -> wheel.events;
+
+    if (!foodSmall)
+    {
+        foodSmall = doAllocate(maze.foodWords, sizeof(uint64_t));
+        foodLarge = doAllocate(maze.foodWords, sizeof(uint64_t));
+    }
+
+    if (!events || dst -> wheel.capacity < src -> wheel.capacity)
+    {
+        events = realloc(events, src -> wheel.capacity * sizeof(eventClass));
+
+        if (!events)
+        {
+            fprintf(stderr, "Failed to allocate %zu bytes\n", src -> wheel.capacity * sizeof(eventClass));
+            exit(4);
+        }
+    }
+
+    *dst = *src;
+    dst -> foodSmall = foodSmall;
+    dst -> foodLarge = foodLarge;
+    dst -> wheel.events = events;
+    memcpy(foodSmall, src -> foodSmall, maze.foodWords * sizeof(uint64_t));
+    memcpy(foodLarge, src -> foodLarge, maze.foodWords * sizeof(uint64_t));
+    memcpy(events, src -> wheel.events, src -> wheel.capacity * sizeof(eventClass));
+}
+
+void doFreeGame(gameClass* game)
+{
+    free(game -> foodSmall);
+    free(game -> foodLarge);
+    free(game -> wheel.events);
+}
+
+// MAZE FILES
+
+// the arcade board in the maze file format: '#' wall, '.' small pellet, 'o' large pellet, ' ' empty floor
+const char *builtInMaze =
+    "size 30 31\n"
+    "portal 0 14 29 14\n"
+    "player 14 23\n"
+    "house 12 13 6 3\n"
+    "ghost 14 11 27 5 22 1\n"
+    "ghost 13 14 7 1 2 5\n"
+    "ghost 14 14 7 23 8 29\n"
+    "ghost 15 14 22 23 21 29\n"
+    "tiles\n"
+    "##############################\n"
+    "##............##............##\n"
+    "##.####.#####.##.#####.####.##\n"
+    "##o####.#####.##.#####.####o##\n"
+    "##.####.#####.##.#####.####.##\n"
+    "##..........................##\n"
+    "##.####.##.########.##.####.##\n"
+    "##.####.##.########.##.####.##\n"
+    "##......##....##....##......##\n"
+    "#######.##### ## #####.#######\n"
+    "#######.##### ## #####.#######\n"
+    "#######.##          ##.#######\n"
+    "#######.## ###  ### ##.#######\n"
+    "#######.## #      # ##.#######\n"
+    "       .   #      #   .       \n"
+    "#######.## #      # ##.#######\n"
+    "#######.## ######## ##.#######\n"
+    "#######.##          ##.#######\n"
+    "#######.## ######## ##.#######\n"
+    "#######.## ######## ##.#######\n"
+    "##............##............##\n"
+    "##.####.#####.##.#####.####.##\n"
+    "##o####.#####.##.#####.####o##\n"
+    "##...##....... ........##...##\n"
+    "####.##.##.########.##.##.####\n"
+    "####.##.##.########.##.##.####\n"
+    "##......##....##....##......##\n"
+    "##.##########.##.##########.##\n"
+    "##.##########.##.##########.##\n"
+    "##..........................##\n"
+    "##############################\n";
+
+SDL_bool doIsInsideMaze(const int x, const int y)
+{
+    return x >= 0 && y >= 0 && x < maze.width && y < maze.height;
+}
+
+SDL_bool doIsOnBorder(const int x, const int y)
+{
+    return doIsInsideMaze(x, y) && (x == 0 || y == 0 || x == maze.width - 1 || y == maze.height - 1);
+}
+
+void doValidateMaze(const char* path)
+{
+    // text mazes and packs go through the same checks once their tiles can be read
+    if (!doIsInsideMaze(maze.houseX, maze.houseY) || maze.houseW < 1 || maze.houseH < 1 || !doIsInsideMaze(maze.houseX + maze.houseW - 1, maze.houseY + maze.houseH - 1))
+    {
+        doMazeError(path, "house lies outside the maze");
+    }
+
+    if (!doIsWalkable(doGetTile(maze.playerX, maze.playerY)))
+    {
+        doMazeError(path, "player spawn is not on the floor");
+    }
+
+    for (int i = 0; i < 4; i++)
+    {
+        for (int k = 0; k < 6; k += 2)
+        {
+            if (!doIsWalkable(doGetTile(maze.ghostSpawn[i][k], maze.ghostSpawn[i][k + 1])))
+            {
+                doMazeError(path, "ghost spawn or scatter corner is not on the floor");
+            }
+        }
+    }
+
+    for (int i = 0; i < maze.portalCount; i++)
+    {
+        const int *p = maze.portal[i];
+
+        if (!doIsWalkable(doGetTile(p[0], p[1])) || !doIsWalkable(doGetTile(p[2], p[3])))
+        {
+            doMazeError(path, "portal is not on the floor");
+        }
+
+        if (!doIsOnBorder(p[0], p[1]) || !doIsOnBorder(p[2], p[3]) || (p[0] != p[2] && p[1] != p[3]))
+        {
+            doMazeError(path, "portal ends must lie on the edge, in the same row or column");
+        }
+    }
+}
+
+void doMapPack(const char* path)
+{
+    // the pack is shared read-only between every process that plays it, nothing is copied out
+    const packHeaderClass *header = NULL;
+    struct stat info;
+    int fd = open(path, O_RDONLY);
+
+    if (fd < 0 || fstat(fd, &info) || (size_t)info.st_size < sizeof(packHeaderClass))
+    {
+        doMazeError(path, "pack is truncated");
+    }
+
+    maze.packSize = (size_t)info.st_size;
+    maze.pack = mmap(NULL, maze.packSize, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (maze.pack == MAP_FAILED)
+    {
+        doMazeError(path, "cannot map pack");
+    }
+
+    header = (const packHeaderClass*)maze.pack;
+
+    if (header -> version != PACK_VERSION || header -> headerSize != sizeof(packHeaderClass))
+    {
+        doMazeError(path, "pack was written by another version");
+    }
+
+    if (doChecksum(header, offsetof(packHeaderClass, checksum)) != header -> checksum)
+    {
+        doMazeError(path, "pack header checksum mismatch");
+    }
+
+    if (header -> width < 3 || header -> height < 3 || header -> distanceCount > MAX_DISTANCE_MAPS || header -> portalCount < 0 || header -> portalCount > MAX_PORTALS)
+    {
+        doMazeError(path, "pack header is out of range");
+    }
+
+    long tiles = (long)header -> width * header -> height;
+    uint64_t expected[packSections] = { 
+        tiles, (tiles + 63) / 64 * 8, (tiles + 63) / 64 * 8, tiles, header -> walkableCount * 4ULL,
+        header -> junctionCount * 4ULL, header -> junctionCount * 4ULL * sizeof(junctionEdgeClass) 
+    };
+
+    for (int i = 0; i < packSections; i++)
+    {
+        const packSectionClass *tmp = &header -> sections[i];
+
+        if (i >= packDistance)
+        {
+            expected[i] = i - packDistance < (int)header -> distanceCount ? tiles * 4 : 0;
+        }
+
+        if (tmp -> size != expected[i] || tmp -> offset % 8 || tmp -> offset > maze.packSize || tmp -> size > maze.packSize - tmp -> offset)
+        {
+            doMazeError(path, "pack section out of bounds");
+        }
+    }
+
+    maze.width = header -> width;
+    maze.height = header -> height;
+    maze.playerX = header -> playerX;
+    maze.playerY = header -> playerY;
+    maze.houseX = header -> houseX;
+    maze.houseY = header -> houseY;
+    maze.houseW = header -> houseW;
+    maze.houseH = header -> houseH;
+    maze.portalCount = header -> portalCount;
+    maze.foodTotal = header -> foodTotal;
+    memcpy(maze.ghostSpawn, header -> ghostSpawn, sizeof(maze.ghostSpawn));
+    memcpy(maze.portal, header -> portal, sizeof(maze.portal));
+
+    maze.chunksX = (maze.width + CHUNK_SIZE - 1) / CHUNK_SIZE;
+    maze.chunksY = (maze.height + CHUNK_SIZE - 1) / CHUNK_SIZE;
+    maze.chunks = doAllocate(maze.chunksX * maze.chunksY, sizeof(gridClass*));
+    maze.foodWords = (int)((tiles + 63) / 64);
+    maze.foodSmallInit = doGetPackSection(packFoodSmall);
+    maze.foodLargeInit = doGetPackSection(packFoodLarge);
+
+    doValidateMaze(path);
+}
+
+void doLoadMaze(const char* path)
+{
+    char line[256], key[16];
+    int ghosts = 0;
+
+    memset(&maze, 0, sizeof(mazeClass));
+    maze.isBuiltIn = !path;
+    maze.path = path;
+    maze.lock = SDL_CreateMutex();
+    maze.source = path ? fopen(path, "rb") : fmemopen((void*)builtInMaze, strlen(builtInMaze), "rb");
+
+    if (!maze.source)
+    {
+        doMazeError(path, "cannot open file");
+    }
+
+    if (fgets(key, sizeof(key), maze.source) && !memcmp(key, PACK_MAGIC, sizeof(PACK_MAGIC)))
+    {
+        fclose(maze.source);
+        maze.source = NULL;
+        doMapPack(path);
+        return;
+    }
+
+    rewind(maze.source);
+
+    // header lines up to "tiles"; ';' starts a comment
+    while (fgets(line, sizeof(line), maze.source))
+    {
+        int *g = maze.ghostSpawn[ghosts % 4];
+
+        if (sscanf(line, "%15s", key) != 1 || key[0] == ';')
+        {
+            continue;
+        }
+
+        if (!strcmp(key, "tiles"))
+        {
+            maze.tilesOffset = ftell(maze.source);
+            break;
+        }
+
+        if (!strcmp(key, "size") && sscanf(line, "%*s %d %d", &maze.width, &maze.height) == 2) continue;
+        if (!strcmp(key, "player") && sscanf(line, "%*s %d %d", &maze.playerX, &maze.playerY) == 2) continue;
+        if (!strcmp(key, "house") && sscanf(line, "%*s %d %d %d %d", &maze.houseX, &maze.houseY, &maze.houseW, &maze.houseH) == 4) continue;
+
+        if (!strcmp(key, "portal") && maze.portalCount < MAX_PORTALS)
+        {
+            int *p = maze.portal[maze.portalCount++];
+
+            if (sscanf(line, "%*s %d %d %d %d", &p[0], &p[1], &p[2], &p[3]) == 4) continue;
+        }
+
+        if (!strcmp(key, "ghost") && ghosts < 4 && sscanf(line, "%*s %d %d %d %d %d %d", &g[0], &g[1], &g[2], &g[3], &g[4], &g[5]) == 6)
+        {
+            ghosts++;
+            continue;
+        }
+
+        doMazeError(path, line);
+    }
+
+    if (maze.width < 3 || maze.height < 3 || !maze.tilesOffset || ghosts != 4)
+    {
+        doMazeError(path, "needs size, four ghost lines and a tiles section");
+    }
+
+    maze.chunksX = (maze.width + CHUNK_SIZE - 1) / CHUNK_SIZE;
+    maze.chunksY = (maze.height + CHUNK_SIZE - 1) / CHUNK_SIZE;
+    maze.chunks = doAllocate(maze.chunksX * maze.chunksY, sizeof(gridClass*));
+    maze.foodWords = (int)(((long)maze.width * maze.height + 63) / 64);
+    uint64_t *foodSmall = doAllocate(maze.foodWords, sizeof(uint64_t));
+    uint64_t *foodLarge = doAllocate(maze.foodWords, sizeof(uint64_t));
+
+    // one streaming pass validates the rows and collects pellets, tiles themselves load per chunk on demand
+    char *row = doAllocate(maze.width + 2, 1);
+
+    for (int y = 0; y < maze.height; y++)
+    {
+        if (!fgets(row, maze.width + 2, maze.source) || (int)strcspn(row, "\n") != maze.width)
+        {
+            doMazeError(path, "tile rows must match the declared width");
+        }
+
+        for (int x = 0; x < maze.width; x++)
+        {
+            long i = (long)y * maze.width + x;
+
+            if (row[x] == '.')
+            {
+                foodSmall[i / 64] |= 1ULL << (i % 64);
+            }
+            else if (row[x] == 'o')
+            {
+                foodLarge[i / 64] |= 1ULL << (i % 64);
+            }
+            else if (row[x] != '#' && row[x] != ' ')
+            {
+                doMazeError(path, "unknown tile character");
+            }
+        }
+    }
+
+    free(row);
+    maze.foodSmallInit = foodSmall;
+    maze.foodLargeInit = foodLarge;
+    maze.foodTotal = doCountFood(maze.foodSmallInit) + doCountFood(maze.foodLargeInit);
+
+    doValidateMaze(path);
+}
+
+void doGenerateMaze(const int width, const int height, const char* path)
+{
+    // a lattice of 3x3 blocks with one tile corridors, for stress tests on boards of any size
+    FILE *tmp = fopen(path, "w");
+    int lastX = 1 + (width - 3) / 4 * 4, lastY = 1 + (height - 3) / 4 * 4;
+    int houseX = width / 2 - 3, houseY = height / 2 - 1, portalY = 1 + height / 8 * 4;
+    int playerX = 1 + width / 8 * 4, playerY = 1 + height * 3 / 16 * 4;
+
+    if (!tmp || width < 12 || height < 12)
+    {
+        fprintf(stderr, "Failed to generate maze %s: needs a writable path and at least 12x12 tiles\n", path);
+        exit(5);
+    }
+
+    fprintf(tmp, "size %d %d\n", width, height);
+    fprintf(tmp, "portal 0 %d %d %d\n", portalY, width - 1, portalY);
+    fprintf(tmp, "player %d %d\n", playerX, playerY);
+    fprintf(tmp, "house %d %d 6 3\n", houseX, houseY);
+    fprintf(tmp, "ghost %d %d %d 1 %d 1\n", houseX + 2, houseY, lastX, SDL_max(1, lastX - 4));
+    fprintf(tmp, "ghost %d %d 1 1 5 1\n", houseX + 1, houseY + 1);
+    fprintf(tmp, "ghost %d %d 1 %d 5 %d\n", houseX + 2, houseY + 1, lastY, lastY);
+    fprintf(tmp, "ghost %d %d %d %d %d %d\n", houseX + 3, houseY + 1, lastX, lastY, SDL_max(1, lastX - 4), lastY);
+    fprintf(tmp, "tiles\n");
+
+    for (int y = 0; y < height; y++)
+    {
+        for (int x = 0; x < width; x++)
+        {
+            SDL_bool isHouse = x >= houseX && x < houseX + 6 && y >= houseY && y < houseY + 3;
+            SDL_bool isBorder = x == 0 || y == 0 || x == width - 1 || y == height - 1;
+            SDL_bool isFloor = (x % 4 == 1 || y % 4 == 1) && !isBorder;
+            char c = '#';
+
+            if (isHouse || (y == portalY && (x == 0 || x == width - 1)))
+            {
+                c = ' ';
+            }
+            else if (isFloor)
+            {
+                c = x % 32 == 1 && y % 32 == 1 ? 'o' : '.';
+            }
+
+            fputc(c, tmp);
+        }
+
+        fputc('\n', tmp);
+    }
+
+    fclose(tmp);
+}
+
+uint32_t doCountDirections(const unsigned char mask)
+{
+    return (uint32_t)__builtin_popcount(mask);
+}
+
+SDL_bool doIsJunction(const unsigned char mask)
+{
+    // anything but a straight corridor is a junction, so corners and dead ends count too
+    return mask && mask != ((1 << north) | (1 << south)) && mask != ((1 << west) | (1 << east));
+}
+
+void doWritePackSection(FILE* file, packHeaderClass* header, const packSectionName section, const void* data, const size_t size)
+{
+    static const char padding[PACK_ALIGN] = { 0 };
+    long offset = ftell(file);
+
+    fwrite(padding, 1, (PACK_ALIGN - offset % PACK_ALIGN) % PACK_ALIGN, file);
+    header -> sections[section].offset = (uint64_t)ftell(file);
+    header -> sections[section].size = size;
+    header -> sections[section].checksum = doChecksum(data, size);
+    fwrite(data, 1, size, file);
+}
+
+void doCompileMaze(const char* path)
+{
+    // precompute the tables the game would otherwise rebuild at runtime and write them as one pack
+    long tiles = (long)maze.width * maze.height;
+    packHeaderClass header;
+    FILE *tmp = fopen(path, "wb");
+    unsigned char *flags = doAllocate(tiles, 1);
+    unsigned char *directions = doAllocate(tiles, 1);
+    uint32_t *walkable = doAllocate(tiles, sizeof(uint32_t));
+    uint32_t *junctionOf = doAllocate(tiles, sizeof(uint32_t));
+    uint32_t *junctions = doAllocate(tiles, sizeof(uint32_t));
+    uint32_t *queue = doAllocate(tiles, sizeof(uint32_t));
+    uint32_t *distance = doAllocate(tiles, sizeof(uint32_t));
+    junctionEdgeClass *edges = NULL;
+
+    if (!tmp)
+    {
+        fprintf(stderr, "Failed to write maze pack %s\n", path);
+        exit(5);
+    }
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, PACK_MAGIC, sizeof(PACK_MAGIC));
+    header.version = PACK_VERSION;
+    header.headerSize = sizeof(packHeaderClass);
+    header.width = maze.width;
+    header.height = maze.height;
+    header.playerX = maze.playerX;
+    header.playerY = maze.playerY;
+    header.houseX = maze.houseX;
+    header.houseY = maze.houseY;
+    header.houseW = maze.houseW;
+    header.houseH = maze.houseH;
+    header.portalCount = maze.portalCount;
+    header.foodTotal = maze.foodTotal;
+    memcpy(header.ghostSpawn, maze.ghostSpawn, sizeof(header.ghostSpawn));
+    memcpy(header.portal, maze.portal, sizeof(header.portal));
+
+    for (long i = 0; i < tiles; i++)
+    {
+        gridClass *cell = doGetTile(i % maze.width, i / maze.width);
+
+        flags[i] = (cell -> isWall ? TILE_WALL : 0) | (cell -> isPortal ? TILE_PORTAL : 0);
+        junctionOf[i] = NO_JUNCTION;
+
+        for (int n = 0; n < 4 && !cell -> isWall; n++)
+        {
+            directions[i] |= doIsWalkable(doGetNeighbour(cell, n)) ? 1 << n : 0;
+        }
+
+        if (!cell -> isWall)
+        {
+            walkable[header.walkableCount++] = (uint32_t)i;
+        }
+
+        if (!cell -> isWall && doIsJunction(directions[i]))
+        {
+            junctionOf[i] = header.junctionCount;
+            junctions[header.junctionCount++] = (uint32_t)i;
+        }
+    }
+
+    // every tile between junctions is a straight corridor, so each exit runs straight on to the next one
+    edges = doAllocate(header.junctionCount * 4 + 1, sizeof(junctionEdgeClass));
+
+    for (uint32_t j = 0; j < header.junctionCount; j++)
+    {
+        for (int n = 0; n < 4; n++)
+        {
+            junctionEdgeClass *edge = &edges[j * 4 + n];
+            gridClass *cell = doGetTile(junctions[j] % maze.width, junctions[j] / maze.width);
+
+            edge -> junction = NO_JUNCTION;
+
+            if (!(directions[junctions[j]] & (1 << n)))
+            {
+                continue;
+            }
+
+            for (uint32_t length = 1; length <= tiles; length++)
+            {
+                cell = doGetNeighbour(cell, n);
+
+                if (junctionOf[doGridIndex(cell)] != NO_JUNCTION)
+                {
+                    edge -> junction = junctionOf[doGridIndex(cell)];
+                    edge -> length = length;
+                    break;
+                }
+            }
+        }
+    }
+
+    // distance maps towards every fixed target: the house and each scatter corner
+    int targets[MAX_DISTANCE_MAPS][2] = { { maze.houseX + (maze.houseW - 1) / 2, maze.houseY + (maze.houseH - 1) / 2 } };
+    header.distanceCount = 1;
+
+    for (int g = 0; g < 4; g++)
+    {
+        for (int k = 2; k < 6; k += 2)
+        {
+            int d = 0;
+
+            while (d < (int)header.distanceCount && (targets[d][0] != maze.ghostSpawn[g][k] || targets[d][1] != maze.ghostSpawn[g][k + 1]))
+            {
+                d++;
+            }
+
+            if (d == (int)header.distanceCount)
+            {
+                targets[header.distanceCount][0] = maze.ghostSpawn[g][k];
+                targets[header.distanceCount++][1] = maze.ghostSpawn[g][k + 1];
+            }
+        }
+    }
+
+    memcpy(header.distanceTarget, targets, sizeof(header.distanceTarget));
+    fwrite(&header, 1, sizeof(header), tmp);
+    doWritePackSection(tmp, &header, packTiles, flags, tiles);
+    doWritePackSection(tmp, &header, packFoodSmall, maze.foodSmallInit, maze.foodWords * sizeof(uint64_t));
+    doWritePackSection(tmp, &header, packFoodLarge, maze.foodLargeInit, maze.foodWords * sizeof(uint64_t));
+    doWritePackSection(tmp, &header, packDirections, directions, tiles);
+    doWritePackSection(tmp, &header, packWalkable, walkable, header.walkableCount * sizeof(uint32_t));
+    doWritePackSection(tmp, &header, packJunctions, junctions, header.junctionCount * sizeof(uint32_t));
+    doWritePackSection(tmp, &header, packJunctionEdges, edges, header.junctionCount * 4 * sizeof(junctionEdgeClass));
+
+    for (uint32_t d = 0; d < header.distanceCount; d++)
+    {
+        // breadth first from the target; the maze is undirected, portals included
+        uint32_t head = 0, tail = 0;
+        long start = (long)targets[d][1] * maze.width + targets[d][0];
+
+        memset(distance, 0xff, tiles * sizeof(uint32_t));
+        distance[start] = 0;
+        queue[tail++] = (uint32_t)start;
+
+        while (head < tail)
+        {
+            uint32_t i = queue[head++];
+            gridClass *cell = doGetTile(i % maze.width, i / maze.width);
+
+            for (int n = 0; n < 4; n++)
+            {
+                gridClass *next = doGetNeighbour(cell, n);
+
+                if (doIsWalkable(next) && distance[doGridIndex(next)] == NO_DISTANCE)
+                {
+                    distance[doGridIndex(next)] = distance[i] + 1;
+                    queue[tail++] = (uint32_t)doGridIndex(next);
+                }
+            }
+        }
+
+        doWritePackSection(tmp, &header, packDistance + d, distance, tiles * sizeof(uint32_t));
+    }
+
+    printf("%s: %dx%d tiles, %u walkable, %u junctions, %u distance maps, %ld bytes\n", path, maze.width, maze.height, header.walkableCount, header.junctionCount, header.distanceCount, ftell(tmp));
+
+    header.checksum = doChecksum(&header, offsetof(packHeaderClass, checksum));
+    fseek(tmp, 0, SEEK_SET);
+    fwrite(&header, 1, sizeof(header), tmp);
+
+    if (fclose(tmp))
+    {
+        fprintf(stderr, "Failed to write maze pack %s\n", path);
+        exit(5);
+    }
+
+    free(flags);
+    free(directions);
+    free(walkable);
+    free(junctionOf);
+    free(junctions);
+    free(queue);
+    free(distance);
+    free(edges);
+}
+
+// RENDER ROUTINES
+
+// every sprite sheet is packed into one atlas texture; while a batch is open sprites are queued
+// as quads and submitted together with one SDL_RenderGeometry
+typedef struct {
+    SDL_Texture *texture;
+    int width, height;
+    SDL_Rect sheets[sheets];
+    SDL_Vertex *vertices;
+    int *indices;
+    int quads, capacity;
+    SDL_bool isBatching, isOpen;
+} spriteAtlasClass;
+
+spriteAtlasClass spriteAtlas = { .isBatching = SDL_TRUE };
+
+// frames can also be drawn on the CPU into an RGBA32 buffer, with no display or GPU; sprites are
+// sampled at pixel centres and blended with the same integer arithmetic as SDL's software blitter
+typedef struct {
+    uint32_t *pixels; // NULL while drawing through SDL
+    int width, height;
+    const uint32_t *atlas;
+    int atlasPitch; // in pixels
+    SDL_Surface *atlasSurface;
+    uint32_t color, *row;
+    SDL_bool isOffscreen; // blinking follows timeMs instead of the wall clock
+    unsigned int timeMs;
+} canvasClass;
+
+canvasClass canvas = { 0 };
+
+uint32_t doPackColor(const Uint8 r, const Uint8 g, const Uint8 b, const Uint8 a)
+{
+    Uint8 bytes[4] = { r, g, b, a };
+    uint32_t color;
+
+    memcpy(&color, bytes, sizeof(color));
+    return color;
+}
+
+void doBlendRow(uint32_t* dst, const uint32_t* src, const int count)
+{
+    // dst = (src * a + dst * (255 - a)) / 255 per channel, alpha blends 255 over dst alpha;
+    // x / 255 is taken as (x + 1 + ((x + 1) >> 8)) >> 8, exact for every x that can occur
+    int i = 0;
+
+#if defined(__AVX2__)
+    const __m256i zero = _mm256_setzero_si256(), one = _mm256_set1_epi16(1), full = _mm256_set1_epi16(255);
+    const __m256i opaque = _mm256_set_epi16(255, 0, 0, 0, 255, 0, 0, 0, 255, 0, 0, 0, 255, 0, 0, 0);
+
+    for (; i + 8 <= count; i += 8)
+    {
+        __m256i s = _mm256_loadu_si256((const __m256i*)(src + i)), d = _mm256_loadu_si256((const __m256i*)(dst + i));
+        __m256i halves[2];
+
+        for (int h = 0; h < 2; h++)
+        {
+            __m256i sw = h ? _mm256_unpackhi_epi8(s, zero) : _mm256_unpacklo_epi8(s, zero);
+            __m256i dw = h ? _mm256_unpackhi_epi8(d, zero) : _mm256_unpacklo_epi8(d, zero);
+            __m256i a = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(sw, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+            __m256i x = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_or_si256(sw, opaque), a), _mm256_mullo_epi16(dw, _mm256_sub_epi16(full, a)));
+
+            x = _mm256_add_epi16(x, one);
+            halves[h] = _mm256_srli_epi16(_mm256_add_epi16(x, _mm256_srli_epi16(x, 8)), 8);
+        }
+
+        _mm256_storeu_si256((__m256i*)(dst + i), _mm256_packus_epi16(halves[0], halves[1]));
+    }
+#elif defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128(), one = _mm_set1_epi16(1), full = _mm_set1_epi16(255);
+    const __m128i opaque = _mm_set_epi16(255, 0, 0, 0, 255, 0, 0, 0);
+
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128i s = _mm_loadu_si128((const __m128i*)(src + i)), d = _mm_loadu_si128((const __m128i*)(dst + i));
+        __m128i halves[2];
+
+        for (int h = 0; h < 2; h++)
+        {
+            __m128i sw = h ? _mm_unpackhi_epi8(s, zero) : _mm_unpacklo_epi8(s, zero);
+            __m128i dw = h ? _mm_unpackhi_epi8(d, zero) : _mm_unpacklo_epi8(d, zero);
+            __m128i a = _mm_shufflehi_epi16(_mm_shufflelo_epi16(sw, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+            __m128i x = _mm_add_epi16(_mm_mullo_epi16(_mm_or_si128(sw, opaque), a), _mm_mullo_epi16(dw, _mm_sub_epi16(full, a)));
+
+            x = _mm_add_epi16(x, one);
+            halves[h] = _mm_srli_epi16(_mm_add_epi16(x, _mm_srli_epi16(x, 8)), 8);
+        }
+
+        _mm_storeu_si128((__m128i*)(dst + i), _mm_packus_epi16(halves[0], halves[1]));
+    }
+#endif
+
+    for (; i < count; i++)
+    {
+        Uint8 s[4], d[4];
+
+        memcpy(s, src + i, 4);
+        memcpy(d, dst + i, 4);
+
+        for (int c = 0; c < 4; c++)
+        {
+            Uint16 x = (Uint16)((c == 3 ? 255 : s[c]) * s[3] + d[c] * (255 - s[3]) + 1);
+
+            x += x >> 8;
+            d[c] = (Uint8)(x >> 8);
+        }
+
+        memcpy(dst + i, d, 4);
+    }
+}
+
+void doCanvasBlit(const SDL_Rect* source, const SDL_Rect* target)
+{
+    // nearest neighbour when the sprite is scaled, rows are gathered first and blended in one pass
+    int x0 = SDL_max(0, target -> x), x1 = SDL_min(canvas.width, target -> x + target -> w);
+    int y0 = SDL_max(0, target -> y), y1 = SDL_min(canvas.height, target -> y + target -> h);
+    uint32_t incX, incY;
+
+    if (x0 >= x1 || y0 >= y1)
+    {
+        return;
+    }
+
+    incX = ((uint32_t)source -> w << 16) / (uint32_t)target -> w;
+    incY = ((uint32_t)source -> h << 16) / (uint32_t)target -> h;
+
+    for (int y = y0; y < y1; y++)
+    {
+        const uint32_t *row = canvas.atlas + (size_t)(source -> y + (int)(((uint32_t)(y - target -> y) * incY + incY / 2) >> 16)) * canvas.atlasPitch + source -> x;
+        const uint32_t *src = row + (x0 - target -> x);
+
+        if (source -> w != target -> w)
+        {
+            for (int x = x0; x < x1; x++)
+            {
+                canvas.row[x - x0] = row[((uint32_t)(x - target -> x) * incX + incX / 2) >> 16];
+            }
+
+            src = canvas.row;
+        }
+
+        doBlendRow(canvas.pixels + (size_t)y * canvas.width + x0, src, x1 - x0);
+    }
+}
+
+void doCanvasFill(const SDL_Rect* rect)
+{
+    int x0 = SDL_max(0, rect -> x), x1 = SDL_min(canvas.width, rect -> x + rect -> w);
+    int y0 = SDL_max(0, rect -> y), y1 = SDL_min(canvas.height, rect -> y + rect -> h);
+
+    for (int y = y0; y < y1; y++)
+    {
+        uint32_t *row = canvas.pixels + (size_t)y * canvas.width;
+
+        for (int x = x0; x < x1; x++)
+        {
+            row[x] = canvas.color;
+        }
+    }
+}
+
+// the draw calls below go to the canvas when there is one, to SDL otherwise
+void doSetDrawColor(SDL_Renderer* renderer, const Uint8 r, const Uint8 g, const Uint8 b, const Uint8 a)
+{
+    canvas.pixels ? (void)(canvas.color = doPackColor(r, g, b, a)) : (void)SDL_SetRenderDrawColor(renderer, r, g, b, a);
+}
+
+void doFillRects(SDL_Renderer* renderer, const SDL_Rect* rects, const int count)
+{
+    if (!canvas.pixels)
+    {
+        SDL_RenderFillRects(renderer, rects, count);
+        drawCalls++;
+        return;
+    }
+
+    for (int i = 0; i < count; i++)
+    {
+        doCanvasFill(&rects[i]);
+    }
+}
+
+void doDrawOutline(SDL_Renderer* renderer, const SDL_Rect* rect)
+{
+    SDL_Rect sides[4] = {
+        { rect -> x, rect -> y, rect -> w, 1 },
+        { rect -> x, rect -> y + rect -> h - 1, rect -> w, 1 },
+        { rect -> x, rect -> y, 1, rect -> h },
+        { rect -> x + rect -> w - 1, rect -> y, 1, rect -> h }
+    };
+
+    canvas.pixels ? doFillRects(renderer, sides, 4) : (void)SDL_RenderDrawRect(renderer, rect);
+}
+
+SDL_bool doBlink(void)
+{
+    return (canvas.isOffscreen ? canvas.timeMs : SDL_GetTicks()) / 100 % 2;
+}
+
+void doDrawSprite(SDL_Renderer* renderer, const sheetName sheet, const SDL_Rect* crop, const SDL_Rect* position)
+{
+    // crops are relative to their own sheet, as they were when every sheet was a texture of its own
+    SDL_Rect source = spriteAtlas.sheets[sheet];
+    SDL_Vertex *quad;
+    int *index;
+
+    if (crop)
+    {
+        source = (SDL_Rect){ source.x + crop -> x, source.y + crop -> y, crop -> w, crop -> h };
+    }
+
+    if (canvas.pixels)
+    {
+        doCanvasBlit(&source, position);
+        return;
+    }
+
+    if (!spriteAtlas.isOpen)
+    {
+        SDL_RenderCopy(renderer, spriteAtlas.texture, &source, position);
+        drawCalls++;
+        return;
+    }
+
+    if (spriteAtlas.quads == spriteAtlas.capacity)
+    {
+        spriteAtlas.capacity = spriteAtlas.capacity ? spriteAtlas.capacity * 2 : 256;
+        spriteAtlas.vertices = realloc(spriteAtlas.vertices, spriteAtlas.capacity * 4 * sizeof(SDL_Vertex));
+        spriteAtlas.indices = realloc(spriteAtlas.indices, spriteAtlas.capacity * 6 * sizeof(int));
+
+        if (!spriteAtlas.vertices || !spriteAtlas.indices)
+        {
+            fprintf(stderr, "Failed to allocate %d sprite quads\n", spriteAtlas.capacity);
+            exit(4);
+        }
+    }
+
+    float u0 = (float)source.x / spriteAtlas.width, v0 = (float)source.y / spriteAtlas.height;
+    float u1 = (float)(source.x + source.w) / spriteAtlas.width, v1 = (float)(source.y + source.h) / spriteAtlas.height;
+    float x0 = (float)position -> x, y0 = (float)position -> y, x1 = x0 + position -> w, y1 = y0 + position -> h;
+    int base = spriteAtlas.quads * 4;
+
+    quad = &spriteAtlas.vertices[base];
+    quad[0] = (SDL_Vertex){ { x0, y0 }, { 255, 255, 255, 255 }, { u0, v0 } };
+    quad[1] = (SDL_Vertex){ { x1, y0 }, { 255, 255, 255, 255 }, { u1, v0 } };
+    quad[2] = (SDL_Vertex){ { x1, y1 }, { 255, 255, 255, 255 }, { u1, v1 } };
+    quad[3] = (SDL_Vertex){ { x0, y1 }, { 255, 255, 255, 255 }, { u0, v1 } };
+
+    index = &spriteAtlas.indices[spriteAtlas.quads * 6];
+    index[0] = base;
+    index[1] = base + 1;
+    index[2] = base + 2;
+    index[3] = base;
+    index[4] = base + 2;
+    index[5] = base + 3;
+
+    spriteAtlas.quads++;
+}
+
+void doOpenBatch(void)
+{
+    spriteAtlas.isOpen = spriteAtlas.isBatching;
+    spriteAtlas.quads = 0;
+}
+
+void doFlushBatch(SDL_Renderer* renderer)
+{
+    if (spriteAtlas.isOpen && spriteAtlas.quads)
+    {
+        SDL_RenderGeometry(renderer, spriteAtlas.texture, spriteAtlas.vertices, spriteAtlas.quads * 4, spriteAtlas.indices, spriteAtlas.quads * 6);
+        drawCalls++;
+    }
+
+    spriteAtlas.isOpen = SDL_FALSE;
+    spriteAtlas.quads = 0;
+}
+
+void doRefreshScreen(SDL_Renderer* renderer)
+{
+    SDL_Rect screen = { 0, 0, SCREEN_WIDTH, SCREEN_HEIGHT };
+
+    doSetDrawColor(renderer, 0, 0, 0, 0);
+    canvas.pixels ? doCanvasFill(&screen) : (void)SDL_RenderClear(renderer);
+}
+
+float doInterpolate(const float previous, const float current)
+{
+    // a jump of more than a tile is a teleport or a respawn and is not smoothed over
+    return fabsf(current - previous) > SIZE_TILE ? current : previous + (current - previous) * renderAlpha;
+}
+
+void doUpdateCamera(const playerClass* player)
+{
+    // a maze that fits the view stays centred, a larger one scrolls with the player
+    int mazeW = maze.width * SIZE_TILE, mazeH = maze.height * SIZE_TILE;
+
+    if (mazeW <= SCREEN_WIDTH + SIZE_TILE * 2)
+    {
+        cameraX = (mazeW - SCREEN_WIDTH) / 2;
+    }
+    else
+    {
+        cameraX = SDL_max(0, SDL_min((int)doInterpolate(player -> prevX, player -> posX) - SCREEN_WIDTH / 2, mazeW - SCREEN_WIDTH));
+    }
+
+    if (mazeH <= VIEW_HEIGHT + SIZE_TILE * 2)
+    {
+        cameraY = (mazeH - VIEW_HEIGHT) / 2;
+    }
+    else
+    {
+        cameraY = SDL_max(0, SDL_min((int)doInterpolate(player -> prevY, player -> posY) - VIEW_HEIGHT / 2, mazeH - VIEW_HEIGHT));
+    }
+}
+
+// maze and pellets are kept pre-rendered in one texture, in maze pixels shifted by LAYER_PAD;
+// eaten pellets are erased from it tile by tile and a refill rebuilds it
+typedef struct {
+    SDL_Texture *texture;
+    int width, height;
+    uint64_t *foodSmall, *foodLarge; // the pellets the texture shows
+    SDL_bool isValid, isUnsupported;
+} mazeLayerClass;
+
+mazeLayerClass mazeLayer = { 0 };
+
+void doDrawWalls(SDL_Renderer* renderer, const SDL_Rect* area, const int originX, const int originY)
+{
+    // mazes loaded from files have no artwork, their walls are drawn tile by tile
+    int x0 = SDL_max(0, area -> x / SIZE_TILE - 1), x1 = SDL_min(maze.width, (area -> x + area -> w) / SIZE_TILE + 1);
+    int y0 = SDL_max(0, area -> y / SIZE_TILE - 1), y1 = SDL_min(maze.height, (area -> y + area -> h) / SIZE_TILE + 1);
+    SDL_Rect walls[256];
+    int count = 0;
+
+    doSetDrawColor(renderer, 33, 33, 222, 255);
+
+    // walls are filled in groups rather than one call each
+    for (int y = y0; y < y1; y++)
+    {
+        for (int x = x0; x < x1; x++)
+        {
+            if (doGetTile(x, y) -> isWall)
+            {
+                walls[count++] = (SDL_Rect){ x * SIZE_TILE - originX + SIZE_TILE / 4, y * SIZE_TILE - originY + SIZE_TILE / 4, SIZE_TILE, SIZE_TILE };
+            }
+
+            if (count == 256 || (count && y == y1 - 1 && x == x1 - 1))
+            {
+                doFillRects(renderer, walls, count);
+                count = 0;
+            }
+        }
+    }
+}
+
+void doDrawMaze(SDL_Renderer* renderer, const SDL_Rect* area, const int originX, const int originY)
+{
+    // the artwork covers the arcade board less its outer tile, the same margin doUpdateCamera centres away
+    SDL_Rect mazeArea = { (maze.width * SIZE_TILE - SCREEN_WIDTH) / 2 - originX, (maze.height * SIZE_TILE - VIEW_HEIGHT) / 2 - originY, SCREEN_WIDTH, VIEW_HEIGHT };
+
+    maze.isBuiltIn ? doDrawSprite(renderer, sheetMaze, NULL, &mazeArea) : doDrawWalls(renderer, area, originX, originY);
+}
+
+void doDrawBackground(SDL_Renderer* renderer, const gameClass* game)
+{
+    SDL_Rect mazeArea = { 0, 0, SCREEN_WIDTH, VIEW_HEIGHT };
+    SDL_Rect view = { cameraX, cameraY, SCREEN_WIDTH, VIEW_HEIGHT };
+
+    if (doBallsLeft(game) > 0 || doBlink())
+    {
+        doDrawMaze(renderer, &view, cameraX, cameraY);
+    }
+    else
+    {
+        doDrawOutline(renderer, &mazeArea);
+    }
+}
+
+void doDrawFoodMask(SDL_Renderer* renderer, const uint64_t* mask, const SDL_Rect* area, const int originX, const int originY, const SDL_Rect* foodTextureCrop)
+{
+    int x0 = SDL_max(0, area -> x / SIZE_TILE - 1), x1 = SDL_min(maze.width, (area -> x + area -> w) / SIZE_TILE + 1);
+    int y0 = SDL_max(0, area -> y / SIZE_TILE - 1), y1 = SDL_min(maze.height, (area -> y + area -> h) / SIZE_TILE + 1);
+
+    // walk set bits of the requested span of each row only, lowest first
+    for (int y = y0; y < y1 && x0 < x1; y++)
+    {
+        long first = (long)y * maze.width + x0, last = (long)y * maze.width + x1 - 1;
+
+        for (long w = first / 64; w <= last / 64; w++)
+        {
+            uint64_t bits = mask[w];
+
+            if (w == first / 64) bits &= ~0ULL << (first % 64);
+            if (w == last / 64) bits &= ~0ULL >> (63 - last % 64);
+
+            while (bits)
+            {
+                long i = w * 64 + __builtin_ctzll(bits);
+                SDL_Rect foodTexturePosition = { (int)( i % maze.width * SIZE_TILE - originX - SIZE_TILE * 0.25f ), (int)( y * SIZE_TILE - originY - SIZE_TILE * 0.25f ), 32, 32 };
+                
+                doDrawSprite(renderer, sheetFood, foodTextureCrop, &foodTexturePosition);
+                bits &= bits - 1;
+            }
+        }
+    }
+}
+
+void doDrawFoodArea(SDL_Renderer* renderer, const uint64_t* foodSmall, const uint64_t* foodLarge, const SDL_Rect* area, const int originX, const int originY)
+{
+    SDL_Rect smallBallCrop = { 32, 0, 32, 32 };
+    SDL_Rect largeBallCrop = { 0, 0, 32, 32 };
+
+    doDrawFoodMask(renderer, foodSmall, area, originX, originY, &smallBallCrop);
+    doDrawFoodMask(renderer, foodLarge, area, originX, originY, &largeBallCrop);
+}
+
+void doDrawFood(SDL_Renderer* renderer, const gameClass* game)
+{
+    SDL_Rect view = { cameraX, cameraY, SCREEN_WIDTH, VIEW_HEIGHT };
+
+    doDrawFoodArea(renderer, game -> foodSmall, game -> foodLarge, &view, cameraX, cameraY);
+}
+
+void doRenderLayerArea(SDL_Renderer* renderer, const SDL_Rect* area)
+{
+    // area is in maze pixels; everything under it is drawn again from scratch
+    SDL_Rect clip = { area -> x + LAYER_PAD, area -> y + LAYER_PAD, area -> w, area -> h };
+
+    SDL_RenderSetClipRect(renderer, &clip);
+    SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
+    SDL_RenderFillRect(renderer, &clip);
+    doDrawMaze(renderer, area, -LAYER_PAD, -LAYER_PAD);
+    doDrawFoodArea(renderer, mazeLayer.foodSmall, mazeLayer.foodLarge, area, -LAYER_PAD, -LAYER_PAD);
+}
+
+SDL_bool doUpdateMazeLayer(SDL_Renderer* renderer, const gameClass* game)
+{
+    size_t bytes = maze.foodWords * sizeof(uint64_t);
+    SDL_bool isRefilled = !mazeLayer.isValid;
+
+    if (mazeLayer.isUnsupported || canvas.pixels)
+    {
+        return SDL_FALSE;
+    }
+
+    if (!mazeLayer.texture)
+    {
+        mazeLayer.width = maze.width * SIZE_TILE + 2 * LAYER_PAD;
+        mazeLayer.height = maze.height * SIZE_TILE + 2 * LAYER_PAD;
+
+        // mazes too large for one texture keep drawing pellets one by one
+        if (mazeLayer.width > LAYER_MAX || mazeLayer.height > LAYER_MAX || !(mazeLayer.texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_TARGET, mazeLayer.width, mazeLayer.height)))
+        {
+            mazeLayer.isUnsupported = SDL_TRUE;
+            return SDL_FALSE;
+        }
+
+        SDL_SetTextureBlendMode(mazeLayer.texture, SDL_BLENDMODE_NONE);
+        mazeLayer.foodSmall = doAllocate(maze.foodWords, sizeof(uint64_t));
+        mazeLayer.foodLarge = doAllocate(maze.foodWords, sizeof(uint64_t));
+        isRefilled = SDL_TRUE;
+    }
+
+    for (int w = 0; w < maze.foodWords && !isRefilled; w++)
+    {
+        isRefilled = (game -> foodSmall[w] & ~mazeLayer.foodSmall[w]) || (game -> foodLarge[w] & ~mazeLayer.foodLarge[w]);
+    }
+
+    if (!isRefilled && !memcmp(mazeLayer.foodSmall, game -> foodSmall, bytes) && !memcmp(mazeLayer.foodLarge, game -> foodLarge, bytes))
+    {
+        return SDL_TRUE;
+    }
+
+    SDL_SetRenderTarget(renderer, mazeLayer.texture);
+
+    if (isRefilled)
+    {
+        SDL_Rect whole = { -LAYER_PAD, -LAYER_PAD, mazeLayer.width, mazeLayer.height };
+
+        memcpy(mazeLayer.foodSmall, game -> foodSmall, bytes);
+        memcpy(mazeLayer.foodLarge, game -> foodLarge, bytes);
+        doRenderLayerArea(renderer, &whole);
+    }
+    else
+    {
+        // only pellets ever go, and each takes its sprite's square plus whatever neighbours overlap it
+        for (int w = 0; w < maze.foodWords; w++)
+        {
+            uint64_t eaten = (mazeLayer.foodSmall[w] & ~game -> foodSmall[w]) | (mazeLayer.foodLarge[w] & ~game -> foodLarge[w]);
+
+            mazeLayer.foodSmall[w] = game -> foodSmall[w];
+            mazeLayer.foodLarge[w] = game -> foodLarge[w];
+
+            while (eaten)
+            {
+                long i = (long)w * 64 + __builtin_ctzll(eaten);
+                SDL_Rect tile = { (int)(i % maze.width) * SIZE_TILE - SIZE_TILE / 4, (int)(i / maze.width) * SIZE_TILE - SIZE_TILE / 4, 32, 32 };
+
+                doRenderLayerArea(renderer, &tile);
+                eaten &= eaten - 1;
+            }
+        }
+    }
+
+    SDL_RenderSetClipRect(renderer, NULL);
+    SDL_SetRenderTarget(renderer, NULL);
+    mazeLayer.isValid = SDL_TRUE;
+    return SDL_TRUE;
+}
+
+SDL_bool doDrawMazeLayer(SDL_Renderer* renderer, const gameClass* game)
+{
+    // one copy of the visible part of the layer, clipped by hand so nothing is stretched
+    SDL_Rect source = { cameraX + LAYER_PAD, cameraY + LAYER_PAD, SCREEN_WIDTH, VIEW_HEIGHT }, target = { 0, 0, SCREEN_WIDTH, VIEW_HEIGHT };
+    int left = SDL_max(0, -source.x), top = SDL_max(0, -source.y);
+
+    if (!doUpdateMazeLayer(renderer, game))
+    {
+        return SDL_FALSE;
+    }
+
+    if (doBallsLeft(game) == 0 && !doBlink())
+    {
+        SDL_RenderDrawRect(renderer, &target);
+        return SDL_TRUE;
+    }
+
+    source.x += left;
+    target.x += left;
+    source.y += top;
+    target.y += top;
+    source.w = target.w = SDL_min(SCREEN_WIDTH - left, mazeLayer.width - source.x);
+    source.h = target.h = SDL_min(VIEW_HEIGHT - top, mazeLayer.height - source.y);
+
+    if (source.w > 0 && source.h > 0)
+    {
+        SDL_RenderCopy(renderer, mazeLayer.texture, &source, &target);
+        drawCalls++;
+    }
+
+    return SDL_TRUE;
+}
+
+void doFreeMazeLayer(void)
+{
+    if (mazeLayer.texture)
+    {
+        SDL_DestroyTexture(mazeLayer.texture);
+    }
+
+    free(mazeLayer.foodSmall);
+    free(mazeLayer.foodLarge);
+    memset(&mazeLayer, 0, sizeof(mazeLayerClass));
+}
+
+SDL_Rect doGetPacmanCrop(const playerClass* player, const unsigned int tick)
+{
+    // sprites are picked from the state alone, so any copy of it draws the same frame
+    SDL_Rect crop = { (int)(tick / 6 % 4) * 32, 0, 32, 32 };
+
+    switch (player -> curHeading)
+    {
+        case up: 
+            crop.y = 96; 
+        break;
+        
+        case down: 
+            crop.y = 32; 
+        break;
+        
+        case left: 
+            crop.y = 64; 
+        break;
+        
+        case right: case idle: 
+            crop.y = 0; 
+        break;
+    }
+
+    return crop;
+}
+
+void doDrawPacman(SDL_Renderer* renderer, const gameClass* game, const playerClass* player)
+{
+    SDL_Rect pacmanTexturePosition = { (int)( doInterpolate(player -> prevX, player -> posX) - cameraX - SIZE_TILE * 0.25f ), (int)( doInterpolate(player -> prevY, player -> posY) - cameraY - SIZE_TILE * 0.25f ), 32, 32 }; 
+    SDL_Rect pacmanTextureCrop = doGetPacmanCrop(player, game -> tick);
+
+    doDrawSprite(renderer, sheetPacman, &pacmanTextureCrop, &pacmanTexturePosition);
+}
+
+void doDrawGhosts(SDL_Renderer* renderer, const playerClass* player, const enemyClass* enemy)
+{
+    for (int i = 0; i < enemy -> count; i++)
+    {
+        SDL_Rect ghostTextureCrop = { 0, 0, 32, 32 }, *crop = &ghostTextureCrop;
+        SDL_Rect ghostTexturePosition = { (int)( doInterpolate(enemy -> prevX[i], enemy -> posX[i]) - cameraX - SIZE_TILE * 0.25f ), (int)( doInterpolate(enemy -> prevY[i], enemy -> posY[i]) - cameraY - SIZE_TILE * 0.25f ), 32, 32 };
+
+        if (ghostTexturePosition.x < -32 || ghostTexturePosition.y < -32 || ghostTexturePosition.x > SCREEN_WIDTH || ghostTexturePosition.y > VIEW_HEIGHT)
+        {
+            continue;
+        }
+
+        switch (enemy -> state[i])
+        {
+            case home: case scatter: case chase:
+                crop -> y = 32 * enemy -> behaviour[i];
+            break;
+        
+            case eaten:
+                crop -> y = 128;
+            break;
+
+            case frightened:
+                crop -> y = 160;
+
+                if (enemy -> isTimeAlmostEnd[i] && doBlink())
+                {
+                    crop -> x = 64;
+                }
+                else 
+                {
+                    crop -> x = 0; 
+                }
+            break;
+        }
+
+        if (enemy -> state[i] != frightened)
+        {
+            switch (enemy -> heading[i])
+            {   
+                case up: 
+                    crop -> x = 192; 
+                break;
+                
+                case down: 
+                    crop -> x = 64; 
+                break;
+                
+                case left: 
+                    crop -> x = 128; 
+                break;
+                
+                case right: case idle: 
+                    crop -> x = 0; 
+                break;
+            }
+        }
+
+        if (enemy -> state[i] != eaten && player -> curHeading != idle) 
+        {
+            if (doBlink())
+            {
+                crop -> x += 32;
+            }
+        }
+
+        doDrawSprite(renderer, sheetGhost, crop, &ghostTexturePosition);
+    }
+}
+
+void doDrawPacmanKill(SDL_Renderer* renderer, const gameClass* game, const playerClass* player)
+{
+    if ( (game -> timeDelay - game -> tick) > 2 * TICK_RATE)
+    {
+        // frozen on one frame until the kill animation starts
+        SDL_Rect pacmanTexturePosition = { (int)( player -> posX - cameraX - SIZE_TILE * 0.25f ), (int)( player -> posY - cameraY - SIZE_TILE * 0.25f ), 32, 32 }; 
+        SDL_Rect pacmanTextureCrop = doGetPacmanCrop(player, game -> timeDelay);
+        doDrawSprite(renderer, sheetPacman, &pacmanTextureCrop, &pacmanTexturePosition);
+    } 
+    else
+    {
+        SDL_Rect killTexturePosition = { (int)( player -> posX - cameraX - SIZE_TILE * 0.25f ), (int)( player -> posY - cameraY - SIZE_TILE * 0.25f ), 32, 32 };
+        SDL_Rect killTextureCrop = { (int)(2 * TICK_RATE - (game -> timeDelay - game -> tick)) / 6 * 32, 0, 32, 32 };
+
+        doDrawSprite(renderer, sheetKill, &killTextureCrop, &killTexturePosition);
+    }
+}  
+
+void doDrawLives(SDL_Renderer* renderer, const gameClass* game, const int top)
+{
+    for (int i = 0, m = 0; i < game -> playerLives; i++, m += SIZE_TILE + SIZE_TILE / 4)
+    {
+        SDL_Rect livesTextureCrop = { 32, 0, 32, 32 }; 
+        SDL_Rect livesTexturePosition = { (int)( SIZE_TILE * 1.5f + m ), top + SIZE_TILE / 2, SIZE_TILE, SIZE_TILE };
+        doDrawSprite(renderer, sheetPacman, &livesTextureCrop, &livesTexturePosition);
+    }
+}
+
+void doDrawNumber(SDL_Renderer* renderer, unsigned int value, const int right, const int top, const int row)
+{
+    // digits go right to left from the given edge, and a zero still shows one
+    int offsetX = right;
+
+    do
+    {
+        SDL_Rect numbersTextureCrop = { (int)(value % 10) * 12, row, 12, 20 };
+        SDL_Rect numbersTexturePosition = { offsetX, top + SIZE_TILE / 2, 12, 20 };
+        doDrawSprite(renderer, sheetNumbers, &numbersTextureCrop, &numbersTexturePosition);
+        offsetX -= 12;
+        value /= 10;
+    }
+    while (value);
+}
+
+void doDrawScore(SDL_Renderer* renderer, const gameClass* game, const int top)
+{ 
+    doDrawNumber(renderer, game -> currentScore, SIZE_TILE * 9 + 120, top, 0);
+    doDrawNumber(renderer, game -> highestScore, SIZE_TILE * 20 + 120, top, 20);
+}
+
+// the strip under the maze is kept in its own texture and redrawn only when what it shows changes
+typedef struct {
+    SDL_Texture *texture;
+    unsigned int score, highScore;
+    unsigned short lives;
+    SDL_bool isValid, isUnsupported;
+} hudClass;
+
+hudClass hud = { 0 };
+
+void doDrawHud(SDL_Renderer* renderer, const gameClass* game)
+{
+    SDL_Rect strip = { 0, VIEW_HEIGHT, SCREEN_WIDTH, SCREEN_HEIGHT - VIEW_HEIGHT };
+
+    if (!hud.texture && !hud.isUnsupported && !(hud.texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_TARGET, strip.w, strip.h)))
+    {
+        hud.isUnsupported = SDL_TRUE;
+    }
+
+    if (hud.isUnsupported || canvas.pixels)
+    {
+        doDrawLives(renderer, game, VIEW_HEIGHT);
+        doDrawScore(renderer, game, VIEW_HEIGHT);
+        return;
+    }
+
+    if (!hud.isValid || hud.score != game -> currentScore || hud.highScore != game -> highestScore || hud.lives != game -> playerLives)
+    {
+        SDL_SetRenderTarget(renderer, hud.texture);
+        SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
+        SDL_RenderClear(renderer);
+        doDrawLives(renderer, game, 0);
+        doDrawScore(renderer, game, 0);
+        SDL_SetRenderTarget(renderer, NULL);
+
+        hud.score = game -> currentScore;
+        hud.highScore = game -> highestScore;
+        hud.lives = game -> playerLives;
+        hud.isValid = SDL_TRUE;
+    }
+
+    SDL_RenderCopy(renderer, hud.texture, NULL, &strip);
+    drawCalls++;
+}
+
+void doFreeHud(void)
+{
+    if (hud.texture)
+    {
+        SDL_DestroyTexture(hud.texture);
+    }
+
+    memset(&hud, 0, sizeof(hudClass));
+}
+
+void doDrawPathCells(SDL_Renderer* renderer, const long* cells, const int count, const int size)
+{
+    // a square of the given size in the middle of each tile, where a ghost sprite's centre would be
+    SDL_Rect marks[256];
+    int n = 0;
+
+    for (int c = 0; c < count; c++)
+    {
+        int x = (int)(cells[c] % maze.width) * SIZE_TILE - cameraX + 16 - SIZE_TILE / 4, y = (int)(cells[c] / maze.width) * SIZE_TILE - cameraY + 16 - SIZE_TILE / 4;
+
+        if (x < -size || y < -size || x > SCREEN_WIDTH + size || y > VIEW_HEIGHT + size)
+        {
+            continue;
+        }
+
+        marks[n++] = (SDL_Rect){ x - size / 2, y - size / 2, size, size };
+
+        if (n == 256)
+        {
+            doFillRects(renderer, marks, n);
+            n = 0;
+        }
+    }
+
+    if (n)
+    {
+        doFillRects(renderer, marks, n);
+    }
+}
+
+void doDrawPathOverlay(SDL_Renderer* renderer)
+{
+    // each ghost's last search: small marks for expanded tiles, larger ones along the path, a frame on the target
+    const Uint8 colors[4][3] = { { 255, 0, 0 }, { 255, 184, 255 }, { 0, 255, 255 }, { 255, 184, 82 } };
+
+    if (!pathStatsTable.isTracing || !pathStatsTable.traces)
+    {
+        return;
+    }
+
+    SDL_LockMutex(pathStatsTable.lock);
+
+    for (int g = 0; g < pathStatsTable.ghosts; g++)
+    {
+        const pathTraceClass *trace = &pathStatsTable.traces[g];
+        const Uint8 *color = colors[g % 4];
+        SDL_Rect target = { (int)(trace -> target % maze.width) * SIZE_TILE - cameraX + 6 - SIZE_TILE / 4, (int)(trace -> target / maze.width) * SIZE_TILE - cameraY + 6 - SIZE_TILE / 4, SIZE_TILE, SIZE_TILE };
+
+        if (!trace -> expanded)
+        {
+            continue;
+        }
+
+        doSetDrawColor(renderer, color[0] / 2, color[1] / 2, color[2] / 2, 255);
+        doDrawPathCells(renderer, trace -> expanded, trace -> expandedCount, 4);
+        doSetDrawColor(renderer, color[0], color[1], color[2], 255);
+        doDrawPathCells(renderer, trace -> path, trace -> pathCount, 8);
+        doDrawOutline(renderer, &target);
+    }
+
+    SDL_UnlockMutex(pathStatsTable.lock);
+}
+
+void doDrawTextReady(SDL_Renderer* renderer)
+{
+    gridClass *tmp = doGetTile(maze.houseX, maze.houseY + maze.houseH + 1);
+    SDL_Rect ready = { (int)( tmp -> gridX - cameraX + 10 ), (int)( tmp -> gridY - cameraY - 3 ), 100, 25 };
+    doDrawSprite(renderer, sheetReady, NULL, &ready);
+}
+
+void doDrawTextGameOver(SDL_Renderer* renderer)
+{
+    gridClass *tmp = doGetTile(maze.houseX - 1, maze.houseY + maze.houseH - 1);
+    SDL_Rect gameOver = { (int)( tmp -> gridX - cameraX + 6 ), (int)( tmp -> gridY - cameraY - 3 ), 150, 25 };
+    doDrawSprite(renderer, sheetGameOver, NULL, &gameOver);
+}
+
+// SDL2 INIT
+
+void doInitEngine(SDL_Window** window, SDL_Renderer** renderer)
+{
+    if (SDL_Init(SDL_INIT_VIDEO)) 
+    {
+        fprintf(stderr, "Failed to initialize SDL2 library: %s\n", SDL_GetError());
+        exit(1);
+    }
+    
+    *window = SDL_CreateWindow(WINDOW_TITLE, SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, SCREEN_WIDTH, SCREEN_HEIGHT, 0);
+    if (!*window) 
+    {
+        fprintf(stderr, "Failed to create window: %s\n", SDL_GetError());
+        exit(2);
+    }
+        
+    *renderer = SDL_CreateRenderer  (*window, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
+    if (!*renderer) 
+    {
+        fprintf(stderr, "Failed to create renderer: %s\n", SDL_GetError());
+        exit(3);
+    }
+}
+
+// TRACKING THE HIGHEST SCORE
+
+// the score file is a header and the latest SCORE_SESSIONS game records; the simulation only queues
+// records, a writer thread batches them and replaces the file through a renamed temporary copy
+typedef struct {
+    uint32_t magic, highScore, count, reserved;
+} scoreHeaderClass;
+
+typedef struct {
+    scoreRecordClass session;
+    unsigned int highScore;
+    SDL_bool isSession;
+} scoreEntryClass;
+
+typedef struct {
+    scoreEntryClass entries[SCORE_QUEUE]; // one producer at a time, the writer thread consumes
+    SDL_atomic_t head, tail, isRunning;
+    SDL_mutex *lock;
+    SDL_cond *ready;
+    SDL_Thread *thread;
+    scoreHeaderClass header;
+    scoreRecordClass *sessions;
+    unsigned int queuedHigh, queuedTick;
+    SDL_bool wasOver;
+    uint64_t records, commits, dropped, failures;
+} scoreStoreClass;
+
+scoreStoreClass scoreStore = { 0 };
+
+void doReadScore(gameClass* game)
+{
+    // older builds wrote the high score alone with putw
+    int file = open(SCORE_FILE, O_RDONLY);
+    struct stat info;
+    const unsigned char *data;
+    scoreHeaderClass header;
+
+    scoreStore.sessions = doAllocate(SCORE_SESSIONS, sizeof(scoreRecordClass));
+    scoreStore.header.magic = SCORE_MAGIC;
+
+    if (file < 0)
+    {
+        return;
+    }
+
+    if (fstat(file, &info) || info.st_size < (off_t)sizeof(int) || (data = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, file, 0)) == MAP_FAILED)
+    {
+        close(file);
+        return;
+    }
+
+    if (info.st_size == sizeof(int))
+    {
+        memcpy(&scoreStore.header.highScore, data, sizeof(int));
+    }
+    else if (info.st_size >= (off_t)sizeof(scoreHeaderClass) && (memcpy(&header, data, sizeof(header)), header.magic == SCORE_MAGIC))
+    {
+        header.count = SDL_min(header.count, SDL_min(SCORE_SESSIONS, (uint32_t)((info.st_size - sizeof(header)) / sizeof(scoreRecordClass))));
+        memcpy(scoreStore.sessions, data + sizeof(header), header.count * sizeof(scoreRecordClass));
+        scoreStore.header = header;
+    }
+
+    munmap((void*)data, info.st_size);
+    close(file);
+    game -> highestScore = scoreStore.queuedHigh = scoreStore.header.highScore;
+}
+
+void doCommitScores(void)
+{
+    // a crash leaves either the old file or the new one, never half of each
+    int file = open(SCORE_FILE ".tmp", O_WRONLY | O_CREAT | O_TRUNC, 0644), directory;
+    size_t size = scoreStore.header.count * sizeof(scoreRecordClass);
+    SDL_bool isWritten = file >= 0 && write(file, &scoreStore.header, sizeof(scoreHeaderClass)) == sizeof(scoreHeaderClass) &&
+                         write(file, scoreStore.sessions, size) == (ssize_t)size && !fsync(file);
+
+    if (file >= 0)
+    {
+        close(file);
+    }
+
+    if (!isWritten || rename(SCORE_FILE ".tmp", SCORE_FILE))
+    {
+        fprintf(stderr, "Failed to save scores: %s\n", strerror(errno));
+        scoreStore.failures++;
+        return;
+    }
+
+    if ((directory = open(".", O_RDONLY)) >= 0)
+    {
+        fsync(directory);
+        close(directory);
+    }
+
+    scoreStore.commits++;
+}
+
+int doScoreWriterThread(void* data)
+{
+    // wait for a record, give the rest of the batch a moment to arrive, then pay for one fsync
+    SDL_bool isRunning = SDL_TRUE;
+
+    while (isRunning)
+    {
+        int head = SDL_AtomicGet(&scoreStore.head);
+
+        SDL_LockMutex(scoreStore.lock);
+
+        while (SDL_AtomicGet(&scoreStore.isRunning) && head == SDL_AtomicGet(&scoreStore.tail))
+        {
+            SDL_CondWait(scoreStore.ready, scoreStore.lock);
+        }
+
+        isRunning = SDL_AtomicGet(&scoreStore.isRunning);
+        SDL_UnlockMutex(scoreStore.lock);
+
+        if (isRunning)
+        {
+            SDL_Delay(SCORE_BATCH_MS);
+        }
+
+        if (head == SDL_AtomicGet(&scoreStore.tail))
+        {
+            continue;
+        }
+
+        for (; head != SDL_AtomicGet(&scoreStore.tail); head++)
+        {
+            scoreEntryClass *entry = &scoreStore.entries[head % SCORE_QUEUE];
+
+            scoreStore.header.highScore = SDL_max(scoreStore.header.highScore, entry -> highScore);
+
+            if (entry -> isSession)
+            {
+                if (scoreStore.header.count == SCORE_SESSIONS)
+                {
+                    memmove(scoreStore.sessions, scoreStore.sessions + 1, (SCORE_SESSIONS - 1) * sizeof(scoreRecordClass));
+                    scoreStore.header.count--;
+                }
+
+                scoreStore.sessions[scoreStore.header.count++] = entry -> session;
+            }
+
+            scoreStore.records++;
+        }
+
+        SDL_AtomicSet(&scoreStore.head, head);
+        doCommitScores();
+    }
+
+    return 0;
+}
+
+void doQueueScore(const gameClass* game, const scoreRecordClass* session)
+{
+    // never waits: a full queue loses the record, the next one carries the high score anyway
+    int tail = SDL_AtomicGet(&scoreStore.tail);
+    scoreEntryClass *entry = &scoreStore.entries[tail % SCORE_QUEUE];
+
+    if (tail - SDL_AtomicGet(&scoreStore.head) == SCORE_QUEUE)
+    {
+        scoreStore.dropped++;
+        return;
+    }
+
+    entry -> highScore = scoreStore.queuedHigh = game -> highestScore;
+    entry -> isSession = session != NULL;
+
+    if (session)
+    {
+        entry -> session = *session;
+        entry -> session.endedAt = (int64_t)time(NULL);
+    }
+
+    scoreStore.queuedTick = game -> tick;
+    SDL_AtomicSet(&scoreStore.tail, tail + 1);
+
+    SDL_LockMutex(scoreStore.lock);
+    SDL_CondSignal(scoreStore.ready);
+    SDL_UnlockMutex(scoreStore.lock);
+}
+
+void doPersistScore(const gameClass* game)
+{
+    // called every tick: a finished game is queued at once, a new high score at most once a second
+    if (game -> gameOver && !scoreStore.wasOver)
+    {
+        doQueueScore(game, &game -> lastSession);
+    }
+    else if (game -> highestScore != scoreStore.queuedHigh && game -> tick - scoreStore.queuedTick >= TICK_RATE)
+    {
+        doQueueScore(game, NULL);
+    }
+
+    scoreStore.wasOver = game -> gameOver;
+}
+
+void doOpenScoreWriter(void)
+{
+    scoreStore.lock = SDL_CreateMutex();
+    scoreStore.ready = SDL_CreateCond();
+    SDL_AtomicSet(&scoreStore.isRunning, 1);
+    scoreStore.thread = SDL_CreateThread(doScoreWriterThread, "score writer", NULL);
+}
+
+void doCloseScoreWriter(const gameClass* game)
+{
+    // a game left mid-way is kept too, marked unfinished
+    scoreRecordClass session = { game -> currentScore, game -> level, game -> deaths, (game -> tick - game -> sessionStart) / TICK_RATE, 0, SDL_FALSE, 0 };
+
+    doQueueScore(game, game -> gameOver || !game -> currentScore ? NULL : &session);
+
+    SDL_LockMutex(scoreStore.lock);
+    SDL_AtomicSet(&scoreStore.isRunning, 0);
+    SDL_CondSignal(scoreStore.ready);
+    SDL_UnlockMutex(scoreStore.lock);
+    SDL_WaitThread(scoreStore.thread, NULL);
+
+    printf("scores: %llu records saved in %llu commits, %llu dropped, %llu failed; %u games on record, best %u\n", (unsigned long long)scoreStore.records, (unsigned long long)scoreStore.commits,
+           (unsigned long long)scoreStore.dropped, (unsigned long long)scoreStore.failures, scoreStore.header.count, scoreStore.header.highScore);
+
+    SDL_DestroyCond(scoreStore.ready);
+    SDL_DestroyMutex(scoreStore.lock);
+    free(scoreStore.sessions);
+    memset(&scoreStore, 0, sizeof(scoreStoreClass));
+}
+
+void doCheckScore(gameClass* game)
+{
+    if (game -> currentScore > game -> highestScore)
+    {
+        game -> highestScore = game -> currentScore;
+    }    
+}
+
+// TEXTURES
+
+// each sheet is read from an asset directory by name; embedded builds carry the packed atlas
+// pre-decoded and only decode the sheets a directory overrides
+const char *sheetFiles[sheets] = { "maze.png", "food.png", "ghost.png", "pacman.png", "kill.png", "ready.png", "gameover.png", "numbers.png" };
+
+#ifdef EMBEDDED_ASSETS
+#include "assets.h"
+#endif
+
+typedef struct {
+    char path[4096];
+    SDL_Surface *surface;
+    SDL_bool isPresent;
+} sheetDecodeClass;
+
+// when each startup phase finished, in nanoseconds on the monotonic clock
+typedef struct {
+    uint64_t start, engine, decode, upload, firstFrame;
+    int decoded;
+    SDL_bool isEmbedded;
+} startupClass;
+
+startupClass startup;
+
+int doDecodeSheet(void* data)
+{
+    sheetDecodeClass *job = data;
+
+    job -> surface = IMG_Load(job -> path);
+    return 0;
+}
+
+int doDecodeSheets(const char* dir, SDL_Surface** surfaces)
+{
+    // every sheet present in the directory is decoded on a thread of its own
+    sheetDecodeClass jobs[sheets];
+    SDL_Thread *threads[sheets] = { NULL };
+    int found = 0;
+
+    IMG_Init(IMG_INIT_PNG);
+
+    for (int i = 0; i < sheets; i++)
+    {
+        snprintf(jobs[i].path, sizeof(jobs[i].path), "%s/%s", dir, sheetFiles[i]);
+        jobs[i].surface = NULL;
+        jobs[i].isPresent = !access(jobs[i].path, R_OK);
+
+        if (!jobs[i].isPresent)
+        {
+            continue;
+        }
+
+        threads[i] = SDL_CreateThread(doDecodeSheet, "decode", &jobs[i]);
+
+        if (!threads[i])
+        {
+            doDecodeSheet(&jobs[i]);
+        }
+
+        found++;
+    }
+
+    for (int i = 0; i < sheets; i++)
+    {
+        if (threads[i])
+        {
+            SDL_WaitThread(threads[i], NULL);
+        }
+
+        if (jobs[i].isPresent && !jobs[i].surface)
+        {
+            fprintf(stderr, "Failed to decode %s: %s\n", jobs[i].path, IMG_GetError());
+            exit(3);
+        }
+
+        surfaces[i] = jobs[i].surface;
+    }
+
+    return found;
+}
+
+SDL_Surface* doPackAtlas(SDL_Surface** surfaces)
+{
+    SDL_Surface *atlas;
+    int x = 0, y = 0, shelf = 0, width = 1;
+
+    // sheets go on shelves left to right, a pixel apart so filtering never bleeds between them
+    for (int i = 0; i < sheets; i++)
+    {
+        int w = surfaces[i] -> w, h = surfaces[i] -> h;
+
+        if (x + w > ATLAS_WIDTH)
+        {
+            x = 0;
+            y += shelf + 1;
+            shelf = 0;
+        }
+
+        spriteAtlas.sheets[i] = (SDL_Rect){ x, y, w, h };
+        x += w + 1;
+        shelf = SDL_max(shelf, h);
+        width = SDL_max(width, x - 1);
+    }
+
+    spriteAtlas.width = width;
+    spriteAtlas.height = SDL_max(1, y + shelf);
+    atlas = SDL_CreateRGBSurfaceWithFormat(0, spriteAtlas.width, spriteAtlas.height, 32, SDL_PIXELFORMAT_RGBA32);
+
+    if (!atlas)
+    {
+        fprintf(stderr, "Failed to create sprite atlas: %s\n", SDL_GetError());
+        exit(3);
+    }
+
+    for (int i = 0; i < sheets; i++)
+    {
+        SDL_SetSurfaceBlendMode(surfaces[i], SDL_BLENDMODE_NONE);
+        SDL_BlitSurface(surfaces[i], NULL, atlas, &spriteAtlas.sheets[i]);
+        SDL_FreeSurface(surfaces[i]);
+    }
+
+    return atlas;
+}
+
+char* doDefaultAssetDir(void)
+{
+    // next to the executable, whatever the working directory
+    char *base = SDL_GetBasePath(), *dir = doAllocate(strlen(base ? base : "./") + 8, sizeof(char));
+
+    sprintf(dir, "%s../img", base ? base : "./");
+    SDL_free(base);
+
+    return dir;
+}
+
+#ifdef EMBEDDED_ASSETS
+void doUseEmbeddedAtlas(void)
+{
+    memcpy(spriteAtlas.sheets, embeddedSheets, sizeof(spriteAtlas.sheets));
+    spriteAtlas.width = EMBEDDED_ATLAS_WIDTH;
+    spriteAtlas.height = EMBEDDED_ATLAS_HEIGHT;
+}
+#endif
+
+SDL_Surface* doLoadAtlas(const char* assetDir)
+{
+    // whatever the directory has is decoded, embedded sheets fill in the rest
+    SDL_Surface *surfaces[sheets] = { NULL };
+    char *dir = assetDir ? NULL : doDefaultAssetDir();
+
+    startup.decoded = doDecodeSheets(assetDir ? assetDir : dir, surfaces);
+
+    for (int i = 0; i < sheets; i++)
+    {
+        if (surfaces[i])
+        {
+            continue;
+        }
+
+#ifdef EMBEDDED_ASSETS
+        surfaces[i] = SDL_CreateRGBSurfaceWithFormatFrom((void*)(embeddedAtlas + ((size_t)embeddedSheets[i].y * EMBEDDED_ATLAS_WIDTH + embeddedSheets[i].x) * 4),
+            embeddedSheets[i].w, embeddedSheets[i].h, 32, EMBEDDED_ATLAS_WIDTH * 4, SDL_PIXELFORMAT_RGBA32);
+#else
+        fprintf(stderr, "Failed to load %s/%s\n", assetDir ? assetDir : dir, sheetFiles[i]);
+        exit(3);
+#endif
+    }
+
+    free(dir);
+    startup.decode = doMonotonicNs();
+
+    return doPackAtlas(surfaces);
+}
+
+void doLoadTextures(SDL_Renderer* renderer, const char* assetDir)
+{
+    SDL_Surface *atlas;
+
+#ifdef EMBEDDED_ASSETS
+    startup.isEmbedded = SDL_TRUE;
+
+    if (!assetDir)
+    {
+        // the fixed path: one upload straight from the blob, nothing to decode
+        doUseEmbeddedAtlas();
+        startup.decode = doMonotonicNs();
+        spriteAtlas.texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA32, SDL_TEXTUREACCESS_STATIC, spriteAtlas.width, spriteAtlas.height);
+
+        if (!spriteAtlas.texture || SDL_UpdateTexture(spriteAtlas.texture, NULL, embeddedAtlas, spriteAtlas.width * 4))
+        {
+            fprintf(stderr, "Failed to create sprite atlas: %s\n", SDL_GetError());
+            exit(3);
+        }
+
+        SDL_SetTextureBlendMode(spriteAtlas.texture, SDL_BLENDMODE_BLEND);
+        startup.upload = doMonotonicNs();
+        return;
+    }
+#endif
+
+    atlas = doLoadAtlas(assetDir);
+    spriteAtlas.texture = SDL_CreateTextureFromSurface(renderer, atlas);
+
+    if (!spriteAtlas.texture)
+    {
+        fprintf(stderr, "Failed to create sprite atlas: %s\n", SDL_GetError());
+        exit(3);
+    }
+
+    SDL_SetTextureBlendMode(spriteAtlas.texture, SDL_BLENDMODE_BLEND);
+    SDL_FreeSurface(atlas);
+    startup.upload = doMonotonicNs();
+}
+
+void doOpenCanvas(const char* assetDir)
+{
+    // the canvas samples the atlas in memory, embedded builds use the blob as it is
+#ifdef EMBEDDED_ASSETS
+    if (!assetDir)
+    {
+        doUseEmbeddedAtlas();
+        canvas.atlas = (const uint32_t*)embeddedAtlas;
+        canvas.atlasPitch = EMBEDDED_ATLAS_WIDTH;
+    }
+#endif
+
+    if (!canvas.atlas)
+    {
+        canvas.atlasSurface = doLoadAtlas(assetDir);
+        canvas.atlas = canvas.atlasSurface -> pixels;
+        canvas.atlasPitch = canvas.atlasSurface -> pitch / 4;
+    }
+
+    canvas.width = SCREEN_WIDTH;
+    canvas.height = SCREEN_HEIGHT;
+    canvas.pixels = doAllocate((size_t)canvas.width * canvas.height, sizeof(uint32_t));
+    canvas.row = doAllocate((size_t)canvas.width, sizeof(uint32_t));
+    canvas.isOffscreen = SDL_TRUE;
+    spriteAtlas.isBatching = SDL_FALSE;
+}
+
+void doCloseCanvas(void)
+{
+    if (canvas.atlasSurface)
+    {
+        SDL_FreeSurface(canvas.atlasSurface);
+    }
+
+    free(canvas.pixels);
+    free(canvas.row);
+    memset(&canvas, 0, sizeof(canvasClass));
+}
+
+void doEmbedAssets(const char* path, const char* dir)
+{
+    // writes the packed atlas as a header for builds with EMBEDDED_ASSETS
+    SDL_Surface *surfaces[sheets] = { NULL }, *atlas;
+    FILE *file;
+
+    if (doDecodeSheets(dir, surfaces) < sheets)
+    {
+        for (int i = 0; i < sheets; i++)
+        {
+            if (!surfaces[i])
+            {
+                fprintf(stderr, "Failed to load %s/%s\n", dir, sheetFiles[i]);
+            }
+        }
+
+        exit(3);
+    }
+
+    atlas = doPackAtlas(surfaces);
+    file = fopen(path, "w");
+
+    if (!file)
+    {
+        fprintf(stderr, "Failed to write %s\n", path);
+        exit(3);
+    }
+
+    fprintf(file, "// generated by pacman --embed-assets from %s, do not edit\n\n", dir);
+    fprintf(file, "#define EMBEDDED_ATLAS_WIDTH %d\n#define EMBEDDED_ATLAS_HEIGHT %d\n\n", spriteAtlas.width, spriteAtlas.height);
+    fprintf(file, "static const SDL_Rect embeddedSheets[%d] = {\n", sheets);
+
+    for (int i = 0; i < sheets; i++)
+    {
+        fprintf(file, "    { %d, %d, %d, %d }, // %s\n", spriteAtlas.sheets[i].x, spriteAtlas.sheets[i].y, spriteAtlas.sheets[i].w, spriteAtlas.sheets[i].h, sheetFiles[i]);
+    }
+
+    fprintf(file, "};\n\nstatic const _Alignas(uint32_t) unsigned char embeddedAtlas[%d] = {", spriteAtlas.width * spriteAtlas.height * 4);
+
+    for (int y = 0; y < spriteAtlas.height; y++)
+    {
+        const unsigned char *row = (const unsigned char*)atlas -> pixels + (size_t)y * atlas -> pitch;
+
+        for (int x = 0; x < spriteAtlas.width * 4; x++)
+        {
+            fprintf(file, "%s%u,", x % 32 ? "" : "\n", row[x]);
+        }
+    }
+
+    fprintf(file, "\n};\n");
+    fclose(file);
+    SDL_FreeSurface(atlas);
+    printf("%s: %d x %d atlas of %d sheets\n", path, spriteAtlas.width, spriteAtlas.height, sheets);
+}
+
+void doReportStartup(void)
+{
+    printf("startup: engine %.2f ms, assets %.2f ms (%s%d decoded), upload %.2f ms, first frame %.2f ms after launch\n",
+        (startup.engine - startup.start) / 1e6, (startup.decode - startup.engine) / 1e6, startup.isEmbedded ? "embedded, " : "", startup.decoded,
+        (startup.upload - startup.decode) / 1e6, (startup.firstFrame - startup.start) / 1e6);
+}
+
+void doCleanAll(SDL_Window* window, SDL_Renderer* renderer)
+{
+    doFreeMazeLayer();
+    doFreeHud();
+    SDL_DestroyTexture(spriteAtlas.texture);
+    free(spriteAtlas.vertices);
+    free(spriteAtlas.indices);
+
+    SDL_DestroyRenderer(renderer);
+    SDL_DestroyWindow(window);
+    SDL_Quit();
+}
+
+// GAME LOOP
+
+void doFinishTick(gameClass* game, playerClass* player, enemyClass* enemy)
+{
+    // everything in a tick that follows the player's move
+    doCheckScore(game);
+
+    if (game -> gameOver)
+    {
+        player -> isMoving = SDL_FALSE;
+        return;
+    }
+
+    if (player -> isAlive) 
+    {   
+        player -> isMoving = SDL_TRUE;
+
+        if (doBallsLeft(game) > 0)
+        {
+            if (player -> curHeading != idle)
+            {
+                if (!game -> isRoundStarted)
+                {
+                    doStartRound(game, enemy);
+                }
+
+                PROFILE_BEGIN(phaseEatFood);
+                doEatFood(game, player, enemy);
+                PROFILE_END(phaseEatFood);
+
+                PROFILE_BEGIN(phaseEnemyState);
+                doUpdateEnemyState(game, player, enemy);
+                PROFILE_END(phaseEnemyState);
+
+                doEnemyMove(game, player, enemy);
+
+                PROFILE_BEGIN(phaseEncounter);
+                doCheckEncounter(game, player, enemy);
+                PROFILE_END(phaseEncounter);
+            }
+        } 
+        else 
+        {
+            player -> isMoving = SDL_FALSE;
+            if (doGamePause(game, 3))
+            {
+                game -> level++;
+                doInitFood(game);
+                doInitRound(game, player, enemy);
+            }
+        }
+    } 
+    else
+    {
+        player -> isMoving = SDL_FALSE;
+        if (doGamePause(game, 3))
+        {
+            game -> deaths++;
+
+            if (game -> playerLives > 1)
+            {
+                game -> playerLives--;
+            }
+            else
+            {
+                game -> lastSession = (scoreRecordClass){ game -> currentScore, game -> level, game -> deaths, (game -> tick - game -> sessionStart) / TICK_RATE, 0, SDL_TRUE, 0 };
+                game -> gameOver = SDL_TRUE;
+                doInitFood(game);
+                game -> playerLives = 3;
+                game -> currentScore = 0;
+                game -> level = 1;
+                game -> deaths = 0;
+                game -> sessionStart = game -> tick;
+            }
+        
+            doInitRound(game, player, enemy);
+        }
+    }
+}
+
+void doRememberPositions(playerClass* player, enemyClass* enemy)
+{
+    player -> prevX = player -> posX;
+    player -> prevY = player -> posY;
+    memcpy(enemy -> prevX, enemy -> posX, enemy -> count * sizeof(float));
+    memcpy(enemy -> prevY, enemy -> posY, enemy -> count * sizeof(float));
+}
+
+SDL_bool doUpdateGame(SDL_Window* window, SDL_Event* event, gameClass* game, playerClass* player, enemyClass* enemy)
+{
+    SDL_bool done = SDL_FALSE;
+
+    PROFILE_BEGIN(phaseTick);
+    doRememberPositions(player, enemy);
+    doAdvanceClock(game, enemy);
+
+    PROFILE_BEGIN(phaseInput);
+    done = doPlayerMove(window, event, game, player);
+    PROFILE_END(phaseInput);
+
+    doFinishTick(game, player, enemy);
+    PROFILE_END(phaseTick);
+
+    return done;
+}
+
+void doDrawGame(SDL_Renderer* renderer, gameClass* game, playerClass* player, enemyClass* enemy)
+{
+    PROFILE_BEGIN(phaseDraw);
+    PROFILE_BEGIN(phaseClear);
+    doRefreshScreen(renderer);
+    doUpdateCamera(player);
+    PROFILE_END(phaseClear);
+
+    if (game -> gameOver)
+    {
+        PROFILE_BEGIN(phaseTextGameOver);
+        doDrawTextGameOver(renderer);
+        PROFILE_END(phaseTextGameOver);
+        PROFILE_END(phaseDraw);
+        return;
+    }
+
+    // the maze layer and the HUD go first and on their own, everything after them is one batch
+    PROFILE_BEGIN(phaseMazeLayer);
+    SDL_bool isLayered = doDrawMazeLayer(renderer, game);
+    PROFILE_END(phaseMazeLayer);
+
+    if (player -> isAlive)
+    {
+        PROFILE_BEGIN(phaseHud);
+        doDrawHud(renderer, game);
+        PROFILE_END(phaseHud);
+    }
+
+    doOpenBatch();
+
+    if (!isLayered)
+    {
+        PROFILE_BEGIN(phaseBackground);
+        doDrawBackground(renderer, game);
+        PROFILE_END(phaseBackground);
+    }
+
+    if (player -> isAlive) 
+    {   
+        if (player -> curHeading == idle)
+        {
+            PROFILE_BEGIN(phaseTextReady);
+            doDrawTextReady(renderer);
+            PROFILE_END(phaseTextReady);
+        }
+
+        if (!isLayered)
+        {
+            PROFILE_BEGIN(phaseFood);
+            doDrawFood(renderer, game);
+            PROFILE_END(phaseFood);
+        }
+
+        PROFILE_BEGIN(phasePacman);
+        doDrawPacman(renderer, game, player);
+        PROFILE_END(phasePacman);
+
+        PROFILE_BEGIN(phaseGhosts);
+        doDrawGhosts(renderer, player, enemy);
+        PROFILE_END(phaseGhosts);
+    } 
+    else
+    {
+        PROFILE_BEGIN(phaseKill);
+        doDrawPacmanKill(renderer, game, player);
+        PROFILE_END(phaseKill);
+    }
+
+    PROFILE_BEGIN(phaseFlush);
+    doFlushBatch(renderer);
+    PROFILE_END(phaseFlush);
+
+    doDrawPathOverlay(renderer);
+    PROFILE_END(phaseDraw);
+}
+
+// STATE STREAM
+
+// delta messages say what changed since the previous tick; keyframes carry everything
+typedef enum { streamScore = 1, streamStatus = 2, streamPlayerMove = 4, streamPlayerHeading = 8, streamPellet = 16, streamGhosts = 32 } streamChangeName;
+typedef enum { ghostMove = 1, ghostState = 2, ghostHeading = 4 } ghostChangeName;
+
+#define STREAM_ALIVE 1
+#define STREAM_GAME_OVER 2
+
+// positions travel in half pixels, which every speed in the game lands on exactly
+typedef struct {
+    unsigned int tick, score, highScore, lives, flags, pauseLeft, foodLeft;
+    int playerX, playerY, ghostCount;
+    unsigned char heading;
+    int *ghostX, *ghostY;
+    unsigned char *ghostState, *ghostHeading, *ghostBehaviour;
+} streamSnapshotClass;
+
+typedef struct {
+    streamSnapshotClass last, next;
+    unsigned int keyframeTick;
+    SDL_bool hasKeyframe;
+} streamEncoderClass;
+
+typedef struct {
+    unsigned long long messages, keyframes, bytes;
+    SDL_bool hasKeyframe, isMalformed;
+} streamDecoderClass;
+
+typedef struct {
+    streamEncoderClass encoder;
+    int listenFd, count, capacity;
+    int *subscribers;
+    FILE *record;
+    unsigned char *message, *keyframe;
+    unsigned long long ticks, bytes, keyframes;
+} streamClass;
+
+size_t doPutVarint(unsigned char* buffer, uint64_t value)
+{
+    size_t n = 0;
+
+    while (value >= 0x80)
+    {
+        buffer[n++] = (unsigned char)(value | 0x80);
+        value >>= 7;
+    }
+
+    buffer[n++] = (unsigned char)value;
+    return n;
+}
+
+size_t doPutSigned(unsigned char* buffer, const int64_t value)
+{
+    return doPutVarint(buffer, ((uint64_t)value << 1) ^ (uint64_t)(value >> 63));
+}
+
+uint64_t doGetVarint(const unsigned char* buffer, size_t* at, const size_t length)
+{
+    // a truncated varint reads as zero and leaves *at past the end, which callers treat as malformed
+    uint64_t value = 0;
+
+    for (int shift = 0; *at < length && shift < 64; shift += 7)
+    {
+        unsigned char byte = buffer[(*at)++];
+
+        value |= (uint64_t)(byte & 0x7f) << shift;
+
+        if (!(byte & 0x80))
+        {
+            return value;
+        }
+    }
+
+    *at = length + 1;
+    return 0;
+}
+
+int64_t doGetSigned(const unsigned char* buffer, size_t* at, const size_t length)
+{
+    uint64_t value = doGetVarint(buffer, at, length);
+
+    return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+}
+
+void doTakeSnapshot(streamSnapshotClass* snapshot, const gameClass* game, const playerClass* player, const enemyClass* enemy)
+{
+    if (snapshot -> ghostCount != enemy -> count)
+    {
+        snapshot -> ghostCount = enemy -> count;
+        snapshot -> ghostX = realloc(snapshot -> ghostX, enemy -> count * sizeof(int));
+        snapshot -> ghostY = realloc(snapshot -> ghostY, enemy -> count * sizeof(int));
+        snapshot -> ghostState = realloc(snapshot -> ghostState, enemy -> count);
+        snapshot -> ghostHeading = realloc(snapshot -> ghostHeading, enemy -> count);
+        snapshot -> ghostBehaviour = realloc(snapshot -> ghostBehaviour, enemy -> count);
+
+        if (!snapshot -> ghostX || !snapshot -> ghostY || !snapshot -> ghostState || !snapshot -> ghostHeading || !snapshot -> ghostBehaviour)
+        {
+            fprintf(stderr, "Failed to allocate stream snapshot for %d ghosts\n", enemy -> count);
+            exit(4);
+        }
+    }
+
+    snapshot -> tick = game -> tick;
+    snapshot -> score = game -> currentScore;
+    snapshot -> highScore = game -> highestScore;
+    snapshot -> lives = game -> playerLives;
+    snapshot -> flags = (player -> isAlive ? STREAM_ALIVE : 0) | (game -> gameOver ? STREAM_GAME_OVER : 0);
+    snapshot -> pauseLeft = game -> timeDelay > game -> tick ? game -> timeDelay - game -> tick : 0;
+    snapshot -> foodLeft = game -> foodLeft;
+    snapshot -> playerX = (int)(player -> posX * 2.0f);
+    snapshot -> playerY = (int)(player -> posY * 2.0f);
+    snapshot -> heading = (unsigned char)player -> curHeading;
+
+    for (int i = 0; i < enemy -> count; i++)
+    {
+        snapshot -> ghostX[i] = (int)(enemy -> posX[i] * 2.0f);
+        snapshot -> ghostY[i] = (int)(enemy -> posY[i] * 2.0f);
+        snapshot -> ghostState[i] = (unsigned char)(enemy -> state[i] | (enemy -> isTimeAlmostEnd[i] ? 0x10 : 0));
+        snapshot -> ghostHeading[i] = (unsigned char)enemy -> heading[i];
+        snapshot -> ghostBehaviour[i] = (unsigned char)enemy -> behaviour[i];
+    }
+}
+
+size_t doEncodeKeyframe(const streamSnapshotClass* snapshot, const gameClass* game, unsigned char* buffer)
+{
+    size_t n = 0;
+
+    buffer[n++] = STREAM_KEYFRAME;
+    n += doPutVarint(buffer + n, snapshot -> tick);
+    n += doPutVarint(buffer + n, snapshot -> score);
+    n += doPutVarint(buffer + n, snapshot -> highScore);
+    n += doPutVarint(buffer + n, snapshot -> lives);
+    n += doPutVarint(buffer + n, snapshot -> flags);
+    n += doPutVarint(buffer + n, snapshot -> pauseLeft);
+    n += doPutSigned(buffer + n, snapshot -> playerX);
+    n += doPutSigned(buffer + n, snapshot -> playerY);
+    buffer[n++] = snapshot -> heading;
+    n += doPutVarint(buffer + n, (uint64_t)snapshot -> ghostCount);
+
+    for (int i = 0; i < snapshot -> ghostCount; i++)
+    {
+        n += doPutSigned(buffer + n, snapshot -> ghostX[i]);
+        n += doPutSigned(buffer + n, snapshot -> ghostY[i]);
+        buffer[n++] = snapshot -> ghostState[i];
+        buffer[n++] = snapshot -> ghostHeading[i];
+        buffer[n++] = snapshot -> ghostBehaviour[i];
+    }
+
+    // pellets as the non-empty bitset words only, each after the gap from the previous one
+    for (int mask = 0; mask < 2; mask++)
+    {
+        const uint64_t *food = mask ? game -> foodLarge : game -> foodSmall;
+        int words = 0, previous = 0;
+
+        for (int w = 0; w < maze.foodWords; w++)
+        {
+            words += food[w] != 0;
+        }
+
+        n += doPutVarint(buffer + n, (uint64_t)words);
+
+        for (int w = 0; w < maze.foodWords; w++)
+        {
+            if (food[w])
+            {
+                n += doPutVarint(buffer + n, (uint64_t)(w - previous));
+                memcpy(buffer + n, &food[w], sizeof(uint64_t));
+                n += sizeof(uint64_t);
+                previous = w;
+            }
+        }
+    }
+
+    return n;
+}
+
+size_t doEncodeDelta(const streamSnapshotClass* last, const streamSnapshotClass* next, const long pellet, unsigned char* buffer)
+{
+    unsigned char changes = 0;
+    size_t n = 1;
+
+    buffer[0] = STREAM_DELTA;
+    n += doPutVarint(buffer + 1, next -> tick - last -> tick);
+
+    size_t at = n++;
+
+    if (next -> score != last -> score || next -> highScore != last -> highScore)
+    {
+        changes |= streamScore;
+        n += doPutSigned(buffer + n, (int64_t)next -> score - last -> score);
+        n += doPutVarint(buffer + n, next -> highScore);
+    }
+
+    if (next -> lives != last -> lives || next -> flags != last -> flags || next -> pauseLeft != last -> pauseLeft)
+    {
+        changes |= streamStatus;
+        n += doPutVarint(buffer + n, next -> lives);
+        n += doPutVarint(buffer + n, next -> flags);
+        n += doPutVarint(buffer + n, next -> pauseLeft);
+    }
+
+    if (next -> playerX != last -> playerX || next -> playerY != last -> playerY)
+    {
+        changes |= streamPlayerMove;
+        n += doPutSigned(buffer + n, next -> playerX - last -> playerX);
+        n += doPutSigned(buffer + n, next -> playerY - last -> playerY);
+    }
+
+    if (next -> heading != last -> heading)
+    {
+        changes |= streamPlayerHeading;
+        buffer[n++] = next -> heading;
+    }
+
+    if (pellet >= 0)
+    {
+        changes |= streamPellet;
+        n += doPutVarint(buffer + n, (uint64_t)pellet);
+    }
+
+    // a bitmap of the ghosts that changed, then only their changed fields
+    size_t bitmap = n;
+    size_t bitmapBytes = (size_t)(next -> ghostCount + 7) / 8;
+
+    memset(buffer + bitmap, 0, bitmapBytes);
+    n += bitmapBytes;
+
+    for (int i = 0; i < next -> ghostCount; i++)
+    {
+        unsigned char fields = 0;
+        size_t fieldsAt = n + 1;
+
+        if (next -> ghostX[i] != last -> ghostX[i] || next -> ghostY[i] != last -> ghostY[i])
+        {
+            fields |= ghostMove;
+            fieldsAt += doPutSigned(buffer + fieldsAt, next -> ghostX[i] - last -> ghostX[i]);
+            fieldsAt += doPutSigned(buffer + fieldsAt, next -> ghostY[i] - last -> ghostY[i]);
+        }
+
+        if (next -> ghostState[i] != last -> ghostState[i])
+        {
+            fields |= ghostState;
+            buffer[fieldsAt++] = next -> ghostState[i];
+        }
+
+        if (next -> ghostHeading[i] != last -> ghostHeading[i])
+        {
+            fields |= ghostHeading;
+            buffer[fieldsAt++] = next -> ghostHeading[i];
+        }
+
+        if (fields)
+        {
+            buffer[n] = fields;
+            buffer[bitmap + i / 8] |= (unsigned char)(1 << (i % 8));
+            n = fieldsAt;
+            changes |= streamGhosts;
+        }
+    }
+
+    if (!(changes & streamGhosts))
+    {
+        n = bitmap;
+    }
+
+    buffer[at] = changes;
+    return n;
+}
+
+size_t doEncodeTick(streamEncoderClass* encoder, const gameClass* game, const playerClass* player, const enemyClass* enemy, unsigned char* buffer)
+{
+    // the message goes after a varint length, reserved at its largest and closed up afterwards
+    streamSnapshotClass swap;
+    long pellet = -1;
+    size_t n = 0;
+
+    doTakeSnapshot(&encoder -> next, game, player, enemy);
+
+    // the only pellet that can go in one tick is the one under the player; anything else, like a new level, needs a keyframe
+    SDL_bool isKeyframe = !encoder -> hasKeyframe || game -> tick - encoder -> keyframeTick >= STREAM_KEYFRAME_TICKS || encoder -> next.ghostCount != encoder -> last.ghostCount;
+
+    if (!isKeyframe && encoder -> next.foodLeft != encoder -> last.foodLeft)
+    {
+        isKeyframe = encoder -> next.foodLeft + 1 != encoder -> last.foodLeft || doGetFood(game, player -> curGridPos) != noFood;
+        pellet = doGridIndex(player -> curGridPos);
+    }
+
+    if (isKeyframe)
+    {
+        n = doEncodeKeyframe(&encoder -> next, game, buffer + 5);
+        encoder -> keyframeTick = game -> tick;
+        encoder -> hasKeyframe = SDL_TRUE;
+    }
+    else
+    {
+        n = doEncodeDelta(&encoder -> last, &encoder -> next, pellet, buffer + 5);
+    }
+
+    swap = encoder -> last;
+    encoder -> last = encoder -> next;
+    encoder -> next = swap;
+
+    size_t prefix = doPutVarint(buffer, n);
+    memmove(buffer + prefix, buffer + 5, n);
+    return prefix + n;
+}
+
+size_t doStreamBufferSize(const int ghosts)
+{
+    return 96 + (size_t)ghosts * 16 + 2 * (size_t)maze.foodWords * 18;
+}
+
+void doFreeSnapshot(streamSnapshotClass* snapshot)
+{
+    free(snapshot -> ghostX);
+    free(snapshot -> ghostY);
+    free(snapshot -> ghostState);
+    free(snapshot -> ghostHeading);
+    free(snapshot -> ghostBehaviour);
+}
+
+size_t doRejectMessage(streamDecoderClass* decoder, const size_t end)
+{
+    decoder -> isMalformed = SDL_TRUE;
+
+    return end;
+}
+
+SDL_bool doIsValidGhostByte(const unsigned char value)
+{
+    return (value & 0x0f) >= scatter && (value & 0x0f) <= home && !(value & 0xe0) ? SDL_TRUE : SDL_FALSE;
+}
+
+size_t doDecodeMessage(streamDecoderClass* decoder, const unsigned char* data, const size_t length, gameClass* game, playerClass* player, enemyClass* enemy)
+{
+    // returns the bytes used, or 0 while the message is still incomplete; bad input sets isMalformed
+    size_t at = 0, size = (size_t)doGetVarint(data, &at, length), end = at + size;
+
+    if (at > length || end > length || !size)
+    {
+        return 0;
+    }
+
+    unsigned char kind = data[at++];
+
+    decoder -> messages++;
+    decoder -> bytes += end;
+
+    if (kind == STREAM_KEYFRAME)
+    {
+        game -> tick = (unsigned int)doGetVarint(data, &at, end);
+        game -> currentScore = (unsigned int)doGetVarint(data, &at, end);
+        game -> highestScore = (unsigned int)doGetVarint(data, &at, end);
+        game -> playerLives = (unsigned short)doGetVarint(data, &at, end);
+        unsigned int flags = (unsigned int)doGetVarint(data, &at, end);
+        game -> timeDelay = game -> tick + (unsigned int)doGetVarint(data, &at, end);
+        game -> gameOver = flags & STREAM_GAME_OVER ? SDL_TRUE : SDL_FALSE;
+        player -> isAlive = flags & STREAM_ALIVE ? SDL_TRUE : SDL_FALSE;
+        player -> posX = (float)doGetSigned(data, &at, end) / 2.0f;
+        player -> posY = (float)doGetSigned(data, &at, end) / 2.0f;
+        player -> curHeading = at < end ? (headingName)data[at++] : idle;
+
+        uint64_t ghosts = doGetVarint(data, &at, end);
+
+        // each ghost takes at least two position bytes and three field bytes
+        if (at > end || player -> curHeading < up || player -> curHeading > idle || ghosts > STREAM_MAX_GHOSTS || ghosts * 5 > end - at)
+        {
+            return doRejectMessage(decoder, end);
+        }
+
+        int count = (int)ghosts;
+
+        if (enemy -> count != count)
+        {
+            if (enemy -> count)
+            {
+                doFreeEnemies(enemy);
+            }
+
+            doAllocEnemies(enemy, count);
+        }
+
+        for (int i = 0; i < count; i++)
+        {
+            enemy -> posX[i] = (float)doGetSigned(data, &at, end) / 2.0f;
+            enemy -> posY[i] = (float)doGetSigned(data, &at, end) / 2.0f;
+
+            if (at + 3 > end || !doIsValidGhostByte(data[at]) || data[at + 1] < up || data[at + 1] > idle || data[at + 2] > clyde)
+            {
+                return doRejectMessage(decoder, end);
+            }
+
+            enemy -> state[i] = data[at] & 0x0f;
+            enemy -> isTimeAlmostEnd[i] = data[at++] & 0x10 ? SDL_TRUE : SDL_FALSE;
+            enemy -> heading[i] = data[at++];
+            enemy -> behaviour[i] = data[at++];
+        }
+
+        for (int mask = 0; mask < 2; mask++)
+        {
+            uint64_t *food = mask ? game -> foodLarge : game -> foodSmall;
+            uint64_t words = doGetVarint(data, &at, end), w = 0;
+
+            memset(food, 0, maze.foodWords * sizeof(uint64_t));
+
+            if (words > (uint64_t)maze.foodWords)
+            {
+                return doRejectMessage(decoder, end);
+            }
+
+            for (uint64_t k = 0; k < words; k++)
+            {
+                uint64_t skip = doGetVarint(data, &at, end);
+
+                // word indices only grow, so a skip past the board or a short payload ends the message
+                if (skip >= (uint64_t)maze.foodWords - w || at + sizeof(uint64_t) > end)
+                {
+                    return doRejectMessage(decoder, end);
+                }
+
+                w += skip;
+                memcpy(&food[w], data + at, sizeof(uint64_t));
+                at += sizeof(uint64_t);
+            }
+        }
+
+        game -> foodLeft = doCountFood(game -> foodSmall) + doCountFood(game -> foodLarge);
+        decoder -> keyframes++;
+        decoder -> hasKeyframe = SDL_TRUE;
+    }
+    else if (kind == STREAM_DELTA && decoder -> hasKeyframe)
+    {
+        // each group is read whole before it is applied, a short one rejects the message
+        unsigned int ticks = (unsigned int)doGetVarint(data, &at, end);
+
+        if (at >= end)
+        {
+            return doRejectMessage(decoder, end);
+        }
+
+        unsigned char changes = data[at++];
+
+        game -> tick += ticks;
+
+        if (changes & streamScore)
+        {
+            int64_t score = doGetSigned(data, &at, end);
+            unsigned int highest = (unsigned int)doGetVarint(data, &at, end);
+
+            if (at > end)
+            {
+                return doRejectMessage(decoder, end);
+            }
+
+            game -> currentScore = (unsigned int)((int64_t)game -> currentScore + score);
+            game -> highestScore = highest;
+        }
+
+        if (changes & streamStatus)
+        {
+            unsigned short lives = (unsigned short)doGetVarint(data, &at, end);
+            unsigned int flags = (unsigned int)doGetVarint(data, &at, end);
+            unsigned int pause = (unsigned int)doGetVarint(data, &at, end);
+
+            if (at > end)
+            {
+                return doRejectMessage(decoder, end);
+            }
+
+            game -> playerLives = lives;
+            game -> timeDelay = game -> tick + pause;
+            game -> gameOver = flags & STREAM_GAME_OVER ? SDL_TRUE : SDL_FALSE;
+            player -> isAlive = flags & STREAM_ALIVE ? SDL_TRUE : SDL_FALSE;
+        }
+
+        if (changes & streamPlayerMove)
+        {
+            int64_t dx = doGetSigned(data, &at, end), dy = doGetSigned(data, &at, end);
+
+            if (at > end)
+            {
+                return doRejectMessage(decoder, end);
+            }
+
+            player -> posX += (float)dx / 2.0f;
+            player -> posY += (float)dy / 2.0f;
+        }
+
+        if (changes & streamPlayerHeading)
+        {
+            if (at >= end || data[at] < up || data[at] > idle)
+            {
+                return doRejectMessage(decoder, end);
+            }
+
+            player -> curHeading = data[at++];
+        }
+
+        if (changes & streamPellet)
+        {
+            uint64_t pellet = doGetVarint(data, &at, end);
+
+            if (at > end || pellet >= (uint64_t)maze.width * maze.height)
+            {
+                return doRejectMessage(decoder, end);
+            }
+
+            doClearFood(game, doGetTile((int)(pellet % maze.width), (int)(pellet / maze.width)));
+        }
+
+        if (changes & streamGhosts)
+        {
+            size_t bitmap = at;
+
+            at += (size_t)(enemy -> count + 7) / 8;
+
+            if (at > end)
+            {
+                return doRejectMessage(decoder, end);
+            }
+
+            for (int i = 0; i < enemy -> count; i++)
+            {
+                if (!(data[bitmap + i / 8] & (1 << (i % 8))))
+                {
+                    continue;
+                }
+
+                // a ghost flagged in the bitmap must have its fields byte and every field it names
+                if (at >= end)
+                {
+                    return doRejectMessage(decoder, end);
+                }
+
+                unsigned char fields = data[at++];
+
+                if (fields & ghostMove)
+                {
+                    int64_t dx = doGetSigned(data, &at, end), dy = doGetSigned(data, &at, end);
+
+                    if (at > end)
+                    {
+                        return doRejectMessage(decoder, end);
+                    }
+
+                    enemy -> posX[i] += (float)dx / 2.0f;
+                    enemy -> posY[i] += (float)dy / 2.0f;
+                }
+
+                if (fields & ghostState)
+                {
+                    if (at >= end || !doIsValidGhostByte(data[at]))
+                    {
+                        return doRejectMessage(decoder, end);
+                    }
+
+                    enemy -> state[i] = data[at] & 0x0f;
+                    enemy -> isTimeAlmostEnd[i] = data[at++] & 0x10 ? SDL_TRUE : SDL_FALSE;
+                }
+
+                if (fields & ghostHeading)
+                {
+                    if (at >= end || data[at] < up || data[at] > idle)
+                    {
+                        return doRejectMessage(decoder, end);
+                    }
+
+                    enemy -> heading[i] = data[at++];
+                }
+            }
+        }
+    }
+
+    // tiles follow positions so the decoded state can be fed to the usual draw routines
+    player -> curGridPos = player -> newGridPos = doGetTile((int)(player -> posX / SIZE_TILE + 0.5f), (int)(player -> posY / SIZE_TILE + 0.5f));
+
+    return end;
+}
+
+streamClass* doOpenStream(const char* socketPath, const char* recordPath, const int ghosts)
+{
+    streamClass *stream = doAllocate(1, sizeof(streamClass));
+    struct sockaddr_un address = { .sun_family = AF_UNIX };
+
+    stream -> listenFd = -1;
+    stream -> message = doAllocate(doStreamBufferSize(ghosts), 1);
+    stream -> keyframe = doAllocate(doStreamBufferSize(ghosts), 1);
+
+    if (socketPath)
+    {
+        strncpy(address.sun_path, socketPath, sizeof(address.sun_path) - 1);
+        unlink(socketPath);
+        stream -> listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+
+        if (stream -> listenFd < 0 || bind(stream -> listenFd, (struct sockaddr*)&address, sizeof(address)) || listen(stream -> listenFd, SOMAXCONN))
+        {
+            fprintf(stderr, "Failed to listen on %s: %s\n", socketPath, strerror(errno));
+            exit(6);
+        }
+    }
+
+    if (recordPath && !(stream -> record = fopen(recordPath, "wb")))
+    {
+        fprintf(stderr, "Failed to open recording %s\n", recordPath);
+        exit(6);
+    }
+
+    return stream;
+}
+
+void doStreamTick(streamClass* stream, const gameClass* game, const playerClass* player, const enemyClass* enemy)
+{
+    // one encode per tick, the same bytes go to every subscriber
+    size_t length = doEncodeTick(&stream -> encoder, game, player, enemy, stream -> message);
+    int fd;
+
+    stream -> ticks++;
+    stream -> bytes += length;
+    stream -> keyframes += stream -> encoder.keyframeTick == game -> tick;
+
+    if (stream -> record)
+    {
+        fwrite(stream -> message, 1, length, stream -> record);
+    }
+
+    // a subscriber that cannot take a whole message has lost the thread of deltas and is dropped
+    for (int i = 0; i < stream -> count; i++)
+    {
+        if (send(stream -> subscribers[i], stream -> message, length, MSG_NOSIGNAL | MSG_DONTWAIT) != (ssize_t)length)
+        {
+            close(stream -> subscribers[i]);
+            stream -> subscribers[i--] = stream -> subscribers[--stream -> count];
+        }
+    }
+
+    // newcomers start from a keyframe of the state everyone else has just reached
+    while (stream -> listenFd >= 0 && (fd = accept4(stream -> listenFd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0)
+    {
+        size_t n = doEncodeKeyframe(&stream -> encoder.last, game, stream -> keyframe + 5);
+        size_t prefix = doPutVarint(stream -> keyframe, n);
+
+        memmove(stream -> keyframe + prefix, stream -> keyframe + 5, n);
+
+        if (send(fd, stream -> keyframe, prefix + n, MSG_NOSIGNAL | MSG_DONTWAIT) != (ssize_t)(prefix + n))
+        {
+            close(fd);
+            continue;
+        }
+
+        if (stream -> count == stream -> capacity)
+        {
+            stream -> capacity = stream -> capacity ? stream -> capacity * 2 : 16;
+            stream -> subscribers = realloc(stream -> subscribers, stream -> capacity * sizeof(int));
+
+            if (!stream -> subscribers)
+            {
+                fprintf(stderr, "Failed to allocate %zu bytes\n", stream -> capacity * sizeof(int));
+                exit(4);
+            }
+        }
+
+        stream -> subscribers[stream -> count++] = fd;
+    }
+}
+
+void doCloseStream(streamClass* stream, const char* socketPath)
+{
+    printf("stream: %llu ticks, %llu keyframes, %.1f bytes/tick, %d subscribers\n", stream -> ticks, stream -> keyframes, stream -> ticks ? (double)stream -> bytes / stream -> ticks : 0.0, stream -> count);
+
+    for (int i = 0; i < stream -> count; i++)
+    {
+        close(stream -> subscribers[i]);
+    }
+
+    if (stream -> listenFd >= 0)
+    {
+        close(stream -> listenFd);
+        unlink(socketPath);
+    }
+
+    if (stream -> record)
+    {
+        fclose(stream -> record);
+    }
+
+    doFreeSnapshot(&stream -> encoder.last);
+    doFreeSnapshot(&stream -> encoder.next);
+    free(stream -> subscribers);
+    free(stream -> message);
+    free(stream -> keyframe);
+    free(stream);
+}
+
+// AUTOPILOT
+
+// one decision point of the player; children are indexed by heading - 1
+typedef struct {
+    int child[4];
+    float visits, value;
+    unsigned char options;
+    SDL_bool isExpanded;
+} mctsNodeClass;
+
+typedef struct {
+    struct autopilotClass *pilot;
+    SDL_Thread *thread;
+    gameClass game;
+    playerClass player;
+    enemyClass enemy;
+    uint64_t seed;
+} rolloutWorkerClass;
+
+typedef struct autopilotClass {
+    int threads;
+    unsigned int budgetMs, job, busy;
+    SDL_bool quit;
+    SDL_mutex *lock;
+    SDL_cond *wake, *done;
+    rolloutWorkerClass *workers;
+    const enemyClass *enemy;
+    const gameClass *rootGame;
+    const playerClass *rootPlayer;
+    mctsNodeClass *nodes;
+    int nodeCount;
+    Uint64 deadline, rollouts, decisions, thinkTicks;
+} autopilotClass;
+
+int doSelectNode(autopilotClass* pilot, headingName* path, int* nodePath)
+{
+    // walk down by UCB1, expanding the first untried heading; visits count as losses until the rollout reports back
+    int node = 0, depth = 0;
+
+    nodePath[0] = 0;
+    pilot -> nodes[0].visits++;
+
+    while (pilot -> nodes[node].isExpanded && depth < MCTS_MAX_DEPTH)
+    {
+        mctsNodeClass *tmp = &pilot -> nodes[node];
+        headingName best = idle;
+        float bestScore = -1.0f;
+
+        for (headingName heading = up; heading <= right; heading++)
+        {
+            if (!(tmp -> options & (1 << heading)))
+            {
+                continue;
+            }
+
+            if (tmp -> child[heading - 1] < 0 && pilot -> nodeCount < MCTS_MAX_NODES)
+            {
+                mctsNodeClass *child = &pilot -> nodes[pilot -> nodeCount];
+
+                memset(child, 0, sizeof(mctsNodeClass));
+                child -> child[0] = child -> child[1] = child -> child[2] = child -> child[3] = -1;
+                tmp -> child[heading - 1] = pilot -> nodeCount++;
+                best = heading;
+                break;
+            }
+
+            if (tmp -> child[heading - 1] >= 0)
+            {
+                mctsNodeClass *child = &pilot -> nodes[tmp -> child[heading - 1]];
+                float score = child -> value / child -> visits + MCTS_EXPLORATION * sqrtf(logf(tmp -> visits) / child -> visits);
+
+                if (score > bestScore)
+                {
+                    best = heading;
+                    bestScore = score;
+                }
+            }
+        }
+
+        if (best == idle)
+        {
+            break;
+        }
+
+        path[depth++] = best;
+        node = tmp -> child[best - 1];
+        nodePath[depth] = node;
+        pilot -> nodes[node].visits++;
+
+        if (!pilot -> nodes[node].isExpanded)
+        {
+            break;
+        }
+    }
+
+    return depth;
+}
+
+int doNearestFood(const gameClass* game, const gridClass* cell)
+{
+    // manhattan distance in tiles to the closest pellet, ignoring walls
+    int best = maze.width + maze.height;
+
+    for (int w = 0; w < maze.foodWords; w++)
+    {
+        uint64_t bits = game -> foodSmall[w] | game -> foodLarge[w];
+
+        while (bits)
+        {
+            long i = (long)w * 64 + __builtin_ctzll(bits);
+            int d = abs((int)(i % maze.width) - cell -> tileX) + abs((int)(i / maze.width) - cell -> tileY);
+
+            best = SDL_min(best, d);
+            bits &= bits - 1;
+        }
+    }
+
+    return best;
+}
+
+float doRollout(rolloutWorkerClass* worker, const headingName* path, const int depth, unsigned char* leafOptions)
+{
+    // replay the path on a private copy of the game, then let the random bot play on for a few seconds
+    autopilotClass *pilot = worker -> pilot;
+    gameClass *game = &worker -> game;
+    playerClass *player = &worker -> player;
+    enemyClass *enemy = &worker -> enemy;
+    unsigned int startScore = pilot -> rootGame -> currentScore, gain = 0;
+
+    doCopyGame(game, pilot -> rootGame);
+    doCopyEnemies(enemy, pilot -> enemy);
+    *player = *pilot -> rootPlayer;
+    game -> autopilot = NULL;
+    game -> isHeadless = SDL_TRUE;
+    game -> plan = path + 1;
+    game -> planLength = depth - 1;
+    game -> planStep = 0;
+    game -> planOptions = 0;
+    game -> turnCount = 0;
+
+    // the root decision is taken where the real game stands, in the middle of doPlayerMove
+    player -> newHeading = path[0];
+    doUpdatePlayerHeading(player);
+    doTeleport(&player -> posX, &player -> posY, &player -> curGridPos, &player -> newGridPos, player -> curHeading);
+    doFinishTick(game, player, enemy);
+
+    for (int t = 0; t < ROLLOUT_TICKS && player -> isAlive && doBallsLeft(game) > 0; t++)
+    {
+        doUpdateGame(NULL, NULL, game, player, enemy);
+    }
+
+    *leafOptions = game -> planStep > game -> planLength ? game -> planOptions : 0;
+    gain = game -> currentScore - startScore;
+
+    if (!player -> isAlive)
+    {
+        return 0.0f;
+    }
+
+    if (!doBallsLeft(game))
+    {
+        return 1.0f;
+    }
+
+    // survival first, then points, then being near the pellets that are left
+    return 0.5f + 0.4f * (float)gain / ((float)gain + 200.0f) + 0.1f / (1.0f + (float)doNearestFood(game, player -> curGridPos) / 4.0f);
+}
+
+void doSearch(rolloutWorkerClass* worker)
+{
+    autopilotClass *pilot = worker -> pilot;
+    headingName path[MCTS_MAX_DEPTH];
+    int nodePath[MCTS_MAX_DEPTH + 1];
+    SDL_bool wasRecording = isRecordingPaths;
+    uint64_t searches = pathSearches;
+
+    // rollouts on the simulation's own thread are not the game's searches
+    isRecordingPaths = SDL_FALSE;
+    isRollingOut = SDL_TRUE;
+
+    while (SDL_GetPerformanceCounter() < pilot -> deadline)
+    {
+        unsigned char options = 0;
+
+        SDL_LockMutex(pilot -> lock);
+        int depth = doSelectNode(pilot, path, nodePath);
+        SDL_UnlockMutex(pilot -> lock);
+
+        if (!depth)
+        {
+            break;
+        }
+
+        float reward = doRollout(worker, path, depth, &options);
+
+        SDL_LockMutex(pilot -> lock);
+
+        if (!pilot -> nodes[nodePath[depth]].isExpanded && options)
+        {
+            pilot -> nodes[nodePath[depth]].options = options;
+            pilot -> nodes[nodePath[depth]].isExpanded = SDL_TRUE;
+        }
+
+        for (int d = 0; d <= depth; d++)
+        {
+            pilot -> nodes[nodePath[d]].value += reward;
+        }
+
+        pilot -> rollouts++;
+        SDL_UnlockMutex(pilot -> lock);
+    }
+
+    isRecordingPaths = wasRecording;
+    isRollingOut = SDL_FALSE;
+    pathSearches = searches;
+}
+
+int doRolloutWorker(void* data)
+{
+    rolloutWorkerClass *worker = data;
+    autopilotClass *pilot = worker -> pilot;
+    unsigned int job = 0;
+
+    doSeedRandom(worker -> seed);
+    isRollingOut = SDL_TRUE;
+    SDL_LockMutex(pilot -> lock);
+
+    while (1)
+    {
+        while (pilot -> job == job && !pilot -> quit)
+        {
+            SDL_CondWait(pilot -> wake, pilot -> lock);
+        }
+
+        if (pilot -> quit)
+        {
+            break;
+        }
+
+        job = pilot -> job;
+        SDL_UnlockMutex(pilot -> lock);
+        doSearch(worker);
+        SDL_LockMutex(pilot -> lock);
+
+        if (--pilot -> busy == 0)
+        {
+            SDL_CondSignal(pilot -> done);
+        }
+    }
+
+    SDL_UnlockMutex(pilot -> lock);
+    return 0;
+}
+
+autopilotClass* doCreateAutopilot(const enemyClass* enemy, const unsigned int budgetMs, const int threads)
+{
+    // the calling thread is worker 0, the others wait in the pool between decisions
+    autopilotClass *pilot = doAllocate(1, sizeof(autopilotClass));
+
+    pilot -> threads = SDL_max(1, threads);
+    pilot -> budgetMs = budgetMs;
+    pilot -> enemy = enemy;
+    pilot -> lock = SDL_CreateMutex();
+    pilot -> wake = SDL_CreateCond();
+    pilot -> done = SDL_CreateCond();
+    pilot -> nodes = doAllocate(MCTS_MAX_NODES, sizeof(mctsNodeClass));
+    pilot -> workers = doAllocate(pilot -> threads, sizeof(rolloutWorkerClass));
+
+    for (int i = 0; i < pilot -> threads; i++)
+    {
+        pilot -> workers[i].pilot = pilot;
+        pilot -> workers[i].seed = (uint64_t)doRandom() << 16 ^ (uint64_t)i;
+
+        if (i > 0)
+        {
+            pilot -> workers[i].thread = SDL_CreateThread(doRolloutWorker, "rollout", &pilot -> workers[i]);
+        }
+    }
+
+    return pilot;
+}
+
+void doFreeAutopilot(autopilotClass* pilot)
+{
+    double seconds = (double)pilot -> thinkTicks / (double)SDL_GetPerformanceFrequency();
+
+    SDL_LockMutex(pilot -> lock);
+    pilot -> quit = SDL_TRUE;
+    SDL_CondBroadcast(pilot -> wake);
+    SDL_UnlockMutex(pilot -> lock);
+
+    printf("autopilot: %llu decisions, %llu rollouts on %d threads, %.0f rollouts/s\n", (unsigned long long)pilot -> decisions, (unsigned long long)pilot -> rollouts, pilot -> threads, seconds > 0.0 ? (double)pilot -> rollouts / seconds : 0.0);
+
+    for (int i = 0; i < pilot -> threads; i++)
+    {
+        if (i > 0)
+        {
+            SDL_WaitThread(pilot -> workers[i].thread, NULL);
+        }
+
+        if (pilot -> workers[i].enemy.count)
+        {
+            doFreeEnemies(&pilot -> workers[i].enemy);
+        }
+
+        doFreeGame(&pilot -> workers[i].game);
+    }
+
+    SDL_DestroyCond(pilot -> wake);
+    SDL_DestroyCond(pilot -> done);
+    SDL_DestroyMutex(pilot -> lock);
+    free(pilot -> workers);
+    free(pilot -> nodes);
+    free(pilot);
+}
+
+void doGetAutopilotCommand(gameClass* game, playerClass* player)
+{
+    // only tile boundaries with a real choice are searched, everywhere else the player keeps going
+    autopilotClass *pilot = game -> autopilot;
+    unsigned char open = 0;
+    headingName best = idle;
+    Uint64 start = SDL_GetPerformanceCounter();
+
+    game -> gameOver = game -> isHeadless ? SDL_FALSE : game -> gameOver;
+
+    if (!player -> isMoving)
+    {
+        return;
+    }
+
+    open = doGetOpenHeadings(player -> newGridPos);
+
+    if (!doIsDecision(open, player -> curHeading))
+    {
+        player -> newHeading = open & (1 << player -> curHeading) ? player -> curHeading : idle;
+
+        for (headingName heading = up; heading <= right && player -> newHeading == idle; heading++)
+        {
+            player -> newHeading = open & (1 << heading) ? heading : idle;
+        }
+
+        return;
+    }
+
+    memset(pilot -> nodes, 0, sizeof(mctsNodeClass));
+    pilot -> nodes[0].child[0] = pilot -> nodes[0].child[1] = pilot -> nodes[0].child[2] = pilot -> nodes[0].child[3] = -1;
+    pilot -> nodes[0].options = open;
+    pilot -> nodes[0].isExpanded = SDL_TRUE;
+    pilot -> nodeCount = 1;
+    pilot -> rootGame = game;
+    pilot -> rootPlayer = player;
+    pilot -> deadline = start + SDL_GetPerformanceFrequency() * pilot -> budgetMs / 1000;
+
+    SDL_LockMutex(pilot -> lock);
+    pilot -> job++;
+    pilot -> busy = pilot -> threads - 1;
+    SDL_CondBroadcast(pilot -> wake);
+    SDL_UnlockMutex(pilot -> lock);
+
+    doSearch(&pilot -> workers[0]);
+
+    SDL_LockMutex(pilot -> lock);
+
+    while (pilot -> busy)
+    {
+        SDL_CondWait(pilot -> done, pilot -> lock);
+    }
+
+    SDL_UnlockMutex(pilot -> lock);
+
+    // the most visited heading is the most trusted one
+    for (headingName heading = up; heading <= right; heading++)
+    {
+        int child = pilot -> nodes[0].child[heading - 1];
+
+        if (child >= 0 && (best == idle || pilot -> nodes[child].visits > pilot -> nodes[pilot -> nodes[0].child[best - 1]].visits))
+        {
+            best = heading;
+        }
+    }
+
+    player -> newHeading = best;
+    pilot -> decisions++;
+    pilot -> thinkTicks += SDL_GetPerformanceCounter() - start;
+}
+
+// TELEMETRY
+
+// with --telemetry each process keeps its counters in /dev/shm/pacman.<pid>, refreshed a few times a
+// second by the render thread; readers copy the struct and retry while sequence is odd or has moved
+#define TELEMETRY_MAGIC 0x50434d54u
+#define TELEMETRY_PREFIX "pacman."
+#define TELEMETRY_WINDOW 128
+#define TELEMETRY_PERIOD_NS 250000000ULL
+
+typedef struct {
+    uint32_t magic;
+    SDL_atomic_t sequence;
+    int32_t pid;
+    uint64_t startedNs, updatedNs, ticks, searches;
+    float ticksPerSecond, frameP50, frameP99, frameWorst; // frame times in ms over the last TELEMETRY_WINDOW frames
+    uint32_t score, highScore, lives, ghosts;
+    uint32_t ghostStates[GHOST_STATES];
+} telemetryClass;
+
+typedef struct {
+    telemetryClass *shared;
+    char name[64];
+    float frames[TELEMETRY_WINDOW];
+    int frameCount;
+    uint64_t lastFrame, lastPublish, lastTicks;
+} telemetryWriterClass;
+
+SDL_bool isTelemetryEnabled = SDL_FALSE;
+
+void doOpenTelemetry(telemetryWriterClass* writer)
+{
+    // a segment that cannot be made only costs the monitoring, the game goes on without it
+    int fd;
+
+    memset(writer, 0, sizeof(telemetryWriterClass));
+    snprintf(writer -> name, sizeof(writer -> name), "/" TELEMETRY_PREFIX "%d", (int)getpid());
+    fd = shm_open(writer -> name, O_CREAT | O_RDWR, 0644);
+
+    if (fd < 0 || ftruncate(fd, sizeof(telemetryClass)))
+    {
+        fprintf(stderr, "Failed to create telemetry segment %s: %s\n", writer -> name, strerror(errno));
+
+        if (fd >= 0)
+        {
+            close(fd);
+            shm_unlink(writer -> name);
+        }
+
+        return;
+    }
+
+    writer -> shared = mmap(NULL, sizeof(telemetryClass), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (writer -> shared == MAP_FAILED)
+    {
+        writer -> shared = NULL;
+        shm_unlink(writer -> name);
+        return;
+    }
+
+    writer -> shared -> pid = (int32_t)getpid();
+    writer -> shared -> startedNs = writer -> lastPublish = writer -> lastFrame = doMonotonicNs();
+    writer -> shared -> magic = TELEMETRY_MAGIC;
+}
+
+void doPublishTelemetry(telemetryWriterClass* writer, const gameClass* game, const enemyClass* enemy, const uint64_t ticks, const uint64_t searches)
+{
+    // called once a frame; all but a few calls a second only note the frame time
+    telemetryClass *shared = writer -> shared;
+    uint64_t now = doMonotonicNs();
+    float sorted[TELEMETRY_WINDOW];
+    int count;
+
+    if (!shared)
+    {
+        return;
+    }
+
+    writer -> frames[writer -> frameCount++ % TELEMETRY_WINDOW] = (now - writer -> lastFrame) / 1e6f;
+    writer -> lastFrame = now;
+
+    if (now - writer -> lastPublish < TELEMETRY_PERIOD_NS)
+    {
+        return;
+    }
+
+    count = SDL_min(writer -> frameCount, TELEMETRY_WINDOW);
+    memcpy(sorted, writer -> frames, count * sizeof(float));
+    qsort(sorted, count, sizeof(float), doCompareFloat);
+
+    SDL_AtomicAdd(&shared -> sequence, 1);
+    SDL_MemoryBarrierRelease();
+
+    shared -> updatedNs = now;
+    shared -> ticksPerSecond = (float)((ticks - writer -> lastTicks) * 1e9 / (now - writer -> lastPublish));
+    shared -> ticks = ticks;
+    shared -> searches = searches;
+    shared -> frameP50 = count ? sorted[count / 2] : 0.0f;
+    shared -> frameP99 = count ? sorted[SDL_min(count - 1, count * 99 / 100)] : 0.0f;
+    shared -> frameWorst = count ? sorted[count - 1] : 0.0f;
+    shared -> score = game -> currentScore;
+    shared -> highScore = game -> highestScore;
+    shared -> lives = game -> playerLives;
+    shared -> ghosts = (uint32_t)enemy -> count;
+    memset(shared -> ghostStates, 0, sizeof(shared -> ghostStates));
+
+    for (int i = 0; i < enemy -> count; i++)
+    {
+        shared -> ghostStates[enemy -> state[i] - 1]++;
+    }
+
+    SDL_MemoryBarrierRelease();
+    SDL_AtomicAdd(&shared -> sequence, 1);
+
+    writer -> lastPublish = now;
+    writer -> lastTicks = ticks;
+}
+
+void doCloseTelemetry(telemetryWriterClass* writer)
+{
+    if (writer -> shared)
+    {
+        munmap(writer -> shared, sizeof(telemetryClass));
+        shm_unlink(writer -> name);
+        writer -> shared = NULL;
+    }
+}
+
+SDL_bool doReadTelemetry(const char* name, telemetryClass* copy)
+{
+    int fd = shm_open(name, O_RDONLY, 0);
+    const telemetryClass *shared;
+    struct stat info;
+    SDL_bool isRead = SDL_FALSE;
+
+    if (fd < 0)
+    {
+        return SDL_FALSE;
+    }
+
+    if (fstat(fd, &info) || (size_t)info.st_size < sizeof(telemetryClass))
+    {
+        close(fd);
+        return SDL_FALSE;
+    }
+
+    shared = mmap(NULL, sizeof(telemetryClass), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (shared == MAP_FAILED)
+    {
+        return SDL_FALSE;
+    }
+
+    // a writer stalled mid-update for a thousand tries is treated as gone
+    for (int attempt = 0; attempt < 1000 && !isRead; attempt++)
+    {
+        int sequence = SDL_AtomicGet((SDL_atomic_t*)&shared -> sequence);
+
+        if (sequence & 1)
+        {
+            continue;
+        }
+
+        memcpy(copy, shared, sizeof(telemetryClass));
+        SDL_MemoryBarrierAcquire();
+        isRead = SDL_AtomicGet((SDL_atomic_t*)&shared -> sequence) == sequence && copy -> magic == TELEMETRY_MAGIC;
+    }
+
+    munmap((void*)shared, sizeof(telemetryClass));
+
+    return isRead;
+}
+
+void doRunTop(const int refreshes)
+{
+    // one line per process with a segment, refreshed every second; a dead pid means a stale segment
+    for (int r = 0; !refreshes || r < refreshes; r++)
+    {
+        DIR *dir = opendir("/dev/shm");
+        struct dirent *entry;
+        uint64_t now = doMonotonicNs();
+        int processes = 0;
+
+        if (!dir)
+        {
+            fprintf(stderr, "Failed to open /dev/shm: %s\n", strerror(errno));
+            exit(6);
+        }
+
+        printf("%s%8s %6s %8s %9s %8s %8s %8s %6s %6s %26s %10s\n", refreshes == 1 ? "" : "\033[H\033[2J", "pid", "age s", "ticks/s", "frame p50", "p99 ms", "worst", "score", "lives", "ghosts",
+            "scatter/fright/eaten/chase/home", "searches");
+
+        while ((entry = readdir(dir)))
+        {
+            telemetryClass copy;
+            char name[300], states[64];
+
+            if (strncmp(entry -> d_name, TELEMETRY_PREFIX, strlen(TELEMETRY_PREFIX)))
+            {
+                continue;
+            }
+
+            snprintf(name, sizeof(name), "/%s", entry -> d_name);
+
+            if (!doReadTelemetry(name, &copy))
+            {
+                continue;
+            }
+
+            snprintf(states, sizeof(states), "%u/%u/%u/%u/%u", copy.ghostStates[0], copy.ghostStates[1], copy.ghostStates[2], copy.ghostStates[3], copy.ghostStates[4]);
+            printf("%8d %6.0f %8.1f %9.2f %8.2f %8.2f %8u %6u %6u %26s %10llu%s\n", copy.pid, (now - copy.startedNs) / 1e9, copy.ticksPerSecond, copy.frameP50, copy.frameP99, copy.frameWorst,
+                copy.score, copy.lives, copy.ghosts, states, (unsigned long long)copy.searches, kill(copy.pid, 0) && errno == ESRCH ? " dead" : "");
+            processes++;
+        }
+
+        closedir(dir);
+        printf("%d processes\n", processes);
+        fflush(stdout);
+
+        if (refreshes != 1)
+        {
+            SDL_Delay(1000);
+        }
+    }
+}
+
+// GAME SESSION
+
+// the simulation runs at TICK_RATE whatever the display does, frames draw in between ticks
+typedef struct {
+    Uint64 frequency, step, budget, previous, accumulator, frameStart;
+    Uint64 frames, workTotal, workWorst, drawCalls;
+    uint64_t idleNs, idleFrames; // time spent blocked on a still picture, and frames waited instead of drawn
+} frameClockClass;
+
+void doStartFrameClock(SDL_Window* window, frameClockClass* clock)
+{
+    SDL_DisplayMode mode;
+    int refresh = 60;
+
+    if (window && !SDL_GetWindowDisplayMode(window, &mode) && mode.refresh_rate > 0)
+    {
+        refresh = mode.refresh_rate;
+    }
+
+    memset(clock, 0, sizeof(frameClockClass));
+    clock -> frequency = SDL_GetPerformanceFrequency();
+    clock -> step = clock -> frequency / TICK_RATE;
+    clock -> budget = clock -> frequency / refresh;
+    clock -> previous = SDL_GetPerformanceCounter();
+}
+
+unsigned int doFrameSteps(frameClockClass* clock)
+{
+    // after a stall only a few ticks are caught up, the rest of the lost time is dropped
+    Uint64 now = SDL_GetPerformanceCounter(), limit = clock -> step * MAX_CATCHUP_TICKS;
+    unsigned int steps = 0;
+
+    clock -> frameStart = now;
+    clock -> accumulator += now - clock -> previous;
+    clock -> previous = now;
+
+    clock -> accumulator = SDL_min(clock -> accumulator, limit);
+
+    for (; clock -> accumulator >= clock -> step; clock -> accumulator -= clock -> step)
+    {
+        steps++;
+    }
+
+    return steps;
+}
+
+Uint64 doCountFrame(frameClockClass* clock)
+{
+    Uint64 work = SDL_GetPerformanceCounter() - clock -> frameStart;
+
+    clock -> frames++;
+    clock -> drawCalls += drawCalls;
+    clock -> workTotal += work;
+    clock -> workWorst = SDL_max(clock -> workWorst, work);
+    drawCalls = 0;
+
+    return work;
+}
+
+void doPaceFrame(frameClockClass* clock)
+{
+    // sleep away what is left of the display interval, vsync or not
+    Uint64 work = doCountFrame(clock);
+
+    if (work + clock -> frequency / 1000 < clock -> budget)
+    {
+        SDL_Delay((Uint32)((clock -> budget - work) * 1000 / clock -> frequency) - 1);
+    }
+}
+
+void doReportFrameClock(const frameClockClass* clock)
+{
+    printf("frames: %llu drawn, %.1f draw calls each, work %.2f ms average, %.2f ms worst\n", (unsigned long long)clock -> frames, clock -> frames ? (double)clock -> drawCalls / clock -> frames : 0.0,
+           clock -> frames ? (double)clock -> workTotal * 1000.0 / clock -> frequency / clock -> frames : 0.0, (double)clock -> workWorst * 1000.0 / clock -> frequency);
+    printf("idle: %.1f s waiting on still screens, %llu frames skipped\n", clock -> idleNs / 1e9, (unsigned long long)clock -> idleFrames);
+}
+
+// the render thread draws its own copies of the game, never the one being simulated
+typedef struct {
+    gameClass game;
+    playerClass player;
+    enemyClass enemy;
+    uint64_t stamp; // when the tick that produced it was due
+    uint64_t ticks, searches;
+} snapshotClass;
+
+// one slot being written, one being drawn, and the latest finished one in between
+typedef struct {
+    snapshotClass slots[3];
+    int back, front;
+    SDL_atomic_t middle; // index of the middle slot, with SNAPSHOT_FRESH set until the reader takes it
+} tripleBufferClass;
+
+// keyboard commands from the main thread to the simulation, one producer and one consumer
+typedef struct {
+    unsigned char commands[INPUT_QUEUE];
+    uint64_t pressedNs[INPUT_QUEUE];
+    SDL_atomic_t head, tail;
+    SDL_mutex *lock; // only for a consumer asleep on an empty queue
+    SDL_cond *ready;
+} inputQueueClass;
+
+typedef struct {
+    gameClass game;
+    playerClass player;
+    enemyClass enemy;
+    tripleBufferClass snapshots;
+    inputQueueClass input;
+    streamClass *stream;
+    SDL_atomic_t isRunning;
+    Uint32 wakeEvent; // pushed to the render thread when the still picture changes or starts moving
+    uint64_t ticks, lateTicks, droppedTicks, worstLateness, idleNs;
+    speculationClass speculation; // the simulation thread's, once it has stopped
+} simulationClass;
+
+void doWakeInput(inputQueueClass* queue)
+{
+    if (queue -> lock)
+    {
+        SDL_LockMutex(queue -> lock);
+        SDL_CondSignal(queue -> ready);
+        SDL_UnlockMutex(queue -> lock);
+    }
+}
+
+void doWaitInput(inputQueueClass* queue, SDL_atomic_t* isRunning)
+{
+    SDL_LockMutex(queue -> lock);
+
+    while (SDL_AtomicGet(isRunning) && SDL_AtomicGet(&queue -> head) == SDL_AtomicGet(&queue -> tail))
+    {
+        SDL_CondWait(queue -> ready, queue -> lock);
+    }
+
+    SDL_UnlockMutex(queue -> lock);
+}
+
+SDL_bool doPushInput(inputQueueClass* queue, const unsigned char command, const uint64_t pressedNs)
+{
+    int tail = SDL_AtomicGet(&queue -> tail);
+
+    if (tail - SDL_AtomicGet(&queue -> head) == INPUT_QUEUE)
+    {
+        return SDL_FALSE;
+    }
+
+    queue -> commands[tail % INPUT_QUEUE] = command;
+    queue -> pressedNs[tail % INPUT_QUEUE] = pressedNs;
+    SDL_AtomicSet(&queue -> tail, tail + 1);
+    doWakeInput(queue);
+    return SDL_TRUE;
+}
+
+SDL_bool doPopInput(inputQueueClass* queue, unsigned char* command, uint64_t* pressedNs)
+{
+    int head = SDL_AtomicGet(&queue -> head);
+
+    if (head == SDL_AtomicGet(&queue -> tail))
+    {
+        return SDL_FALSE;
+    }
+
+    *command = queue -> commands[head % INPUT_QUEUE];
+    *pressedNs = queue -> pressedNs[head % INPUT_QUEUE];
+    SDL_AtomicSet(&queue -> head, head + 1);
+    return SDL_TRUE;
+}
+
+void doPublishSnapshot(simulationClass* sim, const uint64_t stamp)
+{
+    snapshotClass *slot = &sim -> snapshots.slots[sim -> snapshots.back];
+
+    doCopyGame(&slot -> game, &sim -> game);
+    doCopyEnemies(&slot -> enemy, &sim -> enemy);
+    slot -> player = sim -> player;
+    slot -> stamp = stamp;
+    slot -> ticks = sim -> ticks;
+    slot -> searches = pathSearches;
+
+    sim -> snapshots.back = SDL_AtomicSet(&sim -> snapshots.middle, sim -> snapshots.back | SNAPSHOT_FRESH) & 3;
+}
+
+SDL_bool doIsStill(const gameClass* game, const playerClass* player)
+{
+    // nothing moves on the game over screen, before the first key of a round, in the death pause or after a cleared maze
+    return game -> gameOver || !player -> isAlive || player -> curHeading == idle || doBallsLeft(game) == 0;
+}
+
+unsigned int doStillScreen(const gameClass* game, const playerClass* player)
+{
+    // 0 while anything moves, otherwise which still picture is up
+    if (!doIsStill(game, player))
+    {
+        return 0;
+    }
+
+    return 1 | game -> gameOver << 1 | player -> isAlive << 2 | game -> isRoundStarted << 3 | (doBallsLeft(game) == 0) << 4;
+}
+
+uint64_t doNextChangeNs(const snapshotClass* snapshot, const uint64_t now)
+{
+    // 0 while anything moves, UINT64_MAX on the game over screen, otherwise the next blink or sprite frame
+    uint64_t step = 1000000000ULL / TICK_RATE, frame, blink;
+
+    if (snapshot -> game.gameOver)
+    {
+        return UINT64_MAX;
+    }
+
+    if (!doIsStill(&snapshot -> game, &snapshot -> player))
+    {
+        return 0;
+    }
+
+    frame = snapshot -> stamp + (6 - snapshot -> game.tick % 6) * step;
+    blink = now + (100 - SDL_GetTicks() % 100) * 1000000ULL;
+
+    return SDL_min(SDL_max(frame, now), blink);
+}
+
+snapshotClass* doAcquireSnapshot(tripleBufferClass* buffer)
+{
+    if (SDL_AtomicGet(&buffer -> middle) & SNAPSHOT_FRESH)
+    {
+        buffer -> front = SDL_AtomicSet(&buffer -> middle, buffer -> front) & 3;
+    }
+
+    return &buffer -> slots[buffer -> front];
+}
+
+int doSimulationThread(void* data)
+{
+    // ticks keep their own schedule; after a long stall only MAX_CATCHUP_TICKS are made up
+    simulationClass *sim = data;
+    uint64_t step = 1000000000ULL / TICK_RATE, deadline = doMonotonicNs(), now, pressedNs;
+    unsigned char command;
+    struct timespec wake;
+    unsigned int wasStill = doStillScreen(&sim -> game, &sim -> player), isStill;
+    SDL_Event event = { .type = sim -> wakeEvent };
+
+    PROFILE_THREAD("simulation");
+    isRecordingPaths = pathStatsTable.isEnabled;
+
+    while (SDL_AtomicGet(&sim -> isRunning))
+    {
+        // the game over screen only ends on a key, so without subscribers there is nothing to tick for
+        if (sim -> game.gameOver && !sim -> stream)
+        {
+            now = doMonotonicNs();
+            doWaitInput(&sim -> input, &sim -> isRunning);
+            deadline = doMonotonicNs();
+            sim -> idleNs += deadline - now;
+        }
+
+        now = doMonotonicNs();
+
+        if (now > deadline + step * MAX_CATCHUP_TICKS)
+        {
+            sim -> droppedTicks += (now - deadline) / step - MAX_CATCHUP_TICKS;
+            deadline = now - step * MAX_CATCHUP_TICKS;
+        }
+
+        if (now > deadline + 1000000)
+        {
+            sim -> lateTicks++;
+            sim -> worstLateness = SDL_max(sim -> worstLateness, now - deadline);
+        }
+
+        while (doPopInput(&sim -> input, &command, &pressedNs))
+        {
+            doApplyCommand(&sim -> game, command, pressedNs);
+        }
+
+        doUpdateGame(NULL, NULL, &sim -> game, &sim -> player, &sim -> enemy);
+
+        if (sim -> stream)
+        {
+            doStreamTick(sim -> stream, &sim -> game, &sim -> player, &sim -> enemy);
+        }
+
+        doPublishSnapshot(sim, deadline);
+        doPersistScore(&sim -> game);
+        sim -> ticks++;
+        deadline += step;
+
+        // the render thread may be blocked on the previous still picture, so any change has to wake it,
+        // leaving the game over screen for the ready screen as much as starting to move
+        isStill = doStillScreen(&sim -> game, &sim -> player);
+
+        if (isStill != wasStill && wasStill && sim -> wakeEvent != (Uint32)-1)
+        {
+            SDL_PushEvent(&event);
+        }
+
+        wasStill = isStill;
+
+        wake.tv_sec = (time_t)(deadline / 1000000000ULL);
+        wake.tv_nsec = (long)(deadline % 1000000000ULL);
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wake, NULL) == EINTR);
+    }
+
+    sim -> speculation = speculation;
+    return 0;
+}
+
+SDL_bool doForwardEvent(inputQueueClass* input, const SDL_Event* event)
+{
+    switch (event -> type)
+    {
+        case SDL_WINDOWEVENT_CLOSE: case SDL_QUIT:
+            return SDL_TRUE;
+
+        case SDL_RENDER_TARGETS_RESET:
+            mazeLayer.isValid = hud.isValid = SDL_FALSE;
+        break;
+
+        case SDL_KEYDOWN:
+            switch (event -> key.keysym.sym)
+            {
+                case SDLK_ESCAPE:
+                    return SDL_TRUE;
+
+                case SDLK_SPACE:
+                    doPushInput(input, REMOTE_RESTART, doEventNs(event));
+                break;
+
+                case SDLK_UP:
+                    doPushInput(input, up, doEventNs(event));
+                break;
+
+                case SDLK_DOWN:
+                    doPushInput(input, down, doEventNs(event));
+                break;
+
+                case SDLK_LEFT:
+                    doPushInput(input, left, doEventNs(event));
+                break;
+
+                case SDLK_RIGHT:
+                    doPushInput(input, right, doEventNs(event));
+                break;
+            }
+        break;
+    }
+
+    return SDL_FALSE;
+}
+
+void doGameLoop(SDL_Window* window, SDL_Renderer* renderer, const int ghosts, const unsigned int autopilotMs, const int autopilotThreads, streamClass* stream)
+{
+    // the simulation runs on its own thread, this one only handles input and draws the latest snapshot
+    SDL_bool done = SDL_FALSE;
+    SDL_Event event;
+    SDL_Thread *thread;
+    frameClockClass clock;
+    snapshotClass *snapshot;
+    simulationClass sim;
+    telemetryWriterClass telemetry = { 0 };
+    uint64_t next, idleStart, waited;
+    int timeout;
+
+    memset(&sim, 0, sizeof(simulationClass));
+    doInitGame(&sim.game);
+    doAllocEnemies(&sim.enemy, ghosts);
+    doInitRound(&sim.game, &sim.player, &sim.enemy);
+    sim.game.isRemote = SDL_TRUE;
+    sim.game.autopilot = autopilotMs ? doCreateAutopilot(&sim.enemy, autopilotMs, autopilotThreads) : NULL;
+    sim.stream = stream;
+    sim.wakeEvent = SDL_RegisterEvents(1);
+    sim.input.lock = SDL_CreateMutex();
+    sim.input.ready = SDL_CreateCond();
+
+    doReadScore(&sim.game);
+    doOpenScoreWriter();
+    doRememberPositions(&sim.player, &sim.enemy);
+
+    for (int i = 0; i < 3; i++)
+    {
+        sim.snapshots.back = i;
+        doPublishSnapshot(&sim, doMonotonicNs());
+    }
+
+    sim.snapshots.back = 0;
+    sim.snapshots.front = 1;
+    SDL_AtomicSet(&sim.snapshots.middle, 2);
+    SDL_AtomicSet(&sim.isRunning, 1);
+
+    if (pathStatsTable.isEnabled)
+    {
+        doOpenPathStats(ghosts);
+    }
+
+    if (isTelemetryEnabled)
+    {
+        doOpenTelemetry(&telemetry);
+    }
+
+    PROFILE_THREAD("render");
+    thread = SDL_CreateThread(doSimulationThread, "simulation", &sim);
+    doStartFrameClock(window, &clock);
+    
+    while (!done)
+    {
+        clock.frameStart = SDL_GetPerformanceCounter();
+
+        while (SDL_PollEvent(&event))
+        {
+            done = doForwardEvent(&sim.input, &event) || done;
+        }
+
+        // drawn one tick behind the simulation, between the snapshot's last two positions
+        snapshot = doAcquireSnapshot(&sim.snapshots);
+        renderAlpha = SDL_min(1.0f, (float)(doMonotonicNs() - snapshot -> stamp) * TICK_RATE / 1e9f);
+        doDrawGame(renderer, &snapshot -> game, &snapshot -> player, &snapshot -> enemy);
+
+        PROFILE_BEGIN(phasePresent);
+        SDL_RenderPresent(renderer);
+        PROFILE_END(phasePresent);
+
+        if (!startup.firstFrame)
+        {
+            startup.firstFrame = doMonotonicNs();
+            doReportStartup();
+        }
+
+        doPublishTelemetry(&telemetry, &snapshot -> game, &snapshot -> enemy, snapshot -> ticks, snapshot -> searches);
+
+        next = doNextChangeNs(snapshot, doMonotonicNs());
+
+        if (!next || done)
+        {
+            doPaceFrame(&clock);
+            continue;
+        }
+
+        // a still picture is not drawn again until a key, the simulation or its next blink changes it
+        doCountFrame(&clock);
+        idleStart = doMonotonicNs();
+        next = telemetry.shared ? SDL_min(next, idleStart + TELEMETRY_PERIOD_NS) : next;
+        timeout = next == UINT64_MAX ? -1 : (int)((SDL_max(next, idleStart) - idleStart + 999999) / 1000000);
+
+        if (SDL_WaitEventTimeout(&event, timeout))
+        {
+            done = doForwardEvent(&sim.input, &event);
+        }
+
+        waited = doMonotonicNs() - idleStart;
+        clock.idleNs += waited;
+        clock.idleFrames += waited / SDL_max(1, clock.budget * 1000000000ULL / clock.frequency);
+    }
+
+    SDL_AtomicSet(&sim.isRunning, 0);
+    doWakeInput(&sim.input);
+    SDL_WaitThread(thread, NULL);
+    SDL_DestroyCond(sim.input.ready);
+    SDL_DestroyMutex(sim.input.lock);
+    doCloseTelemetry(&telemetry);
+
+    doReportFrameClock(&clock);
+    printf("simulation: %llu ticks, %llu late by over 1 ms (worst %.2f ms), %llu dropped, %.1f s asleep on game over\n", (unsigned long long)sim.ticks, (unsigned long long)sim.lateTicks, sim.worstLateness / 1e6, (unsigned long long)sim.droppedTicks, sim.idleNs / 1e9);
+    doReportTurns();
+    doReportSpeculation(&sim.speculation);
+
+    if (pathStatsTable.isEnabled)
+    {
+        doReportPathStats();
+        doClosePathStats();
+    }
+    
+    doCloseScoreWriter(&sim.game);
+
+    if (sim.game.autopilot)
+    {
+        doFreeAutopilot(sim.game.autopilot);
+    }
+
+    for (int i = 0; i < 3; i++)
+    {
+        doFreeEnemies(&sim.snapshots.slots[i].enemy);
+        doFreeGame(&sim.snapshots.slots[i].game);
+    }
+
+    doFreeEnemies(&sim.enemy);
+    doFreeGame(&sim.game);
+}
+
+void doSpectate(SDL_Window* window, SDL_Renderer* renderer, const char* source)
+{
+    // a live socket is drawn as fast as it arrives, a recording is replayed at the simulation rate
+    struct sockaddr_un address = { .sun_family = AF_UNIX };
+    struct stat info;
+    streamDecoderClass decoder = { 0 };
+    size_t capacity = STREAM_BUFFER + doStreamBufferSize(0), filled = 0, used;
+    unsigned char *buffer = doAllocate(capacity, 1);
+    SDL_bool done = SDL_FALSE, isLive = !stat(source, &info) && S_ISSOCK(info.st_mode), isEnded = SDL_FALSE;
+    SDL_Event event;
+    frameClockClass clock;
+    unsigned int steps, decoded;
+    ssize_t got;
+    FILE *file = NULL;
+    int fd = -1;
+
+    gameClass game;
+    playerClass player = { 0 };
+    enemyClass enemy = { 0 };
+
+    doInitGame(&game);
+
+    if (isLive)
+    {
+        strncpy(address.sun_path, source, sizeof(address.sun_path) - 1);
+        fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+
+        if (fd < 0 || connect(fd, (struct sockaddr*)&address, sizeof(address)))
+        {
+            fprintf(stderr, "Failed to connect to %s: %s\n", source, strerror(errno));
+            exit(6);
+        }
+    }
+    else if (!(file = fopen(source, "rb")))
+    {
+        fprintf(stderr, "Failed to open recording %s\n", source);
+        exit(6);
+    }
+
+    doStartFrameClock(window, &clock);
+
+    while (!done)
+    {
+        while (SDL_PollEvent(&event))
+        {
+            done = done || event.type == SDL_QUIT || (event.type == SDL_KEYDOWN && event.key.keysym.sym == SDLK_ESCAPE);
+            mazeLayer.isValid = mazeLayer.isValid && event.type != SDL_RENDER_TARGETS_RESET;
+            hud.isValid = hud.isValid && event.type != SDL_RENDER_TARGETS_RESET;
+        }
+
+        if (!isEnded && filled < capacity)
+        {
+            got = isLive ? recv(fd, buffer + filled, capacity - filled, MSG_DONTWAIT) : (ssize_t)fread(buffer + filled, 1, capacity - filled, file);
+
+            if (got > 0)
+            {
+                filled += (size_t)got;
+            }
+            else if (got == 0 || (errno != EAGAIN && errno != EWOULDBLOCK))
+            {
+                isEnded = SDL_TRUE;
+            }
+        }
+
+        steps = doFrameSteps(&clock);
+
+        for (used = 0, decoded = 0; used < filled && (isLive || decoded < steps); decoded++)
+        {
+            size_t at = used, size = (size_t)doGetVarint(buffer, &at, filled);
+
+            if (!size || at > filled || at + size > filled)
+            {
+                break;
+            }
+
+            doRememberPositions(&player, &enemy);
+            used += doDecodeMessage(&decoder, buffer + used, filled - used, &game, &player, &enemy);
+
+            if (decoder.isMalformed)
+            {
+                fprintf(stderr, "Malformed stream message after %llu messages\n", decoder.messages);
+                isEnded = SDL_TRUE;
+                used = filled;
+                break;
+            }
+        }
+
+        memmove(buffer, buffer + used, filled - used);
+        filled -= used;
+
+        if (decoder.hasKeyframe)
+        {
+            renderAlpha = isLive ? 1.0f : (float)clock.accumulator / clock.step;
+            doDrawGame(renderer, &game, &player, &enemy);
+
+            PROFILE_BEGIN(phasePresent);
+            SDL_RenderPresent(renderer);
+            PROFILE_END(phasePresent);
+        }
+
+        doPaceFrame(&clock);
+    }
+
+    printf("spectate: %llu messages, %llu keyframes, %.1f bytes/tick\n", decoder.messages, decoder.keyframes, decoder.messages ? (double)decoder.bytes / decoder.messages : 0.0);
+
+    if (file)
+    {
+        fclose(file);
+    }
+
+    if (fd >= 0)
+    {
+        close(fd);
+    }
+
+    if (enemy.count)
+    {
+        doFreeEnemies(&enemy);
+    }
+
+    doFreeGame(&game);
+    free(buffer);
+}
+
+void doDecodeRecording(const char* path)
+{
+    streamDecoderClass decoder = { 0 };
+    size_t capacity = STREAM_BUFFER + doStreamBufferSize(0), filled = 0, used, got, largest = 0;
+    unsigned char *buffer = doAllocate(capacity, 1);
+    FILE *file = fopen(path, "rb");
+
+    gameClass game;
+    playerClass player = { 0 };
+    enemyClass enemy = { 0 };
+
+    if (!file)
+    {
+        fprintf(stderr, "Failed to open recording %s\n", path);
+        exit(6);
+    }
+
+    doInitGame(&game);
+
+    while ((got = fread(buffer + filled, 1, capacity - filled, file)) > 0 || filled)
+    {
+        filled += got;
+
+        for (used = 0; used < filled; used += got)
+        {
+            if (!(got = doDecodeMessage(&decoder, buffer + used, filled - used, &game, &player, &enemy)))
+            {
+                break;
+            }
+
+            largest = SDL_max(largest, got);
+        }
+
+        if (decoder.isMalformed || (!used && (filled == capacity || feof(file))))
+        {
+            fprintf(stderr, "Malformed recording %s\n", path);
+            exit(6);
+        }
+
+        memmove(buffer, buffer + used, filled - used);
+        filled -= used;
+    }
+
+    printf("decode: %llu messages, %llu keyframes, %.1f bytes/tick, %zu bytes largest\n", decoder.messages, decoder.keyframes, decoder.messages ? (double)decoder.bytes / decoder.messages : 0.0, largest);
+    printf("final state: tick %u, score %u, lives %d, %d pellets, %d ghosts%s\n", game.tick, game.currentScore, game.playerLives, game.foodLeft, enemy.count, game.gameOver ? ", game over" : "");
+
+    fclose(file);
+
+    if (enemy.count)
+    {
+        doFreeEnemies(&enemy);
+    }
+
+    doFreeGame(&game);
+    free(buffer);
+}
+
+// OFFSCREEN VIDEO
+
+// headless games drawn on the canvas, one frame per tick and as fast as the CPU allows
+typedef struct {
+    gameClass game;
+    playerClass player;
+    enemyClass enemy;
+    unsigned int frame, overFrames;
+} videoGameClass;
+
+void doStartVideoGame(videoGameClass* video, const int ghosts, const unsigned int autopilotMs, const int autopilotThreads)
+{
+    memset(video, 0, sizeof(videoGameClass));
+    doSeedRandom(1);
+    doInitGame(&video -> game);
+    video -> game.isHeadless = SDL_TRUE;
+    doAllocEnemies(&video -> enemy, ghosts);
+    doInitRound(&video -> game, &video -> player, &video -> enemy);
+    video -> game.autopilot = autopilotMs ? doCreateAutopilot(&video -> enemy, autopilotMs, autopilotThreads) : NULL;
+}
+
+void doStepVideoGame(videoGameClass* video)
+{
+    // the game over screen stays up for two seconds of video, then a new game starts
+    if (video -> game.gameOver && ++video -> overFrames > 2 * TICK_RATE)
+    {
+        doApplyCommand(&video -> game, REMOTE_RESTART, 0);
+        video -> overFrames = 0;
+    }
+
+    doUpdateGame(NULL, NULL, &video -> game, &video -> player, &video -> enemy);
+    canvas.timeMs = (unsigned int)((uint64_t)video -> frame++ * 1000 / TICK_RATE);
+}
+
+void doEndVideoGame(videoGameClass* video)
+{
+    if (video -> game.autopilot)
+    {
+        doFreeAutopilot(video -> game.autopilot);
+    }
+
+    doFreeEnemies(&video -> enemy);
+    doFreeGame(&video -> game);
+}
+
+void doWriteY4mFrame(FILE* file, unsigned char* planes)
+{
+    // full resolution 4:4:4, BT.601 studio range
+    size_t count = (size_t)canvas.width * canvas.height;
+    const unsigned char *rgba = (const unsigned char*)canvas.pixels;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        int r = rgba[i * 4], g = rgba[i * 4 + 1], b = rgba[i * 4 + 2];
+
+        planes[i] = (unsigned char)(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+        planes[count + i] = (unsigned char)(((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+        planes[count * 2 + i] = (unsigned char)(((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+    }
+
+    fputs("FRAME\n", file);
+    fwrite(planes, 1, count * 3, file);
+}
+
+void doRenderVideo(const char* path, const unsigned int frames, const int ghosts, const unsigned int autopilotMs, const int autopilotThreads, const char* assetDir)
+{
+    // "-" and *.y4m get YUV4MPEG2, anything else raw RGBA frames
+    SDL_bool isStdout = !strcmp(path, "-"), isY4m = isStdout || (strlen(path) > 4 && !strcmp(path + strlen(path) - 4, ".y4m"));
+    FILE *file = isStdout ? fdopen(dup(STDOUT_FILENO), "wb") : fopen(path, "wb");
+    unsigned char *planes = NULL;
+    videoGameClass video;
+    uint64_t start;
+
+    if (!file)
+    {
+        fprintf(stderr, "Failed to open %s\n", path);
+        exit(6);
+    }
+
+    if (isStdout)
+    {
+        // the pipe carries nothing but video, reports go to stderr
+        dup2(STDERR_FILENO, STDOUT_FILENO);
+    }
+
+    doOpenCanvas(assetDir);
+    doStartVideoGame(&video, ghosts, autopilotMs, autopilotThreads);
+
+    if (pathStatsTable.isEnabled)
+    {
+        doOpenPathStats(ghosts);
+        isRecordingPaths = SDL_TRUE;
+    }
+
+    if (isY4m)
+    {
+        planes = doAllocate((size_t)canvas.width * canvas.height * 3, 1);
+        fprintf(file, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C444\n", canvas.width, canvas.height, TICK_RATE);
+    }
+
+    start = doMonotonicNs();
+
+    for (unsigned int f = 0; f < frames; f++)
+    {
+        doStepVideoGame(&video);
+        doDrawGame(NULL, &video.game, &video.player, &video.enemy);
+
+        if (isY4m)
+        {
+            doWriteY4mFrame(file, planes);
+        }
+        else
+        {
+            fwrite(canvas.pixels, sizeof(uint32_t), (size_t)canvas.width * canvas.height, file);
+        }
+    }
+
+    double seconds = (doMonotonicNs() - start) / 1e9;
+
+    fprintf(stderr, "video: %u frames of %dx%d in %.2f s, %.0f fps, %.1fx realtime\n", frames, canvas.width, canvas.height, seconds,
+        seconds > 0 ? frames / seconds : 0.0, seconds > 0 ? frames / seconds / TICK_RATE : 0.0);
+
+    fclose(file);
+    if (pathStatsTable.isEnabled)
+    {
+        doReportPathStats();
+        doClosePathStats();
+    }
+
+    free(planes);
+    doEndVideoGame(&video);
+    doCloseCanvas();
+}
+
+int doCheckMazeArt(const gameClass* game, const playerClass* player)
+{
+    // the canvas draws the artwork alone, and the middle of every pellet tile must be dark corridor there
+    int misplaced = 0, inset = SIZE_TILE / 10;
+
+    doRefreshScreen(NULL);
+    doUpdateCamera(player);
+    doDrawBackground(NULL, game);
+
+    for (int y = 0; y < maze.height; y++)
+    {
+        for (int x = 0; x < maze.width; x++)
+        {
+            int left = x * SIZE_TILE - cameraX, top = y * SIZE_TILE - cameraY;
+            SDL_bool isLit = SDL_FALSE;
+
+            if (doGetFood(game, doGetTile(x, y)) == noFood || left < 0 || top < 0 || left + SIZE_TILE > canvas.width || top + SIZE_TILE > VIEW_HEIGHT)
+            {
+                continue;
+            }
+
+            for (int py = top + inset; py < top + SIZE_TILE - inset && !isLit; py++)
+            {
+                for (int px = left + inset; px < left + SIZE_TILE - inset && !isLit; px++)
+                {
+                    const unsigned char *rgba = (const unsigned char*)&canvas.pixels[py * canvas.width + px];
+
+                    isLit = rgba[0] + rgba[1] + rgba[2] > 100;
+                }
+            }
+
+            misplaced += isLit;
+        }
+    }
+
+    printf("compare: %d pellet tiles on walls of the maze artwork\n", misplaced);
+    return misplaced;
+}
+
+int doCompareFrames(const unsigned int frames, const int ghosts, const char* assetDir)
+{
+    // every frame is drawn by SDL's software renderer and by the canvas, colour channels must agree
+    SDL_Surface *target = SDL_CreateRGBSurfaceWithFormat(0, SCREEN_WIDTH, SCREEN_HEIGHT, 32, SDL_PIXELFORMAT_ARGB8888);
+    SDL_Renderer *renderer = target ? SDL_CreateSoftwareRenderer(target) : NULL;
+    unsigned char *reference = doAllocate((size_t)SCREEN_WIDTH * SCREEN_HEIGHT, 4);
+    unsigned long long differing = 0, framesDiffering = 0;
+    int worst = 0, misplaced;
+    videoGameClass video;
+    uint32_t *pixels;
+
+    if (!renderer)
+    {
+        fprintf(stderr, "Failed to create software renderer: %s\n", SDL_GetError());
+        exit(3);
+    }
+
+    doLoadTextures(renderer, assetDir);
+    doOpenCanvas(assetDir);
+    doStartVideoGame(&video, ghosts, 0, 0);
+    pixels = canvas.pixels;
+    misplaced = maze.isBuiltIn ? doCheckMazeArt(&video.game, &video.player) : 0;
+
+    for (unsigned int f = 0; f < frames; f++)
+    {
+        const unsigned char *mine = (const unsigned char*)pixels;
+        unsigned long long before = differing;
+
+        doStepVideoGame(&video);
+
+        canvas.pixels = NULL;
+        doDrawGame(renderer, &video.game, &video.player, &video.enemy);
+        SDL_RenderReadPixels(renderer, NULL, SDL_PIXELFORMAT_RGBA32, reference, SCREEN_WIDTH * 4);
+
+        canvas.pixels = pixels;
+        doDrawGame(NULL, &video.game, &video.player, &video.enemy);
+
+        for (size_t i = 0; i < (size_t)SCREEN_WIDTH * SCREEN_HEIGHT; i++)
+        {
+            int difference = 0;
+
+            for (int c = 0; c < 3; c++)
+            {
+                difference = SDL_max(difference, abs(mine[i * 4 + c] - reference[i * 4 + c]));
+            }
+
+            differing += difference > 0;
+            worst = SDL_max(worst, difference);
         }
+
+        framesDiffering += differing > before;
     }
-    return SDL_FALSE;
+
+    printf("compare: %u frames, %llu differ in %llu pixels, worst channel difference %d\n", frames, framesDiffering, differing, worst);
+
+    doEndVideoGame(&video);
+    doCloseCanvas();
+    doFreeMazeLayer();
+    doFreeHud();
+    SDL_DestroyTexture(spriteAtlas.texture);
+    SDL_DestroyRenderer(renderer);
+    SDL_FreeSurface(target);
+    free(reference);
+
+    return differing || misplaced ? 1 : 0;
 }
 
-void doUpdatePlayerHeading(playerClass* player)
+// SERVER
+
+// every tick each session gets one frame: a header followed by its ghosts
+typedef struct {
+    uint32_t length, tick;
+    uint64_t stamp; // CLOCK_MONOTONIC nanoseconds at the start of the tick
+    uint32_t score, ballsLeft;
+    int16_t playerX, playerY;
+    uint16_t ghostCount;
+    uint8_t heading, lives, flags, padding[7];
+} frameHeaderClass;
+
+typedef struct {
+    int16_t posX, posY;
+    uint8_t state, heading;
+} frameGhostClass;
+
+#define FRAME_ALIVE 1
+#define FRAME_GAME_OVER 2
+
+typedef struct {
+    int fd;
+    gameClass game;
+    playerClass player;
+    enemyClass enemy;
+    unsigned char *out;
+    size_t outLength, outCapacity;
+    unsigned int dropped;
+} sessionClass;
+
+typedef struct {
+    int listenFd, epollFd, ghosts, workers;
+    sessionClass **sessions;
+    int count, capacity;
+    unsigned int job, busy, tick;
+    SDL_atomic_t nextBatch;
+    uint64_t stamp;
+    SDL_bool quit;
+    SDL_mutex *lock;
+    SDL_cond *wake, *done;
+    SDL_Thread **threads;
+} serverClass;
+
+volatile sig_atomic_t serverStop = 0;
+
+void doStopServer(int signal)
 {
-    switch (player -> newHeading) 
+    serverStop = signal;
+}
+
+size_t doBuildFrame(const sessionClass* session, const uint64_t stamp, unsigned char* buffer)
+{
+    frameHeaderClass header;
+    frameGhostClass *ghosts = (frameGhostClass*)(buffer + sizeof(frameHeaderClass));
+    const enemyClass *enemy = &session -> enemy;
+
+    memset(&header, 0, sizeof(header));
+    header.length = (uint32_t)(sizeof(frameHeaderClass) + enemy -> count * sizeof(frameGhostClass));
+    header.tick = session -> game.tick;
+    header.stamp = stamp;
+    header.score = session -> game.currentScore;
+    header.ballsLeft = doBallsLeft(&session -> game);
+    header.playerX = (int16_t)session -> player.posX;
+    header.playerY = (int16_t)session -> player.posY;
+    header.ghostCount = (uint16_t)enemy -> count;
+    header.heading = (uint8_t)session -> player.curHeading;
+    header.lives = (uint8_t)session -> game.playerLives;
+    header.flags = (session -> player.isAlive ? FRAME_ALIVE : 0) | (session -> game.gameOver ? FRAME_GAME_OVER : 0);
+    memcpy(buffer, &header, sizeof(header));
+
+    for (int i = 0; i < enemy -> count; i++)
     {
-        case up: 
-            if ( !(player -> newGridPos - 30) -> isWall)
-            {
-                player -> curHeading = up;
-            }
-        break;
+        frameGhostClass ghost = { (int16_t)enemy -> posX[i], (int16_t)enemy -> posY[i], (uint8_t)enemy -> state[i], (uint8_t)enemy -> heading[i] };
+        memcpy(&ghosts[i], &ghost, sizeof(ghost));
+    }
 
-        case down:
-            if ( !(player -> newGridPos + 30) -> isWall)
-            {
-                player -> curHeading = down;
-            }
-        break;
-        
-        case left:
-            if ( !(player -> newGridPos - 1) -> isWall)
-            {
-                player -> curHeading = left; 
-            }
-        break;
-        
-        case right:
-            if (!(player -> newGridPos + 1) -> isWall)
-            {
-                player -> curHeading = right;
-            }
-        break;
+    return header.length;
+}
 
-        case idle: 
-        break;
+SDL_bool doFlushSession(sessionClass* session)
+{
+    // non-blocking; whatever the socket does not take now waits for the next tick
+    while (session -> outLength)
+    {
+        ssize_t sent = send(session -> fd, session -> out, session -> outLength, MSG_NOSIGNAL | MSG_DONTWAIT);
+
+        if (sent <= 0)
+        {
+            return errno == EAGAIN || errno == EWOULDBLOCK;
+        }
+
+        memmove(session -> out, session -> out + sent, session -> outLength - (size_t)sent);
+        session -> outLength -= (size_t)sent;
     }
 
-    switch (player -> curHeading) 
+    return SDL_TRUE;
+}
+
+void doStepSession(sessionClass* session, const uint64_t stamp)
+{
+    doUpdateGame(NULL, NULL, &session -> game, &session -> player, &session -> enemy);
+
+    // a client that has not drained the last frame skips this one rather than queueing without bound
+    if (!doFlushSession(session) || session -> outLength)
     {
-        case up: 
-            if ( !(player -> newGridPos - 30) -> isWall)
-            {
-                player -> newGridPos -= 30;
-            }
-        break;
-        
-        case down:
-            if ( !(player -> newGridPos + 30) -> isWall)
-            {
-                player -> newGridPos += 30;
-            }
-        break;
-        
-        case left:
-            if ( !(player -> newGridPos - 1) -> isWall)
-            {
-                player -> newGridPos -= 1;
-            }
-        break; 
-        
-        case right:
-            if ( !(player -> newGridPos + 1) -> isWall)
-            {
-                player -> newGridPos += 1;
-            }
-        break;
+        session -> dropped++;
+        return;
+    }
 
-        case idle:
-        break;
+    session -> outLength = doBuildFrame(session, stamp, session -> out);
+    doFlushSession(session);
+}
+
+void doStepBatches(serverClass* server)
+{
+    // workers pull batches of sessions until none are left
+    int batch;
+
+    while ((batch = SDL_AtomicAdd(&server -> nextBatch, SERVER_BATCH)) < server -> count)
+    {
+        for (int i = batch; i < SDL_min(batch + SERVER_BATCH, server -> count); i++)
+        {
+            doStepSession(server -> sessions[i], server -> stamp);
+        }
     }
 }
 
-SDL_bool doPlayerMove(SDL_Window* window, SDL_Event* event, gameClass* game, playerClass* player)
-{  
-    SDL_bool tmp = SDL_FALSE;
-    
-    if (player -> isMoving == SDL_TRUE)
+int doServerWorker(void* data)
+{
+    serverClass *server = data;
+    unsigned int job = 0;
+
+    PROFILE_THREAD("server worker");
+    doSeedRandom(doMonotonicNs());
+    SDL_LockMutex(server -> lock);
+
+    while (1)
     {
-        if (player -> posX == player -> newGridPos -> gridX && player -> posY == player -> newGridPos -> gridY)
+        while (server -> job == job && !server -> quit)
         {
-            player -> curGridPos = player -> newGridPos;
-            player -> vector[0] = player -> vector[1] = 0;
-            tmp = doGetPlayerComand(window, event, game, player);
-            doUpdatePlayerHeading(player);
-        } 
-        else
+            SDL_CondWait(server -> wake, server -> lock);
+        }
+
+        if (server -> quit)
         {
-            player -> vector[0] = (int)(player -> newGridPos -> gridX - player -> curGridPos -> gridX) / SIZE_TILE ; // 1, -1, 0
-            player -> vector[1] = (int)(player -> newGridPos -> gridY - player -> curGridPos -> gridY) / SIZE_TILE ; // 1, -1, 0
-            player -> posX += player -> speed * (float)player -> vector[0];
-            player -> posY += player -> speed * (float)player -> vector[1];
+            break;
+        }
+
+        job = server -> job;
+        SDL_UnlockMutex(server -> lock);
+        doStepBatches(server);
+        SDL_LockMutex(server -> lock);
+
+        if (--server -> busy == 0)
+        {
+            SDL_CondSignal(server -> done);
         }
-        doTeleport(&player -> posX, &player -> posY, &player -> curGridPos, &player -> newGridPos, player -> curHeading);
-    } 
-    else
-    {
-        player -> newHeading = idle;
-        tmp = doGetPlayerComand(window, event, game, player);
     }
 
-    return tmp;
+    SDL_UnlockMutex(server -> lock);
+    return 0;
 }
 
-// ENEMY ROUTINES
+void doAcceptSessions(serverClass* server)
+{
+    int fd;
+
+    while ((fd = accept4(server -> listenFd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0)
+    {
+        sessionClass *session = doAllocate(1, sizeof(sessionClass));
+        struct epoll_event event = { .events = EPOLLIN, .data.ptr = session };
+
+        session -> fd = fd;
+        doInitGame(&session -> game);
+        session -> game.isRemote = SDL_TRUE;
+        doAllocEnemies(&session -> enemy, server -> ghosts);
+        doInitRound(&session -> game, &session -> player, &session -> enemy);
+        session -> outCapacity = sizeof(frameHeaderClass) + server -> ghosts * sizeof(frameGhostClass);
+        session -> out = doAllocate(session -> outCapacity, 1);
+
+        if (server -> count == server -> capacity)
+        {
+            server -> capacity = server -> capacity ? server -> capacity * 2 : 64;
+            server -> sessions = realloc(server -> sessions, server -> capacity * sizeof(sessionClass*));
 
-SDL_bool doSetTimer(const unsigned int time, enemyClass* enemy)
+            if (!server -> sessions)
+            {
+                fprintf(stderr, "Failed to allocate %zu bytes\n", server -> capacity * sizeof(sessionClass*));
+                exit(4);
+            }
+        }
+
+        server -> sessions[server -> count++] = session;
+        epoll_ctl(server -> epollFd, EPOLL_CTL_ADD, fd, &event);
+    }
+}
+
+void doCloseSession(serverClass* server, sessionClass* session)
 {
-    if (!enemy -> timeEnd)
+    for (int i = 0; i < server -> count; i++)
     {
-        enemy -> timeEnd = SDL_GetTicks() / 1000 + time;
+        if (server -> sessions[i] == session)
+        {
+            server -> sessions[i] = server -> sessions[--server -> count];
+            break;
+        }
     }
 
-    if (enemy -> timeEnd && enemy -> timeEnd - SDL_GetTicks() / 1000 < 3)
+    close(session -> fd);
+    doFreeEnemies(&session -> enemy);
+    doFreeGame(&session -> game);
+    free(session -> out);
+    free(session);
+}
+
+void doReadInput(serverClass* server, sessionClass* session)
+{
+    unsigned char input[64];
+    ssize_t length;
+
+    while ((length = recv(session -> fd, input, sizeof(input), MSG_DONTWAIT)) > 0)
     {
-        enemy -> isTimeAlmostEnd = SDL_TRUE;
+        for (ssize_t i = 0; i < length; i++)
+        {
+            doApplyCommand(&session -> game, input[i], 0);
+        }
     }
 
-    if (enemy -> timeEnd && enemy -> timeEnd == SDL_GetTicks() / 1000)
+    if (length == 0 || (errno != EAGAIN && errno != EWOULDBLOCK))
     {
-        enemy -> timeEnd = enemy -> isTimeAlmostEnd = 0;
-        return SDL_TRUE;
+        doCloseSession(server, session);
     }
+}
+
+int doCompareUint64(const void* a, const void* b)
+{
+    uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
 
-    return SDL_FALSE; 
+    return (x > y) - (x < y);
 }
 
-gridClass* doGetRandomLocation(enemyClass* enemy)
+void doRunServer(const char* path, const int ghosts, const int workers)
 {
-    gridClass *tmp = NULL;
-    int rowRand, colRand;
+    // the main thread owns the sockets and is worker 0 while a tick is stepped
+    serverClass server;
+    struct sockaddr_un address = { .sun_family = AF_UNIX };
+    struct epoll_event listenEvent = { .events = EPOLLIN, .data.ptr = NULL }, events[SERVER_EVENTS];
+    uint64_t tickNs = 1000000000ULL / TICK_RATE, nextTick = 0, stepNs[SERVER_STATS_TICKS];
+    unsigned long long dropped = 0;
+
+    memset(&server, 0, sizeof(server));
+    server.ghosts = ghosts;
+    server.workers = SDL_max(1, workers);
+    strncpy(address.sun_path, path, sizeof(address.sun_path) - 1);
+    unlink(path);
+
+    server.listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    server.epollFd = epoll_create1(EPOLL_CLOEXEC);
+
+    if (server.listenFd < 0 || server.epollFd < 0 || bind(server.listenFd, (struct sockaddr*)&address, sizeof(address)) || listen(server.listenFd, SOMAXCONN))
+    {
+        fprintf(stderr, "Failed to listen on %s: %s\n", path, strerror(errno));
+        exit(6);
+    }
+
+    epoll_ctl(server.epollFd, EPOLL_CTL_ADD, server.listenFd, &listenEvent);
+    signal(SIGINT, doStopServer);
+    signal(SIGTERM, doStopServer);
 
-    if (enemy -> state != home)
+    server.lock = SDL_CreateMutex();
+    server.wake = SDL_CreateCond();
+    server.done = SDL_CreateCond();
+    server.threads = doAllocate(server.workers, sizeof(SDL_Thread*));
+
+    for (int i = 1; i < server.workers; i++)
     {
-        do {
-            rowRand = rand() % (29 + 1 - 1) + 1;
-            colRand = rand() % (27 + 1 - 2) + 2;
-            tmp = &grid[rowRand][colRand];
-        } while (tmp -> isWall);
-    } 
-    else
+        server.threads[i] = SDL_CreateThread(doServerWorker, "session", &server);
+    }
+
+    printf("serving %s with %d workers, %d ghosts per session\n", path, server.workers, ghosts);
+    nextTick = doMonotonicNs();
+
+    while (!serverStop)
     {
-        rowRand = rand() % (15 + 1 - 13) + 13;
-        colRand = rand() % (17 + 1 - 12) + 12;
-        tmp = &grid[rowRand][colRand];
+        uint64_t now = doMonotonicNs();
+
+        // sockets are served until the tick is due, then every session steps once
+        if (now < nextTick)
+        {
+            int ready = epoll_wait(server.epollFd, events, SERVER_EVENTS, (int)((nextTick - now + 999999) / 1000000));
+
+            for (int i = 0; i < ready; i++)
+            {
+                events[i].data.ptr ? doReadInput(&server, events[i].data.ptr) : doAcceptSessions(&server);
+            }
+
+            continue;
+        }
+
+        server.stamp = now;
+        SDL_AtomicSet(&server.nextBatch, 0);
+        SDL_LockMutex(server.lock);
+        server.job++;
+        server.busy = server.workers - 1;
+        SDL_CondBroadcast(server.wake);
+        SDL_UnlockMutex(server.lock);
+
+        doStepBatches(&server);
+
+        SDL_LockMutex(server.lock);
+
+        while (server.busy)
+        {
+            SDL_CondWait(server.done, server.lock);
+        }
+
+        SDL_UnlockMutex(server.lock);
+
+        stepNs[server.tick % SERVER_STATS_TICKS] = doMonotonicNs() - now;
+        nextTick = SDL_max(nextTick + tickNs, now);
+
+        if (++server.tick % SERVER_STATS_TICKS == 0)
+        {
+            for (int i = 0; i < server.count; i++)
+            {
+                dropped += server.sessions[i] -> dropped;
+                server.sessions[i] -> dropped = 0;
+            }
+
+            qsort(stepNs, SERVER_STATS_TICKS, sizeof(uint64_t), doCompareUint64);
+            printf("tick %u: %d sessions, step p50 %.2f ms p99 %.2f ms, %llu frames dropped\n", server.tick, server.count, stepNs[SERVER_STATS_TICKS / 2] / 1e6, stepNs[SERVER_STATS_TICKS * 99 / 100] / 1e6, dropped);
+            fflush(stdout);
+        }
     }
 
-    return tmp;
-} 
+    SDL_LockMutex(server.lock);
+    server.quit = SDL_TRUE;
+    SDL_CondBroadcast(server.wake);
+    SDL_UnlockMutex(server.lock);
 
-void doEnemyScatter(enemyClass* enemy)
-{
-    if (enemy -> curGridPos != enemy -> scatterPointOne)
+    for (int i = 1; i < server.workers; i++)
     {
-        enemy -> target = enemy -> scatterPointOne;
+        SDL_WaitThread(server.threads[i], NULL);
     }
 
-    if (enemy -> curGridPos != enemy -> scatterPointTwo)
+    while (server.count)
     {
-        enemy -> target = enemy -> scatterPointTwo;
+        doCloseSession(&server, server.sessions[0]);
     }
+
+    close(server.listenFd);
+    close(server.epollFd);
+    unlink(path);
+    free(server.sessions);
+    free(server.threads);
+    SDL_DestroyCond(server.wake);
+    SDL_DestroyCond(server.done);
+    SDL_DestroyMutex(server.lock);
 }
 
-void doPinkySearch(const playerClass* player, enemyClass* enemy)
+// LOAD GENERATOR
+
+typedef struct {
+    int fd;
+    unsigned char *in;
+    size_t inLength;
+    unsigned int frames;
+} loadClientClass;
+
+double doProcessCpuSeconds(const pid_t pid)
 {
-    gridClass *tmp = player -> curGridPos; 
+    // utime and stime from /proc/<pid>/stat, fields 14 and 15
+    char path[64], line[1024], *tmp = NULL;
+    unsigned long utime = 0, stime = 0;
+    FILE *file = NULL;
 
-    switch (player -> curHeading)
+    snprintf(path, sizeof(path), "/proc/%d/stat", (int)pid);
+    file = fopen(path, "r");
+
+    if (!file)
     {
-        case up: 
-            tmp -= 90; 
-        break;
-        
-        case down: 
-            tmp += 90; 
-        break;
-        
-        case left: 
-            tmp -= 3; 
-        break;
-        
-        case right: 
-            tmp += 3; 
-        break;
-        
-        case idle: 
-        break;
+        return 0.0;
     }
 
-    !tmp -> isWall ? (enemy -> target = tmp) : (enemy -> target = player -> curGridPos);
-
-    if (enemy -> curGridPos == enemy -> target)
+    if (fgets(line, sizeof(line), file) && (tmp = strrchr(line, ')')))
     {
-        doEnemyScatter(enemy);
+        sscanf(tmp + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu", &utime, &stime);
     }
+
+    fclose(file);
+    return (double)(utime + stime) / (double)sysconf(_SC_CLK_TCK);
 }
 
-void doInkySearch(const playerClass* player, enemyClass* enemy)
+void doRunLoadGenerator(const char* path, const int sessions, const int seconds)
 {
-    float tmp = doDistance(player -> curGridPos, enemy -> curGridPos) / SIZE_TILE;
+    // many sessions from one thread; latency is frame arrival minus the server's tick start
+    struct sockaddr_un address = { .sun_family = AF_UNIX };
+    struct epoll_event events[SERVER_EVENTS];
+    loadClientClass *clients = doAllocate(sessions, sizeof(loadClientClass));
+    size_t latencyCount = 0, latencyCapacity = 1 << 16;
+    uint64_t *latency = doAllocate(latencyCapacity, sizeof(uint64_t));
+    int epollFd = epoll_create1(EPOLL_CLOEXEC);
+    pid_t serverPid = 0;
+    unsigned long long frames = 0;
+
+    strncpy(address.sun_path, path, sizeof(address.sun_path) - 1);
+
+    for (int i = 0; i < sessions; i++)
+    {
+        struct epoll_event event = { .events = EPOLLIN, .data.ptr = &clients[i] };
 
-    tmp <= 8 ? doEnemyScatter(enemy) : (enemy -> target = player -> curGridPos);
-}
+        clients[i].fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
 
-void doClydeSearch(const playerClass* player, const enemyClass* blinky, enemyClass* clyde)
-{
-    float coordX, coordY, dist;
-    gridClass* tmp1 = player -> curGridPos; 
+        if (clients[i].fd < 0 || connect(clients[i].fd, (struct sockaddr*)&address, sizeof(address)))
+        {
+            fprintf(stderr, "Failed to connect session %d to %s: %s\n", i, path, strerror(errno));
+            exit(6);
+        }
 
-    switch (player -> curHeading)
+        if (!serverPid)
+        {
+            struct ucred peer;
+            socklen_t length = sizeof(peer);
+
+            serverPid = getsockopt(clients[i].fd, SOL_SOCKET, SO_PEERCRED, &peer, &length) ? 0 : peer.pid;
+        }
+
+        clients[i].in = doAllocate(1 << 16, 1);
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, clients[i].fd, &event);
+    }
+
+    double cpuStart = doProcessCpuSeconds(serverPid);
+    uint64_t start = doMonotonicNs(), end = start + (uint64_t)seconds * 1000000000ULL;
+
+    while (doMonotonicNs() < end)
     {
-        case up: 
-            tmp1 -= 60; 
-        break;
-        
-        case down: 
-            tmp1 += 60; 
-        break;
-        
-        case left: 
-            tmp1 -= 2; 
-        break;
-        
-        case right: 
-            tmp1 += 2; 
-        break;
-        
-        case idle: 
-        break;
+        int ready = epoll_wait(epollFd, events, SERVER_EVENTS, 100);
+
+        for (int e = 0; e < ready; e++)
+        {
+            loadClientClass *client = events[e].data.ptr;
+            ssize_t length = recv(client -> fd, client -> in + client -> inLength, (1 << 16) - client -> inLength, MSG_DONTWAIT);
+            uint64_t now = doMonotonicNs();
+            size_t used = 0;
+
+            if (length <= 0)
+            {
+                continue;
+            }
+
+            client -> inLength += (size_t)length;
+
+            while (client -> inLength - used >= sizeof(frameHeaderClass))
+            {
+                frameHeaderClass header;
+
+                memcpy(&header, client -> in + used, sizeof(header));
+
+                if (client -> inLength - used < header.length)
+                {
+                    break;
+                }
+
+                if (latencyCount == latencyCapacity)
+                {
+                    latencyCapacity *= 2;
+                    latency = realloc(latency, latencyCapacity * sizeof(uint64_t));
+
+                    if (!latency)
+                    {
+                        fprintf(stderr, "Failed to allocate %zu bytes\n", latencyCapacity * sizeof(uint64_t));
+                        exit(4);
+                    }
+                }
+
+                latency[latencyCount++] = now - header.stamp;
+                used += header.length;
+                frames++;
+
+                // turn now and then, and get back into the game after a game over
+                if (++client -> frames % 15 == 0)
+                {
+                    unsigned char input = header.flags & FRAME_GAME_OVER ? REMOTE_RESTART : (unsigned char)(up + doRandom() % 4);
+                    send(client -> fd, &input, 1, MSG_NOSIGNAL | MSG_DONTWAIT);
+                }
+            }
+
+            memmove(client -> in, client -> in + used, client -> inLength - used);
+            client -> inLength -= used;
+        }
+    }
+
+    double wall = (double)(doMonotonicNs() - start) / 1e9;
+    double cores = (doProcessCpuSeconds(serverPid) - cpuStart) / wall;
+
+    qsort(latency, latencyCount, sizeof(uint64_t), doCompareUint64);
+    printf("%d sessions for %.1f s: %llu frames (%.0f/s, %.1f%% of ticks)\n", sessions, wall, frames, frames / wall, 100.0 * frames / (wall * TICK_RATE * sessions));
+
+    if (latencyCount)
+    {
+        printf("tick latency p50 %.3f ms, p99 %.3f ms, max %.3f ms\n", latency[latencyCount / 2] / 1e6, latency[latencyCount * 99 / 100] / 1e6, latency[latencyCount - 1] / 1e6);
     }
 
-    dist = doDistance(blinky -> curGridPos, tmp1);
-    coordX = tmp1 -> gridX - 2 * dist * (tmp1 -> gridX - blinky -> curGridPos -> gridX) / dist;
-    coordY = tmp1 -> gridY - 2 * dist * (tmp1 -> gridY - blinky -> curGridPos -> gridY) / dist;
+    printf("server used %.2f cores, %.0f sessions per core\n", cores, cores > 0.0 ? sessions / cores : 0.0);
 
-    if ( (coordX < SCREEN_WIDTH && coordX >= SIZE_TILE) && (coordY < SCREEN_HEIGHT && coordY >= SIZE_TILE) )
+    for (int i = 0; i < sessions; i++)
     {
-        gridClass* tmp2 = NULL;
+        close(clients[i].fd);
+        free(clients[i].in);
+    }
 
-        for (int y = 2; y < 33; y++)
-        {
-            for (int x = 0; x < 30; x++)
-            {
-                if (grid[y][x].gridX == coordX && grid[y][x].gridY == coordY) 
-                    tmp2 = &grid[y][x];
-            }
-        }
+    close(epollFd);
+    free(clients);
+    free(latency);
+}
 
-        if (tmp2 && !tmp2 -> isWall)
-        {
-            clyde -> target = tmp2;
-        }
+// BENCHMARKS
+
+void doBenchGhosts(const int maxGhosts)
+{
+    // headless bot games with a fixed seed, ghost count grows by four each round
+    printf("%8s %8s %12s %12s\n", "ghosts", "ticks", "us/tick", "ns/ghost");
+
+    for (int count = 4; count <= maxGhosts; count *= 4)
+    {
+        gameClass game;
+        playerClass player;
+        enemyClass enemy;
+
+        doSeedRandom(1);
+        doInitGame(&game);
+        game.isHeadless = SDL_TRUE;
+        doAllocEnemies(&enemy, count);
+        doInitRound(&game, &player, &enemy);
 
-        if (clyde -> curGridPos == tmp2)
+        Uint64 start = SDL_GetPerformanceCounter();
+
+        for (int t = 0; t < BENCH_TICKS; t++)
         {
-            doEnemyScatter(clyde);
+            doUpdateGame(NULL, NULL, &game, &player, &enemy);
         }
 
-    } else
-    {
-        clyde -> target = player -> curGridPos;
+        double elapsed = (double)(SDL_GetPerformanceCounter() - start) / (double)SDL_GetPerformanceFrequency();
+        double perTick = elapsed * 1e6 / BENCH_TICKS;
+
+        printf("%8d %8d %12.2f %12.2f\n", count, BENCH_TICKS, perTick, perTick * 1e3 / count);
+
+        doFreeEnemies(&enemy);
+        doFreeGame(&game);
     }
 }
 
-void doUpdateEnemyState(const gameClass* game, const playerClass* player, enemyClass* enemy)
+void doBenchAutopilot(const int games, const unsigned int budgetMs, const int threads)
 {
-    int time = 0;
-    game -> ballsLeft < 100 ? (time = 3) : (time = 7); 
+    // full headless games, won by clearing the level; the random bot plays the same seeds for reference
+    printf("%8s %8s %8s %12s %12s %16s\n", "player", "games", "wins", "win rate", "cpu ms/game", "win rate/cpu ms");
 
-    for (int i = 0; i < 4; i++)
+    for (int mode = 0; mode < 2; mode++)
     {
-        switch (enemy[i].state) 
+        int wins = 0;
+        clock_t start = clock();
+
+        for (int g = 0; g < games; g++)
         {
-            case home:
+            gameClass game;
+            playerClass player;
+            enemyClass enemy;
+
+            doSeedRandom((uint64_t)g + 1);
+            doInitGame(&game);
+            game.isHeadless = SDL_TRUE;
+            doAllocEnemies(&enemy, 4);
+            doInitRound(&game, &player, &enemy);
+            game.autopilot = mode ? doCreateAutopilot(&enemy, budgetMs, threads) : NULL;
+
+            for (unsigned int t = 0; t < BENCH_GAME_TICKS && !game.gameOver; t++)
+            {
+                doUpdateGame(NULL, NULL, &game, &player, &enemy);
 
-                if (game -> ballsLeft < 215)
+                if (!doBallsLeft(&game))
                 {
-                    enemy[i].state = scatter;
+                    wins++;
+                    break;
                 }
-                else 
-                {
-                    if (!enemy[i].isRandLocationSet)
-                    {
-                        enemy[i].target = doGetRandomLocation(&enemy[i]);
-                        enemy[i].isRandLocationSet = SDL_TRUE;
-                    }
+            }
 
-                    if (enemy[i].isRandLocationSet == SDL_TRUE && enemy[i].curGridPos == enemy[i].target)
-                    {
-                        enemy[i].isRandLocationSet = SDL_FALSE;
-                    }
-                }
-            break;
+            if (game.autopilot)
+            {
+                doFreeAutopilot(game.autopilot);
+            }
 
-            case scatter:   
-                doEnemyScatter(&enemy[i]); 
-                if (doSetTimer(time, &enemy[i])) 
-                {
-                    enemy[i].state = chase;
-                }
-            break;
-        
-            case chase:
-                switch (i)
-                {
-                    case blinky: 
-                        enemy[blinky].target = player -> curGridPos; 
-                    break;
-                    
-                    case pinky: 
-                        doPinkySearch(player, &enemy[pinky]); 
-                    break;
-                    
-                    case inky: 
-                        doInkySearch(player, &enemy[inky]); 
-                    break;
-                    
-                    case clyde: 
-                        doClydeSearch(player, &enemy[blinky], &enemy[clyde]); 
-                    break;
-                }
+            doFreeEnemies(&enemy);
+            doFreeGame(&game);
+        }
 
-                enemy[i].isRandLocationSet = SDL_FALSE;
+        double cpuMs = (double)(clock() - start) * 1000.0 / CLOCKS_PER_SEC / games;
+        double rate = (double)wins / games;
 
-                if (doSetTimer(20, &enemy[i])) 
-                {
-                    enemy[i].state = scatter;
-                }
-            break;
+        printf("%8s %8d %8d %12.2f %12.0f %16.6f\n", mode ? "mcts" : "random", games, wins, rate, cpuMs, rate / cpuMs);
+    }
+}
 
-            case frightened:
-                if (!enemy[i].isRandLocationSet) 
-                {
-                    enemy[i].target = doGetRandomLocation(&enemy[i]);
-                    enemy[i].isRandLocationSet = SDL_TRUE;
-                }
-        
-                if (enemy[i].isRandLocationSet && enemy[i].curGridPos == enemy[i].target) 
-                {
-                    enemy[i].isRandLocationSet = SDL_FALSE;
-                }
+// the suite behind make bench: fixed seeds, BENCH_TRIALS trials each, medians compared against a stored report
+typedef struct {
+    gameClass game;
+    playerClass player;
+    enemyClass enemy;
+} benchStateClass;
 
-                if (doSetTimer(time, &enemy[i])) 
-                {
-                    enemy[i].state = chase;
-                }
-            break;
+typedef struct {
+    benchStateClass *states; // BENCH_STATES ticks of a seeded bot game, replayed by the per-routine benchmarks
+    benchStateClass work;
+    gridClass **tiles;
+    int tileCount;
+    SDL_Surface *target;
+    SDL_Renderer *renderer;
+    uint64_t drawCalls;
+} benchSuiteClass;
 
-            case eaten:
-                enemy[i].target = &grid[14][14];
-                enemy[i].isRandLocationSet = SDL_FALSE; 
+typedef struct {
+    const char *name;
+    uint64_t (*run)(benchSuiteClass* suite, uint64_t* elapsedNs); // returns the operations done
+} benchCaseClass;
 
-                if (enemy[i].curGridPos == &grid[14][14]) 
-                {
-                    enemy[i].state = chase;
-                }
-            break;
-        }
-    }
+void doLoadBenchState(benchSuiteClass* suite, const int s)
+{
+    doCopyGame(&suite -> work.game, &suite -> states[s].game);
+    doCopyEnemies(&suite -> work.enemy, &suite -> states[s].enemy);
+    suite -> work.player = suite -> states[s].player;
 }
 
-void doUpdateEnemySpeed(gameClass* game, enemyClass* enemy)
+uint64_t doBenchPathPairs(benchSuiteClass* suite, uint64_t* elapsedNs)
 {
-    switch (enemy -> state) 
+    enemyClass *enemy = &suite -> work.enemy;
+    uint64_t start = doMonotonicNs();
+
+    enemy -> state[0] = frightened;
+    enemy -> heading[0] = idle;
+
+    for (int a = 0; a < suite -> tileCount; a++)
     {
-        case chase: case scatter: case home: 
-            game -> ballsLeft < 50 ? (enemy -> speed = 2.5f) : (enemy -> speed = 2.0f); 
-        break;
-        
-        case frightened: 
-            enemy -> speed = 0.5f; 
-        break;
-        
-        case eaten:
-            enemy -> speed = 4.0f; 
-        break;
+        enemy -> curGridPos[0] = suite -> tiles[a];
+
+        for (int b = 0; b < suite -> tileCount; b++)
+        {
+            enemy -> target[0] = suite -> tiles[b];
+            doPathFinding(enemy, 0);
+        }
     }
+
+    *elapsedNs = doMonotonicNs() - start;
+    return (uint64_t)suite -> tileCount * suite -> tileCount;
 }
 
-void doUpdateEnemyHeading(enemyClass* enemy)
+uint64_t doBenchInitNodes(benchSuiteClass* suite, uint64_t* elapsedNs)
 {
-    if (enemy -> vector[0] == 0 && enemy -> vector[1] < 0)
+    enemyClass *enemy = &suite -> work.enemy;
+    uint64_t start = doMonotonicNs();
+
+    for (int a = 0; a < suite -> tileCount; a++)
     {
-        enemy -> heading = up;
+        enemy -> curGridPos[0] = suite -> tiles[a];
+        enemy -> target[0] = suite -> tiles[suite -> tileCount - 1 - a];
+        doInitNodes(enemy, 0);
+        doListDelete();
     }
-    
-    if (enemy -> vector[0] == 0 && enemy -> vector[1] > 0)
+
+    *elapsedNs = doMonotonicNs() - start;
+    return (uint64_t)suite -> tileCount;
+}
+
+uint64_t doBenchEnemyState(benchSuiteClass* suite, uint64_t* elapsedNs)
+{
+    for (int s = 0; s < BENCH_STATES; s++)
     {
-        enemy -> heading = down;
+        doLoadBenchState(suite, s);
+        uint64_t start = doMonotonicNs();
+        doUpdateEnemyState(&suite -> work.game, &suite -> work.player, &suite -> work.enemy);
+        *elapsedNs += doMonotonicNs() - start;
     }
-    
-    if (enemy -> vector[0] < 0 && enemy -> vector[1] == 0)
+
+    return BENCH_STATES;
+}
+
+uint64_t doBenchEnemyMove(benchSuiteClass* suite, uint64_t* elapsedNs)
+{
+    for (int s = 0; s < BENCH_STATES; s++)
     {
-        enemy -> heading = left;
+        doLoadBenchState(suite, s);
+        uint64_t start = doMonotonicNs();
+        doEnemyMove(&suite -> work.game, &suite -> work.player, &suite -> work.enemy);
+        *elapsedNs += doMonotonicNs() - start;
     }
 
-    if (enemy -> vector[0] > 0 && enemy -> vector[1] == 0)
+    return BENCH_STATES;
+}
+
+uint64_t doBenchGameTicks(benchSuiteClass* suite, uint64_t* elapsedNs)
+{
+    uint64_t start;
+
+    doSeedRandom(1);
+    doLoadBenchState(suite, 0);
+    start = doMonotonicNs();
+
+    for (int t = 0; t < BENCH_TICKS; t++)
     {
-        enemy -> heading = right;
+        doUpdateGame(NULL, NULL, &suite -> work.game, &suite -> work.player, &suite -> work.enemy);
     }
+
+    *elapsedNs = doMonotonicNs() - start;
+    return BENCH_TICKS;
 }
 
-void doEnemyMove(gameClass* game, const playerClass* player, enemyClass* enemy)
+uint64_t doBenchDraw(benchSuiteClass* suite, uint64_t* elapsedNs)
 {
-    for (int i = 0; i < 4; i++)
-    {  
-        if (!enemy[i].isMoving)
-        {   
-            doPathFinding(&enemy[i]);
+    // the software renderer rasterises as well, so this is the cost of a frame's draw calls end to end
+    uint64_t start = doMonotonicNs();
 
-            nodeClass *tmp = nodeEnd;
-            while (tmp != nodeStart)
-            {
-                enemy[i].newGridPos = tmp -> gridPtr; 
-                tmp = tmp -> nodeParent;
-            }
+    drawCalls = 0;
 
-            enemy[i].vector[0] = (int)(enemy[i].newGridPos -> gridX - enemy[i].curGridPos -> gridX) / SIZE_TILE; // 1, -1, 0
-            enemy[i].vector[1] = (int)(enemy[i].newGridPos -> gridY - enemy[i].curGridPos -> gridY) / SIZE_TILE; // 1, -1, 0
-            enemy[i].isMoving = SDL_TRUE;
-            doUpdateEnemyHeading(&enemy[i]);
-        }
-    
-        // after enemy move is finished, we update his position and state
-        if (enemy[i].posX == enemy[i].newGridPos -> gridX && enemy[i].posY == enemy[i].newGridPos -> gridY)
-        {
-            enemy[i].isMoving = SDL_FALSE;
-            enemy[i].curGridPos = enemy[i].newGridPos;
-            enemy[i].vector[0] = enemy[i].vector[1] = 0;
-            doUpdateEnemySpeed(game, &enemy[i]);
-        } else 
-        {
-            enemy[i].posX += enemy[i].speed * (float)enemy[i].vector[0]; 
-            enemy[i].posY += enemy[i].speed * (float)enemy[i].vector[1];
-        }
-        doTeleport(&enemy[i].posX, &enemy[i].posY, &enemy[i].curGridPos, &enemy[i].newGridPos, enemy[i].heading);
+    for (int s = 0; s < BENCH_STATES; s++)
+    {
+        benchStateClass *state = &suite -> states[s];
+        doDrawGame(suite -> renderer, &state -> game, &state -> player, &state -> enemy);
     }
+
+    *elapsedNs = doMonotonicNs() - start;
+    suite -> drawCalls = drawCalls;
+    return BENCH_STATES;
 }
 
-// GLOBAL EVENTS THAT AFFECT BOTH PLAYER AND ENEMY
+const benchCaseClass benchCases[] = {
+    { "path_all_pairs", doBenchPathPairs },
+    { "init_nodes", doBenchInitNodes },
+    { "enemy_state", doBenchEnemyState },
+    { "enemy_move", doBenchEnemyMove },
+    { "game_tick", doBenchGameTicks },
+    { "draw_frame", doBenchDraw },
+};
 
-void doEatFood(gameClass* game, playerClass* player, enemyClass* enemy)
+void doOpenBenchSuite(benchSuiteClass* suite, const char* assetDir)
 {
-    if (player -> curGridPos -> food == smallBall)
+    memset(suite, 0, sizeof(benchSuiteClass));
+    suite -> target = SDL_CreateRGBSurfaceWithFormat(0, SCREEN_WIDTH, SCREEN_HEIGHT, 32, SDL_PIXELFORMAT_ARGB8888);
+    suite -> renderer = suite -> target ? SDL_CreateSoftwareRenderer(suite -> target) : NULL;
+
+    if (!suite -> renderer)
     {
-        player -> curGridPos -> food = noFood;
-        game -> currentScore += 10;   
-        game -> ballsLeft--; 
-    } 
-    else if (player -> curGridPos -> food == largeBall)
+        fprintf(stderr, "Failed to create software renderer: %s\n", SDL_GetError());
+        exit(3);
+    }
+
+    doLoadTextures(suite -> renderer, assetDir);
+    suite -> tiles = doAllocate((size_t)maze.width * maze.height, sizeof(gridClass*));
+
+    for (int y = 0; y < maze.height; y++)
     {
-        player -> curGridPos -> food = noFood;
-        game -> currentScore += 100;
-        game -> ballsLeft--;
-        for (int i = 0; i < 4; i++)
+        for (int x = 0; x < maze.width; x++)
         {
-            if (enemy[i].state != eaten)
+            if (doIsWalkable(doGetTile(x, y)))
             {
-                enemy[i].state = frightened;
-                enemy[i].timeEnd = enemy[i].isTimeAlmostEnd = 0;
+                suite -> tiles[suite -> tileCount++] = doGetTile(x, y);
             }
         }
     }
-}
-
-// PROCESS ENCOUNTERS
 
-SDL_bool doCollisionBox(const playerClass* player, const enemyClass* enemy)
-{
-    SDL_bool checkX = SDL_FALSE;
-    SDL_bool checkY = SDL_FALSE;
+    suite -> states = doAllocate(BENCH_STATES, sizeof(benchStateClass));
+    doSeedRandom(1);
+    doInitGame(&suite -> work.game);
+    suite -> work.game.isHeadless = SDL_TRUE;
+    doAllocEnemies(&suite -> work.enemy, 4);
+    doInitRound(&suite -> work.game, &suite -> work.player, &suite -> work.enemy);
 
-    checkX = fabsf(player -> posX - enemy -> posX) * 2.0f < (float)(SIZE_TILE * 2); 
-    checkY = fabsf(player -> posY - enemy -> posY) * 2.0f < (float)(SIZE_TILE * 2); 
-    
-    if (checkX && checkY)
+    // only ticks where the ghosts move are kept, the others never reach the routines being measured
+    for (int s = 0; s < BENCH_STATES; doUpdateGame(NULL, NULL, &suite -> work.game, &suite -> work.player, &suite -> work.enemy))
     {
-        return SDL_TRUE;
+        if (suite -> work.game.isRoundStarted && !doIsStill(&suite -> work.game, &suite -> work.player))
+        {
+            doCopyGame(&suite -> states[s].game, &suite -> work.game);
+            doCopyEnemies(&suite -> states[s].enemy, &suite -> work.enemy);
+            suite -> states[s++].player = suite -> work.player;
+        }
     }
-    
-    return SDL_FALSE;
 }
 
-void doCheckEncounter(gameClass* game, playerClass* player, enemyClass* enemy)
+void doCloseBenchSuite(benchSuiteClass* suite)
 {
-    for (int i = 0; i < 4; i++)
+    for (int s = 0; s < BENCH_STATES; s++)
     {
-        if (doCollisionBox(player, &enemy[i]))
-        {
-            if (enemy[i].state == frightened)
-            {
-                enemy[i].state = eaten;
-                game -> currentScore += 100;
-            }
-            
-            if (enemy[i].state == scatter || enemy[i].state == chase)
-            {
-                player -> isAlive = SDL_FALSE;
-            }
-        }
+        doFreeEnemies(&suite -> states[s].enemy);
+        doFreeGame(&suite -> states[s].game);
     }
+
+    doFreeEnemies(&suite -> work.enemy);
+    doFreeGame(&suite -> work.game);
+    doFreeMazeLayer();
+    doFreeHud();
+    SDL_DestroyTexture(spriteAtlas.texture);
+    SDL_DestroyRenderer(suite -> renderer);
+    SDL_FreeSurface(suite -> target);
+    free(suite -> states);
+    free(suite -> tiles);
 }
 
-// GAME PAUSE
+double doReadBaseline(const char* text, const char* name)
+{
+    // the report's own layout, one "name": { ... "median_ns": x ... } per benchmark
+    char key[64];
+    const char *at;
+    double value = 0.0;
 
-SDL_bool doGamePause(gameClass* game, const unsigned int time)
+    snprintf(key, sizeof(key), "\"%s\":", name);
+    at = text ? strstr(text, key) : NULL;
+    at = at ? strstr(at, "\"median_ns\":") : NULL;
+
+    if (!at || sscanf(at + strlen("\"median_ns\":"), "%lf", &value) != 1)
+    {
+        return 0.0;
+    }
+
+    return value;
+}
+
+int doRunBenchSuite(const char* reportPath, const char* baselinePath, const double tolerance, const char* assetDir)
 {
-    if (!game -> timeDelay)
+    // exits 1 when any median is slower than the baseline's by more than tolerance percent
+    int cases = (int)(sizeof(benchCases) / sizeof(benchCaseClass)), regressions = 0;
+    benchSuiteClass suite;
+    FILE *report = fopen(reportPath, "w"), *file = baselinePath ? fopen(baselinePath, "r") : NULL;
+    char *baseline = NULL;
+    long size;
+
+    if (!report)
     {
-        game -> timeDelay = SDL_GetTicks() / 1000 + time;
+        fprintf(stderr, "Failed to open %s: %s\n", reportPath, strerror(errno));
+        exit(6);
     }
 
-    if (game -> timeDelay && game -> timeDelay == SDL_GetTicks() / 1000)
+    if (file && !fseek(file, 0, SEEK_END) && (size = ftell(file)) > 0 && !fseek(file, 0, SEEK_SET))
     {
-        game -> timeDelay = 0;
-        return SDL_TRUE;
+        baseline = doAllocate((size_t)size + 1, 1);
+        baseline[fread(baseline, 1, (size_t)size, file)] = '\0';
     }
-    
-    return SDL_FALSE;
-}
 
-// INIT CHARACTERS
+    if (file)
+    {
+        fclose(file);
+    }
 
-void doInitPlayer(playerClass* player)
-{
-    player -> isAlive = SDL_TRUE; 
-    player -> speed = 4.0f; 
-    player -> posX = grid[23][14].gridX; 
-    player -> posY = grid[23][14].gridY;
-    player -> curGridPos = player -> newGridPos = &grid[23][14]; 
-    player -> vector[0] = player -> vector[1] = 0;
-    player -> curHeading = player -> newHeading = idle;
-    player -> pacmanTextureCrop.x = player -> pacmanTextureCrop.y = 0; 
-    player -> pacmanTextureCrop.w = player -> pacmanTextureCrop.h = 32; 
-    player -> killTextureCrop.x = player -> killTextureCrop.y = 0; 
-    player -> killTextureCrop.w = player -> killTextureCrop.h = 32; 
-    player -> timeFrame = 0;
-}
+    doOpenBenchSuite(&suite, assetDir);
+    printf("%-16s %10s %12s %12s %12s %8s\n", "benchmark", "ops", "median ns", "min ns", "baseline", "change");
+    fprintf(report, "{\n  \"trials\": %d,\n  \"seed\": 1,\n  \"tiles\": %d,\n  \"benchmarks\": {\n", BENCH_TRIALS, suite.tileCount);
 
-void doInitEnemy(enemyClass* enemy)
-{
-    for (int i = 0; i < 4; i++)
+    for (int c = 0; c < cases; c++)
     {
-        enemy[i].target = NULL;
-        enemy[i].speed = 2.5f;
-        enemy[i].vector[0] = enemy[i].vector[1] = 0;
-        enemy[i].ghostTextureCrop.x = enemy[i].ghostTextureCrop.y = 0;
-        enemy[i].ghostTextureCrop.w = enemy[i].ghostTextureCrop.h = 32;
-        enemy[i].isMoving = enemy[i].isRandLocationSet = enemy[i].isTimeAlmostEnd = SDL_FALSE;  
-        enemy[i].timeEnd = 0;
+        double perOp[BENCH_TRIALS], median, best, reference;
+        uint64_t ops = 0;
 
-        switch (i) 
+        for (int t = 0; t < BENCH_TRIALS; t++)
         {
-            case blinky:
-                enemy[i].heading = up;
-                enemy[i].state = scatter;
-                enemy[i].posX = grid[11][14].gridX;
-                enemy[i].posY = grid[11][14].gridY;
-                enemy[i].curGridPos = enemy[i].newGridPos = &grid[11][14];
-                enemy[i].scatterPointOne = &grid[5][27];
-                enemy[i].scatterPointTwo = &grid[1][22];
-            break;
-        
-            case pinky:
-                enemy[i].heading = left;
-                enemy[i].state = home;
-                enemy[i].posX = grid[14][13].gridX;
-                enemy[i].posY = grid[14][13].gridY;
-                enemy[i].curGridPos = enemy[i].newGridPos = &grid[14][13];
-                enemy[i].scatterPointOne = &grid[1][7];
-                enemy[i].scatterPointTwo = &grid[5][2];
-            break;
-
-            case inky:
-                enemy[i].heading = down;
-                enemy[i].state = home;
-                enemy[i].posX = grid[14][14].gridX;
-                enemy[i].posY = grid[14][14].gridY;
-                enemy[i].curGridPos = enemy[i].newGridPos = &grid[14][14];
-                enemy[i].scatterPointOne = &grid[23][7];
-                enemy[i].scatterPointTwo = &grid[29][8];
-            break;
+            uint64_t elapsed = 0;
 
-            case clyde:
-                enemy[i].heading = right;
-                enemy[i].state = home;
-                enemy[i].posX = grid[14][15].gridX;
-                enemy[i].posY = grid[14][15].gridY;
-                enemy[i].curGridPos = enemy[i].newGridPos = &grid[14][15];
-                enemy[i].scatterPointOne = &grid[23][22];
-                enemy[i].scatterPointTwo = &grid[29][21];
-            break;
+            doSeedRandom(1);
+            ops = benchCases[c].run(&suite, &elapsed);
+            perOp[t] = (double)elapsed / (double)ops;
         }
-    }
-}
 
-// INIT GRID
-
-void doInitGrid(void) 
-{
-    int gridWallInit[33][30] = { 
-        { 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1 },
-        { 1, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 1 },
-        { 1, 1, 0, 1, 1, 1, 1, 0, 1, 1, 1, 1, 1, 0, 1, 1, 0, 1, 1, 1, 1, 1, 0, 1, 1, 1, 1, 0, 1, 1 },
-        { 1, 1, 0, 1, 1, 1, 1, 0, 1, 1, 1, 1, 1, 0, 1, 1, 0, 1, 1, 1, 1, 1, 0, 1, 1, 1, 1, 0, 1, 1 },
-        { 1, 1, 0, 1, 1, 1, 1, 0, 1, 1, 1, 1, 1, 0, 1, 1, 0, 1, 1, 1, 1, 1, 0, 1, 1, 1, 1, 0, 1, 1 },
-        { 1, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 1 },
-        { 1, 1, 0, 1, 1, 1, 1, 0, 1, 1, 0, 1, 1, 1, 1, 1, 1, 1, 1, 0, 1, 1, 0, 1, 1, 1, 1, 0, 1, 1 },
-        { 1, 1, 0, 1, 1, 1, 1, 0, 1, 1, 0, 1, 1, 1, 1, 1, 1, 1, 1, 0, 1, 1, 0, 1, 1, 1, 1, 0, 1, 1 },
-        { 1, 1, 0, 0, 0, 0, 0, 0, 1, 1, 0, 0, 0, 0, 1, 1, 0, 0, 0, 0, 1, 1, 0, 0, 0, 0, 0, 0, 1, 1 },
-        { 1, 1, 1, 1, 1, 1, 1, 0, 1, 1, 1, 1, 1, 0, 1, 1, 0, 1, 1, 1, 1, 1, 0, 1, 1, 1, 1, 1, 1, 1 },
-        { 1, 1, 1, 1, 1, 1, 1, 0, 1, 1, 1, 1, 1, 0, 1, 1, 0, 1, 1, 1, 1, 1, 0, 1, 1, 1, 1, 1, 1, 1 },
-        { 1, 1, 1, 1, 1, 1, 1, 0, 1, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 0, 1, 1, 1, 1, 1, 1, 1 },
-        { 1, 1, 1, 1, 1, 1, 1, 0, 1, 1, 0, 1, 1, 1, 0, 0, 1, 1, 1, 0, 1, 1, 0, 1, 1, 1, 1, 1, 1, 1 },
-        { 1, 1, 1, 1, 1, 1, 1, 0, 1, 1, 0, 1, 0, 0, 0, 0, 0, 0, 1, 0, 1, 1, 0, 1, 1, 1, 1, 1, 1, 1 },
-        { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
-        { 1, 1, 1, 1, 1, 1, 1, 0, 1, 1, 0, 1, 0, 0, 0, 0, 0, 0, 1, 0, 1, 1, 0, 1, 1, 1, 1, 1, 1, 1 },
-        { 1, 1, 1, 1, 1, 1, 1, 0, 1, 1, 0, 1, 1, 1, 1, 1, 1, 1, 1, 0, 1, 1, 0, 1, 1, 1, 1, 1, 1, 1 },
-        { 1, 1, 1, 1, 1, 1, 1, 0, 1, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 0, 1, 1, 1, 1, 1, 1, 1 },
-        { 1, 1, 1, 1, 1, 1, 1, 0, 1, 1, 0, 1, 1, 1, 1, 1, 1, 1, 1, 0, 1, 1, 0, 1, 1, 1, 1, 1, 1, 1 },
-        { 1, 1, 1, 1, 1, 1, 1, 0, 1, 1, 0, 1, 1, 1, 1, 1, 1, 1, 1, 0, 1, 1, 0, 1, 1, 1, 1, 1, 1, 1 },
-        { 1, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 1 },
-        { 1, 1, 0, 1, 1, 1, 1, 0, 1, 1, 1, 1, 1, 0, 1, 1, 0, 1, 1, 1, 1, 1, 0, 1, 1, 1, 1, 0, 1, 1 },
-        { 1, 1, 0, 1, 1, 1, 1, 0, 1, 1, 1, 1, 1, 0, 1, 1, 0, 1, 1, 1, 1, 1, 0, 1, 1, 1, 1, 0, 1, 1 },
-        { 1, 1, 0, 0, 0, 1, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 0, 0, 0, 1, 1 },
-        { 1, 1, 1, 1, 0, 1, 1, 0, 1, 1, 0, 1, 1, 1, 1, 1, 1, 1, 1, 0, 1, 1, 0, 1, 1, 0, 1, 1, 1, 1 },
-        { 1, 1, 1, 1, 0, 1, 1, 0, 1, 1, 0, 1, 1, 1, 1, 1, 1, 1, 1, 0, 1, 1, 0, 1, 1, 0, 1, 1, 1, 1 },
-        { 1, 1, 0, 0, 0, 0, 0, 0, 1, 1, 0, 0, 0, 0, 1, 1, 0, 0, 0, 0, 1, 1, 0, 0, 0, 0, 0, 0, 1, 1 },
-        { 1, 1, 0, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 1, 1, 0, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 1, 1 },
-        { 1, 1, 0, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 1, 1, 0, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 1, 1 },
-        { 1, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 1 },
-        { 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1 },
-        { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
-        { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
-    };
+        qsort(perOp, BENCH_TRIALS, sizeof(double), doCompareDouble);
+        median = perOp[BENCH_TRIALS / 2];
+        best = perOp[0];
+        reference = doReadBaseline(baseline, benchCases[c].name);
 
-    int gridFoodlInit[33][30] = { 
-        { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 }, 
-        { 0, 0, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0 }, 
-        { 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 1, 0, 0, 1, 0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0 }, 
-        { 0, 0, 2, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 1, 0, 0, 1, 0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 2, 0, 0 }, 
-        { 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 1, 0, 0, 1, 0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0 }, 
-        { 0, 0, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0 }, 
-        { 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0 }, 
-        { 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0 }, 
-        { 0, 0, 1, 1, 1, 1, 1, 1, 0, 0, 1, 1, 1, 1, 0, 0, 1, 1, 1, 1, 0, 0, 1, 1, 1, 1, 1, 1, 0, 0 }, 
-        { 0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0 }, 
-        { 0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0 }, 
-        { 0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0 }, 
-        { 0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0 }, 
-        { 0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0 }, 
-        { 0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0 }, 
-        { 0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0 }, 
-        { 0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0 }, 
-        { 0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0 }, 
-        { 0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0 }, 
-        { 0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0 }, 
-        { 0, 0, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0 }, 
-        { 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 1, 0, 0, 1, 0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0 }, 
-        { 0, 0, 2, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 1, 0, 0, 1, 0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 2, 0, 0 }, 
-        { 0, 0, 1, 1, 1, 0, 0, 1, 1, 1, 1, 1, 1, 1, 0, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 1, 1, 1, 0, 0 }, 
-        { 0, 0, 0, 0, 1, 0, 0, 1, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 1, 0, 0, 1, 0, 0, 0, 0 }, 
-        { 0, 0, 0, 0, 1, 0, 0, 1, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 1, 0, 0, 1, 0, 0, 0, 0 }, 
-        { 0, 0, 1, 1, 1, 1, 1, 1, 0, 0, 1, 1, 1, 1, 0, 0, 1, 1, 1, 1, 0, 0, 1, 1, 1, 1, 1, 1, 0, 0 }, 
-        { 0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0, 0 }, 
-        { 0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0, 0 }, 
-        { 0, 0, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0 },
-        { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 }, 
-        { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
-        { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
-    };
+        SDL_bool isRegression = reference > 0.0 && median > reference * (1.0 + tolerance / 100.0);
+        regressions += isRegression;
 
-    for (int y = 0; y < 33; y++)
-    {
-        for (int x = 0; x < 30; x++) 
+        printf("%-16s %10llu %12.1f %12.1f %12.1f %+7.1f%%%s\n", benchCases[c].name, (unsigned long long)ops, median, best, reference,
+               reference > 0.0 ? (median / reference - 1.0) * 100.0 : 0.0, isRegression ? "  SLOWER" : "");
+        fprintf(report, "    \"%s\": { \"ops\": %llu, \"median_ns\": %.1f, \"min_ns\": %.1f", benchCases[c].name, (unsigned long long)ops, median, best);
+
+        if (benchCases[c].run == doBenchDraw)
         {
-            if (x == 0) 
-            {
-                grid[y][x].gridX = (float) -SIZE_TILE;
-            }
-            else 
-            {
-                grid[y][x].gridX = (float) x * SIZE_TILE - SIZE_TILE; 
-            }
-            grid[y][x].gridY = (float) y * SIZE_TILE;
-            grid[y][x].food = gridFoodlInit[y][x];
-            grid[y][x].isWall = gridWallInit[y][x];
+            fprintf(report, ", \"draw_calls\": %.1f", (double)suite.drawCalls / BENCH_STATES);
         }
+
+        fprintf(report, " }%s\n", c + 1 < cases ? "," : "");
     }
-}
 
-// RENDER ROUTINES
+    fprintf(report, "  }\n}\n");
+    fclose(report);
+    doCloseBenchSuite(&suite);
 
-void doRefreshScreen(SDL_Renderer* renderer)
-{
-    SDL_SetRenderDrawColor(renderer, 0, 0, 0, 0);
-    SDL_RenderClear(renderer);
+    if (!baseline)
+    {
+        printf("bench: no baseline%s%s, report written to %s\n", baselinePath ? " at " : "", baselinePath ? baselinePath : "", reportPath);
+        return 0;
+    }
+
+    free(baseline);
+    printf("bench: %d of %d benchmarks slower than the baseline by over %.0f%%\n", regressions, cases, tolerance);
+
+    return regressions ? 1 : 0;
 }
 
-void doDrawBackground(SDL_Renderer* renderer, const gameClass* game, SDL_Texture* mazeTexture)
+// SOAK TEST
+
+long doResidentKb(void)
 {
-    SDL_Rect maze = { 0, 0, SCREEN_WIDTH, SCREEN_HEIGHT - SIZE_TILE * 2};
+    long pages = 0, resident = 0;
+    FILE *file = fopen("/proc/self/statm", "r");
 
-    if (game -> ballsLeft > 0)
+    if (file)
     {
-        SDL_RenderCopy(renderer, mazeTexture, NULL, &maze);
-    }
-    else
-    {
-        if (SDL_GetTicks() / 100 % 2)
-        {
-            SDL_RenderCopy(renderer, mazeTexture, NULL, &maze);
-        }
-        else
+        if (fscanf(file, "%ld %ld", &pages, &resident) != 2)
         {
-            SDL_Rect noMaze = { 0, 0, SCREEN_WIDTH, SCREEN_HEIGHT - SIZE_TILE * 2 }; 
-            SDL_RenderDrawRect(renderer, &noMaze);
+            resident = 0;
         }
-    }
-}
-
-void doDrawFood(SDL_Renderer* renderer, SDL_Texture* foodTexture)
-{
-    for (int y = 0; y < 33; y++)
-    {
-        for (int x = 0; x < 30; x++)
-        {   
-            if (grid[y][x].food)
-            {
-                SDL_Rect foodTextureCrop = { 0, 0, 32, 32 };
-                SDL_Rect foodTexturePosition = { (int)( grid[y][x].gridX - SIZE_TILE * 0.25f ), (int)( grid[y][x].gridY - SIZE_TILE * 0.25f ), 32, 32 };
-
-                switch (grid[y][x].food)
-                {
-                    case smallBall: 
-                        foodTextureCrop.x = 32; 
-                    break;
-                    
-                    case largeBall: 
-                        foodTextureCrop.x = 0; 
-                    break;
-                    
-                    case noFood: 
-                    break;
-                }    
 
-                SDL_RenderCopy(renderer, foodTexture, &foodTextureCrop, &foodTexturePosition);
-            }
-        }
+        fclose(file);
     }
+
+    return resident * (sysconf(_SC_PAGESIZE) / 1024);
 }
 
-void doDrawPacman(SDL_Renderer* renderer, playerClass* player, SDL_Texture* pacmanTexture)
+const char* doCheckInvariants(const gameClass* game, const playerClass* player, const enemyClass* enemy, stateName* states)
 {
-    SDL_Rect pacmanTexturePosition = { (int)( player -> posX - SIZE_TILE * 0.25f ), (int)( player -> posY - SIZE_TILE * 0.25f ), 32, 32 }; 
+    // a tick can chain a timer, a large pellet and an encounter, so scatter may turn into eaten at once;
+    // a new round puts everyone back in scatter or home
+    static const unsigned char allowed[6] = {
+        [scatter] = 1 << scatter | 1 << chase | 1 << frightened | 1 << eaten,
+        [chase] = 1 << chase | 1 << scatter | 1 << frightened | 1 << eaten,
+        [frightened] = 1 << frightened | 1 << chase | 1 << eaten,
+        [eaten] = 1 << eaten | 1 << chase,
+        [home] = 1 << home | 1 << scatter | 1 << frightened | 1 << eaten,
+    };
+    static char message[128];
 
-    switch (player -> curHeading)
+    if (game -> foodLeft != doCountFood(game -> foodSmall) + doCountFood(game -> foodLarge))
     {
-        case up: 
-            player -> pacmanTextureCrop.y = 96; 
-        break;
-        
-        case down: 
-            player -> pacmanTextureCrop.y = 32; 
-        break;
-        
-        case left: 
-            player -> pacmanTextureCrop.y = 64; 
-        break;
-        
-        case right: case idle: 
-            player -> pacmanTextureCrop.y = 0; 
-        break;
+        snprintf(message, sizeof(message), "%u pellets counted, %u in the bitsets", game -> foodLeft, doCountFood(game -> foodSmall) + doCountFood(game -> foodLarge));
+        return message;
     }
 
-    player -> timeFrame++;
+    if (!doIsWalkable(player -> curGridPos) || !doIsWalkable(player -> newGridPos))
+    {
+        return "player off the walkable tiles";
+    }
 
-    if (30 / player -> timeFrame == 5)
+    for (int i = 0; i < enemy -> count; i++)
     {
-        player -> pacmanTextureCrop.x += 32;
-        player -> timeFrame = 0;
+        stateName state = enemy -> state[i];
+
+        if (!doIsWalkable(enemy -> curGridPos[i]) || !doIsWalkable(enemy -> newGridPos[i]))
+        {
+            snprintf(message, sizeof(message), "ghost %d off the walkable tiles", i);
+            return message;
+        }
 
-        if (player -> pacmanTextureCrop.x >= 128)
+        if (state < scatter || state > home || (!(allowed[states[i]] & 1 << state) && (game -> isRoundStarted || (state != scatter && state != home))))
         {
-            player -> pacmanTextureCrop.x = 0;
+            snprintf(message, sizeof(message), "ghost %d went from state %d to %d", i, states[i], state);
+            return message;
         }
+
+        states[i] = state;
     }
 
-    SDL_RenderCopy(renderer, pacmanTexture, &player -> pacmanTextureCrop, &pacmanTexturePosition);
+    return NULL;
 }
 
-void doDrawGhosts(SDL_Renderer* renderer, const playerClass* player, enemyClass* enemy, SDL_Texture* ghostTexture)
+int doRunSoak(const double minutes, const unsigned int sampleSeconds, const int ghosts)
 {
-    for (int i = 0; i < 4; i++)
+    // headless bot games back to back; fails on a broken invariant, or when the last sample is
+    // SOAK_DECAY slower or SOAK_GROWTH_KB bigger than the first
+    gameClass game;
+    playerClass player;
+    enemyClass enemy;
+    telemetryWriterClass telemetry = { 0 };
+    stateName *states = doAllocate(ghosts, sizeof(stateName));
+    uint64_t start = doMonotonicNs(), end = start + (uint64_t)(minutes * 60e9), sampleStart = start, now = start;
+    uint64_t ticks = 0, sampleTicks = 0, sampleSearches = 0, levels = 0, gamesOver = 0;
+    unsigned int level = 1;
+    SDL_bool wasOver = SDL_FALSE;
+    double firstRate = 0.0, lastRate = 0.0;
+    long firstKb = 0, lastKb = 0;
+    int samples = 0;
+    const char *broken = NULL;
+
+    doSeedRandom(1);
+    doInitGame(&game);
+    game.isHeadless = SDL_TRUE;
+    doAllocEnemies(&enemy, ghosts);
+    doInitRound(&game, &player, &enemy);
+    memcpy(states, enemy.state, ghosts * sizeof(stateName));
+
+    if (isTelemetryEnabled)
     {
-        SDL_Rect ghostTexturePosition = { (int)( enemy[i].posX - SIZE_TILE * 0.25f ), (int)( enemy[i].posY - SIZE_TILE * 0.25f ), 32, 32 };
+        doOpenTelemetry(&telemetry);
+    }
+
+    printf("soak: seed 1, %d ghosts, %.1f minutes, a sample every %u s\n", ghosts, minutes, sampleSeconds);
 
-        switch (enemy[i].state)
+    while (!broken && now < end)
+    {
+        // the random bot never clears a maze, so every so often the pellets vanish to put it through a level change
+        if (game.tick % SOAK_CLEAR_TICKS == 0 && player.isAlive && game.isRoundStarted)
         {
-            case home: case scatter: case chase:
-                enemy[i].ghostTextureCrop.y = 32 * i;
-            break;
-        
-            case eaten:
-                enemy[i].ghostTextureCrop.y = 128;
-            break;
+            memset(game.foodSmall, 0, maze.foodWords * sizeof(uint64_t));
+            memset(game.foodLarge, 0, maze.foodWords * sizeof(uint64_t));
+            game.foodLeft = 0;
+        }
 
-            case frightened:
-                enemy[i].ghostTextureCrop.y = 160;
+        doUpdateGame(NULL, NULL, &game, &player, &enemy);
+        broken = doCheckInvariants(&game, &player, &enemy, states);
+        ticks++;
 
-                if (enemy[i].isTimeAlmostEnd && SDL_GetTicks() / 100 % 2)
-                {
-                    enemy[i].ghostTextureCrop.x = 64;
-                }
-                else 
-                {
-                    enemy[i].ghostTextureCrop.x = 0; 
-                }
-            break;
-        }
+        levels += game.level > level;
+        gamesOver += game.gameOver && !wasOver;
+        level = game.level;
+        wasOver = game.gameOver;
 
-        if (enemy[i].state != frightened)
+        if (ticks % 1024)
         {
-            switch (enemy[i].heading)
-            {   
-                case up: 
-                    enemy[i].ghostTextureCrop.x = 192; 
-                break;
-                
-                case down: 
-                    enemy[i].ghostTextureCrop.x = 64; 
-                break;
-                
-                case left: 
-                    enemy[i].ghostTextureCrop.x = 128; 
-                break;
-                
-                case right: case idle: 
-                    enemy[i].ghostTextureCrop.x = 0; 
-                break;
-            }
+            continue;
         }
 
-        if (enemy[i].state != eaten && player -> curHeading != idle) 
+        now = doMonotonicNs();
+        doPublishTelemetry(&telemetry, &game, &enemy, ticks, pathSearches);
+
+        if (now - sampleStart < sampleSeconds * 1000000000ULL)
         {
-            if (SDL_GetTicks() / 100 % 2)
-            {
-                enemy[i].ghostTextureCrop.x += 32;
-            }
+            continue;
         }
 
-        SDL_RenderCopy(renderer, ghostTexture, &enemy[i].ghostTextureCrop, &ghostTexturePosition);
-    }
-}
-
-void doDrawPacmanKill(SDL_Renderer* renderer, gameClass* game, playerClass* player, SDL_Texture* pacmanTexture, SDL_Texture *killTexture)
-{
-    if ( (game -> timeDelay - SDL_GetTicks() / 1000) > 2)
-    {
-        SDL_Rect pacmanTexturePosition = { (int)( player -> posX - SIZE_TILE * 0.25f ), (int)( player -> posY - SIZE_TILE * 0.25f ), 32, 32 }; 
-        SDL_RenderCopy(renderer, pacmanTexture, &player -> pacmanTextureCrop, &pacmanTexturePosition);
-    } 
-    else
-    {
-        SDL_Rect killTexturePosition = { (int)( player -> posX - SIZE_TILE * 0.25f ), (int)( player -> posY - SIZE_TILE * 0.25f ), 32, 32 };
-        player -> timeFrame++;
+        lastRate = (double)(ticks - sampleTicks) * 1e9 / (double)(now - sampleStart);
+        lastKb = doResidentKb();
+        firstRate = samples ? firstRate : lastRate;
+        firstKb = samples ? firstKb : lastKb;
+        samples++;
 
-        if (30 / player -> timeFrame == 5)
-        {
-            player -> killTextureCrop.x += 32;
-            player -> timeFrame = 0;
-        }   
+        printf("soak: %6.1f min %12llu ticks %10.0f ticks/s %8ld KB rss %8llu levels %8llu games over %10.0f searches/s\n", (now - start) / 60e9, (unsigned long long)ticks, lastRate, lastKb,
+               (unsigned long long)levels, (unsigned long long)gamesOver, (double)(pathSearches - sampleSearches) * 1e9 / (double)(now - sampleStart));
+        fflush(stdout);
 
-        SDL_RenderCopy(renderer, killTexture, &player -> killTextureCrop, &killTexturePosition);
+        sampleStart = now;
+        sampleTicks = ticks;
+        sampleSearches = pathSearches;
     }
-}  
 
-void doDrawLives(SDL_Renderer* renderer, gameClass* game, SDL_Texture* pacmanTexture)
-{
-    for (int i = 0, m = 0; i < game -> playerLives; i++, m += SIZE_TILE + SIZE_TILE / 4)
+    doCloseTelemetry(&telemetry);
+    doFreeEnemies(&enemy);
+    doFreeGame(&game);
+    free(states);
+
+    if (broken)
     {
-        SDL_Rect livesTextureCrop = { 32, 0, 32, 32 }; 
-        SDL_Rect livesTexturePosition = { (int)( grid[31][3].gridX - SIZE_TILE * 0.5f + m ), (int)( grid[32][3].gridY - SIZE_TILE * 0.5f ), SIZE_TILE, SIZE_TILE };
-        SDL_RenderCopy(renderer, pacmanTexture, &livesTextureCrop, &livesTexturePosition);
+        printf("soak: FAILED at tick %u: %s\n", game.tick, broken);
+        return 1;
     }
-}
 
-void doDrawScore(SDL_Renderer* renderer, gameClass* game, SDL_Texture* numbersTexture)
-{ 
-    unsigned int tmp = 0, offsetX, score;
-    
-    // draw current score   
-    offsetX = 120;
-    score = game -> currentScore;
-
-    while (score)
+    if (samples > 1 && lastRate < firstRate * (1.0 - SOAK_DECAY))
     {
-        tmp = score % 10;
-        SDL_Rect numbersTextureCrop = { tmp * 12, 0, 12, 20 };
-        SDL_Rect numbersTexturePosition = { (int)( grid[31][10].gridX + offsetX ), (int)( grid[31][10].gridY + SIZE_TILE * 0.5f ), 12, 20 };
-        SDL_RenderCopy(renderer, numbersTexture, &numbersTextureCrop, &numbersTexturePosition);
-        offsetX -= 12;
-        score /= 10;
+        printf("soak: FAILED, throughput fell from %.0f to %.0f ticks/s\n", firstRate, lastRate);
+        return 1;
     }
-    
-    // draw highest score
-    offsetX = 120;
-    score = game -> highestScore;
 
-    while (score)
+    if (samples > 1 && lastKb > firstKb + SOAK_GROWTH_KB)
     {
-        tmp = score % 10;
-        SDL_Rect numbersTextureCrop = { tmp * 12, 20, 12, 20 };
-        SDL_Rect numbersTexturePosition = { (int)( grid[31][21].gridX + offsetX ), (int)( grid[31][21].gridY + SIZE_TILE * 0.5f ), 12, 20 };
-        SDL_RenderCopy(renderer, numbersTexture, &numbersTextureCrop, &numbersTexturePosition);
-        offsetX -= 12;
-        score /= 10;
+        printf("soak: FAILED, resident memory grew from %ld to %ld KB\n", firstKb, lastKb);
+        return 1;
     }
 
+    doReportSpeculation(&speculation);
+    printf("soak: passed, %llu ticks, %llu levels cleared, %llu games over\n", (unsigned long long)ticks, (unsigned long long)levels, (unsigned long long)gamesOver);
+    return 0;
 }
 
-void doDrawTextReady(SDL_Renderer* renderer, SDL_Texture* readyTexture)
+int doCheckTurn(const char* name, const SDL_bool isPassed)
 {
-    SDL_Rect ready = { (int)( grid[17][12].gridX + 10 ), (int)( grid[17][12].gridY - 3 ), 100, 25 };
-    SDL_RenderCopy(renderer, readyTexture, NULL, &ready);
+    printf("test-turns: %-40s %s\n", name, isPassed ? "ok" : "FAILED");
+    return !isPassed;
 }
 
-void doDrawTextGameOver(SDL_Renderer* renderer, SDL_Texture* gameOverTexture)
+int doRunTurnTests(void)
 {
-    SDL_Rect gameOver = { (int)( grid[15][11].gridX + 6 ), (int)( grid[15][11].gridY - 3 ), 150, 25 };
-    SDL_RenderCopy(renderer, gameOverTexture, NULL, &gameOver);
-}
+    // the turn buffer on the loaded maze: a corridor tile with no way up and a tile that opens upwards
+    gameClass game;
+    playerClass player = { 0 };
+    gridClass *corridor = NULL, *junction = NULL;
+    int failed = 0;
 
-// SDL2 INIT
-
-void doInitEngine(SDL_Window** window, SDL_Renderer** renderer)
-{
-    if (SDL_Init(SDL_INIT_VIDEO)) 
-    {
-        fprintf(stderr, "Failed to initialize SDL2 library: %s\n", SDL_GetError());
-        exit(1);
-    }
-    
-    *window = SDL_CreateWindow(WINDOW_TITLE, SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, SCREEN_WIDTH, SCREEN_HEIGHT, 0);
-    if (!*window) 
-    {
-        fprintf(stderr, "Failed to create window: %s\n", SDL_GetError());
-        exit(2);
-    }
-        
-    *renderer = SDL_CreateRenderer  (*window, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
-    if (!*renderer) 
+    for (int y = 0; y < maze.height && (!corridor || !junction); y++)
     {
-        fprintf(stderr, "Failed to create renderer: %s\n", SDL_GetError());
-        exit(3);
-    }
-}
-
-// TRACKING THE HIGHEST SCORE
+        for (int x = 0; x < maze.width; x++)
+        {
+            gridClass *cell = doGetTile(x, y);
 
-void doReadScore(gameClass* game)
-{
-    FILE *tmp = fopen("score", "r");
+            if (doIsWalkable(cell) && doIsWalkable(doGetStep(cell, left)) && doIsWalkable(doGetStep(cell, right)))
+            {
+                if (doIsWalkable(doGetStep(cell, up)))
+                {
+                    junction = junction ? junction : cell;
+                }
+                else
+                {
+                    corridor = corridor ? corridor : cell;
+                }
+            }
+        }
+    }
 
-    if (tmp)
+    if (!corridor || !junction)
     {
-        game -> highestScore = getw(tmp); 
+        printf("test-turns: FAILED, the maze needs a left-right corridor with and without a way up\n");
+        return 1;
     }
 
-    fclose(tmp);
+    doInitGame(&game);
+    game.tick = 100;
+
+    // up has no opening, the reverse pressed after it must not wait behind it
+    player.newGridPos = corridor;
+    doQueueTurn(&game, up, 0);
+    game.tick++;
+    doQueueTurn(&game, right, 0);
+    doTakeTurn(&game, &player);
+    failed += doCheckTurn("blocked turn then reverse", player.newHeading == right && !game.turnCount);
+
+    // a blocked turn on its own is kept for the junction ahead
+    doQueueTurn(&game, up, 0);
+    doTakeTurn(&game, &player);
+    failed += doCheckTurn("blocked turn waits", player.newHeading == idle && game.turnCount == 1);
+    player.newGridPos = junction;
+    game.tick += turnWindowTicks / 2;
+    doTakeTurn(&game, &player);
+    failed += doCheckTurn("blocked turn taken at the junction", player.newHeading == up && !game.turnCount);
+
+    // and dropped once it is older than the window
+    player.newGridPos = corridor;
+    doQueueTurn(&game, up, 0);
+    game.tick += turnWindowTicks + 1;
+    player.newGridPos = junction;
+    doTakeTurn(&game, &player);
+    failed += doCheckTurn("stale turn expires", player.newHeading == idle && !game.turnCount);
+
+    doFreeGame(&game);
+    printf("test-turns: %s\n", failed ? "FAILED" : "passed");
+    return failed ? 1 : 0;
 }
 
-void doWriteScore(gameClass* game)
-{
-    FILE *tmp = fopen("score", "w");
-    putw(game -> highestScore, tmp);
-    fclose(tmp);
-}
+// MAIN ROUTINES
 
-void doCheckScore(gameClass* game)
+int main(int argc, char* argv[])
 {
-    if (game -> currentScore > game -> highestScore)
+    SDL_Window *window = NULL;
+    SDL_Renderer *renderer = NULL;
+    const char *mazePath = NULL, *packPath = NULL, *serverPath = NULL, *loadPath = NULL;
+    const char *streamPath = NULL, *recordPath = NULL, *spectatePath = NULL, *assetDir = NULL, *videoPath = NULL;
+    const char *benchReport = NULL, *benchBaseline = NULL;
+    double benchTolerance = BENCH_TOLERANCE, soakMinutes = 0.0;
+    unsigned int soakSample = 60;
+    SDL_bool isTestingTurns = SDL_FALSE;
+    streamClass *stream = NULL;
+    int serverWorkers = SDL_GetCPUCount(), loadSessions = 0, loadSeconds = 0;
+    int ghosts = 4, benchGhosts = 0, benchAutopilot = 0, autopilotThreads = SDL_GetCPUCount();
+    unsigned int autopilotMs = 0, videoFrames = 0, compareFrames = 0;
+
+    startup.start = doMonotonicNs();
+
+#ifdef PROFILE
+    profileOrigin = startup.start;
+    atexit(doProfileReport);
+#endif
+
+    for (int i = 1; i < argc; i++)
     {
-        game -> highestScore = game -> currentScore;
-    }    
-}
+        if (!strcmp(argv[i], "--ghosts") && i + 1 < argc)
+        {
+            ghosts = atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "--maze") && i + 1 < argc)
+        {
+            mazePath = argv[++i];
+        }
+        else if (!strcmp(argv[i], "--compile-maze") && i + 1 < argc)
+        {
+            packPath = argv[++i];
+        }
+        else if (!strcmp(argv[i], "--generate-maze") && i + 3 < argc)
+        {
+            doGenerateMaze(atoi(argv[i + 1]), atoi(argv[i + 2]), argv[i + 3]);
+            return 0;
+        }
+        else if (!strcmp(argv[i], "--autopilot"))
+        {
+            autopilotMs = i + 1 < argc && atoi(argv[i + 1]) > 0 ? (unsigned int)atoi(argv[++i]) : 20;
+        }
+        else if (!strcmp(argv[i], "--autopilot-threads") && i + 1 < argc)
+        {
+            autopilotThreads = atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "--bench-autopilot"))
+        {
+            benchAutopilot = i + 1 < argc && atoi(argv[i + 1]) > 0 ? atoi(argv[++i]) : 10;
+        }
+        else if (!strcmp(argv[i], "--server") && i + 1 < argc)
+        {
+            serverPath = argv[++i];
+        }
+        else if (!strcmp(argv[i], "--server-workers") && i + 1 < argc)
+        {
+            serverWorkers = atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "--loadgen") && i + 3 < argc)
+        {
+            loadPath = argv[i + 1];
+            loadSessions = atoi(argv[i + 2]);
+            loadSeconds = atoi(argv[i + 3]);
+            i += 3;
+        }
+        else if (!strcmp(argv[i], "--stream") && i + 1 < argc)
+        {
+            streamPath = argv[++i];
+        }
+        else if (!strcmp(argv[i], "--record") && i + 1 < argc)
+        {
+            recordPath = argv[++i];
+        }
+        else if (!strcmp(argv[i], "--spectate") && i + 1 < argc)
+        {
+            spectatePath = argv[++i];
+        }
+        else if (!strcmp(argv[i], "--assets") && i + 1 < argc)
+        {
+            assetDir = argv[++i];
+        }
+        else if (!strcmp(argv[i], "--embed-assets") && i + 1 < argc)
+        {
+            doEmbedAssets(argv[i + 1], i + 2 < argc ? argv[i + 2] : "../img");
+            return 0;
+        }
+        else if (!strcmp(argv[i], "--video") && i + 1 < argc)
+        {
+            videoPath = argv[++i];
+            videoFrames = i + 1 < argc && atoi(argv[i + 1]) > 0 ? (unsigned int)atoi(argv[++i]) : 60 * TICK_RATE;
+        }
+        else if (!strcmp(argv[i], "--compare-frames"))
+        {
+            compareFrames = i + 1 < argc && atoi(argv[i + 1]) > 0 ? (unsigned int)atoi(argv[++i]) : 600;
+        }
+        else if (!strcmp(argv[i], "--trace") && i + 1 < argc)
+        {
+#ifdef PROFILE
+            profileTracePath = argv[++i];
+#else
+            fprintf(stderr, "--trace needs a build with -DPROFILE, ignoring it\n");
+            i++;
+#endif
+        }
+        else if (!strcmp(argv[i], "--path-stats"))
+        {
+            pathStatsTable.isEnabled = SDL_TRUE;
+        }
+        else if (!strcmp(argv[i], "--path-overlay"))
+        {
+            pathStatsTable.isEnabled = pathStatsTable.isTracing = SDL_TRUE;
+        }
+        else if (!strcmp(argv[i], "--telemetry"))
+        {
+            isTelemetryEnabled = SDL_TRUE;
+        }
+        else if (!strcmp(argv[i], "--top"))
+        {
+            doRunTop(i + 1 < argc && atoi(argv[i + 1]) > 0 ? atoi(argv[++i]) : 0);
+            return 0;
+        }
+        else if (!strcmp(argv[i], "--turn-window") && i + 1 < argc)
+        {
+            turnWindowTicks = (unsigned int)abs(atoi(argv[++i])) * TICK_RATE / 1000;
+        }
+        else if (!strcmp(argv[i], "--no-speculate"))
+        {
+            isSpeculating = SDL_FALSE;
+        }
+        else if (!strcmp(argv[i], "--no-batch"))
+        {
+            spriteAtlas.isBatching = SDL_FALSE;
+        }
+        else if (!strcmp(argv[i], "--decode") && i + 1 < argc)
+        {
+            doLoadMaze(mazePath);
+            doDecodeRecording(argv[++i]);
+            return 0;
+        }
+        else if (!strcmp(argv[i], "--bench") && i + 1 < argc)
+        {
+            benchReport = argv[++i];
+            benchBaseline = i + 1 < argc && argv[i + 1][0] != '-' ? argv[++i] : NULL;
+            benchTolerance = benchBaseline && i + 1 < argc && atof(argv[i + 1]) > 0.0 ? atof(argv[++i]) : benchTolerance;
+        }
+        else if (!strcmp(argv[i], "--soak") && i + 1 < argc)
+        {
+            soakMinutes = atof(argv[++i]);
+            soakSample = i + 1 < argc && atoi(argv[i + 1]) > 0 ? (unsigned int)atoi(argv[++i]) : soakSample;
+        }
+        else if (!strcmp(argv[i], "--bench-ghosts"))
+        {
+            benchGhosts = i + 1 < argc && atoi(argv[i + 1]) > 0 ? atoi(argv[++i]) : 1024;
+        }
+        else if (!strcmp(argv[i], "--test-turns"))
+        {
+            isTestingTurns = SDL_TRUE;
+        }
+        else
+        {
+            fprintf(stderr, "Usage: %s [--ghosts N] [--maze FILE] [--compile-maze PACK] [--generate-maze W H FILE] [--autopilot [MS]] [--autopilot-threads N] [--bench-autopilot [GAMES]] [--bench-ghosts [MAX]] [--bench REPORT [BASELINE [TOLERANCE]]] [--soak MINUTES [SECONDS]] [--test-turns] [--server SOCKET] [--server-workers N] [--loadgen SOCKET SESSIONS SECONDS] [--stream SOCKET] [--record FILE] [--spectate SOCKET|FILE] [--decode FILE] [--assets DIR] [--embed-assets FILE [DIR]] [--video FILE|- [FRAMES]] [--compare-frames [FRAMES]] [--trace FILE] [--path-stats] [--path-overlay] [--telemetry] [--top [REFRESHES]] [--turn-window MS] [--no-speculate] [--no-batch]\n", argv[0]);
+            return 1;
+        }
+    }
 
-// TEXTURES
+    doLoadMaze(mazePath);
 
-void doLoadTextures(SDL_Renderer* renderer, SDL_Texture** textures)
-{
-    SDL_Surface *surfaces[8] = {
-        IMG_Load("../img/maze.png"), // 0
-        IMG_Load("../img/food.png"), // 1 
-        IMG_Load("../img/ghost.png"), // 2
-        IMG_Load("../img/pacman.png"), // 3
-        IMG_Load("../img/kill.png"), // 4
-        IMG_Load("../img/ready.png"), // 5
-        IMG_Load("../img/gameover.png"), // 6
-        IMG_Load("../img/numbers.png") // 7
-    };
+    if (packPath)
+    {
+        doCompileMaze(packPath);
+        return 0;
+    }
 
-    for (int i = 0; i < 8; i++)
+    if (isTestingTurns)
     {
-        textures[i] = SDL_CreateTextureFromSurface(renderer, surfaces[i]);
-        SDL_FreeSurface(surfaces[i]);
+        return doRunTurnTests();
     }
 
-}
+    if (benchGhosts)
+    {
+        doBenchGhosts(benchGhosts);
+        return 0;
+    }
 
-void doCleanAll(SDL_Window* window, SDL_Renderer* renderer, SDL_Texture** textures)
-{
-    for (int i = 0; i < 8; i++)
+    if (benchReport)
     {
-        SDL_DestroyTexture(textures[i]);
+        return doRunBenchSuite(benchReport, benchBaseline, benchTolerance, assetDir);
     }
 
-    SDL_DestroyRenderer(renderer);
-    SDL_DestroyWindow(window);
-    SDL_Quit();
-}
+    if (benchAutopilot)
+    {
+        doBenchAutopilot(benchAutopilot, autopilotMs ? autopilotMs : 20, autopilotThreads);
+        return 0;
+    }
 
-// GAME LOOP
+    if (ghosts < 1)
+    {
+        ghosts = 1;
+    }
 
-void doGameLoop(SDL_Window* window, SDL_Renderer* renderer, SDL_Texture** textures)
-{
-    SDL_bool done = SDL_FALSE;
-    SDL_Event event;
+    if (soakMinutes > 0.0)
+    {
+        return doRunSoak(soakMinutes, soakSample, ghosts);
+    }
 
-    gameClass game = { SDL_FALSE, 3, 245, 0, 0, 0 };   
-    playerClass player;
-    enemyClass enemy[4];
+    if (serverPath)
+    {
+        doSeedRandom((uint64_t)time(NULL));
+        doRunServer(serverPath, ghosts, serverWorkers);
+        return 0;
+    }
 
-    doInitGrid();
-    doInitPlayer(&player);
-    doInitEnemy(enemy);
+    if (loadPath)
+    {
+        doRunLoadGenerator(loadPath, SDL_max(1, loadSessions), SDL_max(1, loadSeconds));
+        return 0;
+    }
 
-    doReadScore(&game);
-    
-    while (!done)
+    if (videoPath)
     {
-        done = doPlayerMove(window, &event, &game, &player);
-        
-        doCheckScore(&game);
-        doRefreshScreen(renderer);
+        doRenderVideo(videoPath, videoFrames, ghosts, autopilotMs, autopilotThreads, assetDir);
+        return 0;
+    }
 
-        if (!game.gameOver)
-        {
-            doDrawBackground(renderer, &game, textures[0]);
-        
-            if (player.isAlive) 
-            {   
-                player.isMoving = SDL_TRUE;
-                if (player.curHeading == idle)
-                {
-                    doDrawTextReady(renderer, textures[5]);
-                }
+    if (compareFrames)
+    {
+        return doCompareFrames(compareFrames, ghosts, assetDir);
+    }
 
-                if (game.ballsLeft > 0)
-                {
-                    if (player.curHeading != idle)
-                    {
-                        doEatFood(&game, &player, enemy);
-                        doUpdateEnemyState(&game, &player, enemy);
-                        doEnemyMove(&game, &player, enemy);
-                        doCheckEncounter(&game, &player, enemy);
-                    }
-                } 
-                else 
-                {
-                    player.isMoving = SDL_FALSE;
-                    if (doGamePause(&game, 3))
-                    {
-                        doInitGrid();
-                        doInitPlayer(&player);
-                        doInitEnemy(enemy);
-                        game.ballsLeft = 245;
-                    }
-                }
+    doInitEngine(&window, &renderer);
+    startup.engine = doMonotonicNs();
+    doLoadTextures(renderer, assetDir);
 
-                doDrawFood(renderer, textures[1]);
-                doDrawPacman(renderer, &player, textures[3]);
-                doDrawGhosts(renderer, &player, enemy, textures[2]);
-                doDrawLives(renderer, &game, textures[3]);
-                doDrawScore(renderer, &game, textures[7]);
-            } 
-            else
-            {
-                player.isMoving = SDL_FALSE;
-                if (doGamePause(&game, 3))
-                {
-                    if (game.playerLives > 1)
-                    {
-                        game.playerLives--;
-                    }
-                    else
-                    {
-                        game.gameOver = SDL_TRUE;
-                        doInitGrid();
-                        game.playerLives = 3;
-                        game.ballsLeft = 245;
-                        game.currentScore = 0;
-                    }
-                
-                    doInitPlayer(&player);
-                    doInitEnemy(enemy);
-                }
-                
-                // this condition is to avoid a frame leak of pacman which is visible after gameover becomes true
-                if (!game.gameOver)
-                {
-                    doDrawPacmanKill(renderer, &game, &player, textures[3], textures[4]);
-                }
-            }
-        } 
-        else 
-        {
-            player.isMoving = SDL_FALSE;
-            doDrawTextGameOver(renderer, textures[6]);
-        }
+    if (spectatePath)
+    {
+        doSpectate(window, renderer, spectatePath);
+        doCleanAll(window, renderer);
+        return 0;
+    }
 
-        SDL_RenderPresent(renderer);
-        SDL_Delay(FPS);
+    if (streamPath || recordPath)
+    {
+        stream = doOpenStream(streamPath, recordPath, ghosts);
     }
-    
-    doWriteScore(&game);
-}
 
-// MAIN ROUTINES
+    doSeedRandom((uint64_t)time(NULL));
+    doGameLoop(window, renderer, ghosts, autopilotMs, autopilotThreads, stream);
 
-int main(void)
-{
-    SDL_Window *window = NULL;
-    SDL_Renderer *renderer = NULL;
-    SDL_Texture *textures[8]; 
+    if (stream)
+    {
+        doCloseStream(stream, streamPath);
+    }
 
-    doInitEngine(&window, &renderer);
-    doLoadTextures(renderer, textures);
-    srand(time(NULL));  
-    doGameLoop(window, renderer, textures);
-    doCleanAll(window, renderer, textures);
+    doCleanAll(window, renderer);
 
     return 0;
-}
\ No newline at end of file
+}